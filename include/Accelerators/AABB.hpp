@@ -0,0 +1,175 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Matrix.hpp"
+#include "Ray.hpp"
+#include "Tuples/Point.hpp"
+#include "Tuples/Vector.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief An axis aligned bounding box in world space
+     *
+     */
+    struct AABB
+    {
+        [[nodiscard]] constexpr AABB()
+            : m_min(std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()),
+              m_max(-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity())
+        {
+        }
+
+        [[nodiscard]] constexpr AABB(const Point &min, const Point &max) : m_min(min), m_max(max) {}
+
+        // a box that contains all of space (used by the unbounded planes)
+        [[nodiscard]] static constexpr AABB infinite() noexcept
+        {
+            return AABB(Point(-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()),
+                        Point(std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()));
+        }
+
+        // world space bounds of the unit box [-1, 1]^3 after being transformed by the given matrix
+        [[nodiscard]] static AABB from_unit_box(const Matrix4 &transform) noexcept
+        {
+            AABB res;
+
+            for (int i = 0; i < 8; i++)
+            {
+                Point corner((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+                res.expand(transform * corner);
+            }
+
+            return res;
+        }
+
+        // bounds of the box after being transformed by the given matrix, unbounded boxes stay infinite and empty ones empty
+        [[nodiscard]] AABB transformed(const Matrix4 &transform) const noexcept
+        {
+            if (is_empty() || !is_finite())
+                return is_empty() ? AABB() : infinite();
+
+            AABB res;
+
+            for (int i = 0; i < 8; i++)
+            {
+                Point corner((i & 1) ? m_max.x : m_min.x, (i & 2) ? m_max.y : m_min.y, (i & 4) ? m_max.z : m_min.z);
+                res.expand(transform * corner);
+            }
+
+            return res;
+        }
+
+        constexpr AABB &expand(const Point &p) noexcept
+        {
+            m_min = Point(std::min(m_min.x, p.x), std::min(m_min.y, p.y), std::min(m_min.z, p.z));
+            m_max = Point(std::max(m_max.x, p.x), std::max(m_max.y, p.y), std::max(m_max.z, p.z));
+
+            return *this;
+        }
+
+        constexpr AABB &expand(const AABB &other) noexcept
+        {
+            m_min = Point(std::min(m_min.x, other.m_min.x), std::min(m_min.y, other.m_min.y), std::min(m_min.z, other.m_min.z));
+            m_max = Point(std::max(m_max.x, other.m_max.x), std::max(m_max.y, other.m_max.y), std::max(m_max.z, other.m_max.z));
+
+            return *this;
+        }
+
+        [[nodiscard]] constexpr bool is_empty() const noexcept
+        {
+            return m_min.x > m_max.x || m_min.y > m_max.y || m_min.z > m_max.z;
+        }
+
+        [[nodiscard]] bool is_finite() const noexcept
+        {
+            return std::isfinite(m_min.x) && std::isfinite(m_min.y) && std::isfinite(m_min.z) &&
+                   std::isfinite(m_max.x) && std::isfinite(m_max.y) && std::isfinite(m_max.z);
+        }
+
+        [[nodiscard]] constexpr Point centroid() const noexcept
+        {
+            return Point((m_min.x + m_max.x) * 0.5f, (m_min.y + m_max.y) * 0.5f, (m_min.z + m_max.z) * 0.5f);
+        }
+
+        [[nodiscard]] constexpr Vector extent() const noexcept
+        {
+            return m_max - m_min;
+        }
+
+        [[nodiscard]] constexpr float surface_area() const noexcept
+        {
+            if (is_empty())
+                return 0;
+
+            Vector e = extent();
+
+            return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+
+        // squared distance from a point to the box, 0 inside of it
+        [[nodiscard]] constexpr float distance_squared(const Point &p) const noexcept
+        {
+            const float dx = std::max({m_min.x - p.x, 0.0f, p.x - m_max.x});
+            const float dy = std::max({m_min.y - p.y, 0.0f, p.y - m_max.y});
+            const float dz = std::max({m_min.z - p.z, 0.0f, p.z - m_max.z});
+
+            return dx * dx + dy * dy + dz * dz;
+        }
+
+        // index of the longest axis (0 = x, 1 = y, 2 = z)
+        [[nodiscard]] constexpr int longest_axis() const noexcept
+        {
+            Vector e = extent();
+
+            if (e.x >= e.y && e.x >= e.z)
+                return 0;
+
+            return e.y >= e.z ? 1 : 2;
+        }
+
+        /**
+         * @brief Slab test against a ray
+         *
+         * @param ray The ray to test, boxes that end before its m_t_min or start at or after its m_t_max (the closest hit so far) are rejected
+         * @return float The entry distance, or infinity on a miss
+         */
+        [[nodiscard]] float intersects(const Ray &ray) const noexcept
+        {
+            const Vector &inverse_direction = ray.m_inverse_direction;
+
+            float tx1 = (m_min.x - ray.m_origin.x) * inverse_direction.x;
+            float tx2 = (m_max.x - ray.m_origin.x) * inverse_direction.x;
+
+            float t_near = std::min(tx1, tx2);
+            float t_far = std::max(tx1, tx2);
+
+            float ty1 = (m_min.y - ray.m_origin.y) * inverse_direction.y;
+            float ty2 = (m_max.y - ray.m_origin.y) * inverse_direction.y;
+
+            t_near = std::max(t_near, std::min(ty1, ty2));
+            t_far = std::min(t_far, std::max(ty1, ty2));
+
+            float tz1 = (m_min.z - ray.m_origin.z) * inverse_direction.z;
+            float tz2 = (m_max.z - ray.m_origin.z) * inverse_direction.z;
+
+            t_near = std::max(t_near, std::min(tz1, tz2));
+            t_far = std::min(t_far, std::max(tz1, tz2));
+
+            if (t_far >= t_near && t_far > ray.m_t_min && t_near < ray.m_t_max)
+                return t_near;
+
+            return std::numeric_limits<float>::infinity();
+        }
+
+        // << operator
+        friend std::ostream &operator<<(std::ostream &os, const AABB &box)
+        {
+            os << "AABB(min=" << box.m_min << ", max=" << box.m_max << ")";
+            return os;
+        }
+
+        Point m_min;
+        Point m_max;
+    };
+} // namespace COAL
@@ -0,0 +1,1626 @@
+#pragma once
+
+#include "Accelerators/AABB.hpp"
+#include "Accelerators/CompiledShapes.hpp"
+#include "Constants.hpp"
+#include "Intersection.hpp"
+#include "Profiling/RenderCounters.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "Shapes/Shape.hpp"
+#include "Threading/ThreadPool.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief A node of a flattened bounding volume hierarchy
+     *
+     * Interior nodes store the index of their left child (the right child always follows it), leaves store the index of their first primitive.
+     */
+    struct BVHNode
+    {
+        [[nodiscard]] constexpr bool is_leaf() const noexcept
+        {
+            return m_count > 0;
+        }
+
+        AABB m_bounds;
+        uint32_t m_left_first = 0;
+        uint32_t m_count = 0;
+    };
+
+    /**
+     * @brief Builds a binned surface-area-heuristic hierarchy over a set of primitive bounds
+     *
+     * The builder only knows about boxes, the caller maps the resulting primitive order back onto its own primitives.
+     *
+     * Given a thread pool the top of the tree is split on the calling thread with the binning of large nodes spread over the workers,
+     * and the subtrees below it are built as tasks. Bins only take minimums, maximums and counts, and every node is still partitioned
+     * by one thread, so the result is the same as the one of the serial build node for node.
+     */
+    struct BVHBuilder
+    {
+        static constexpr int kBinCount = 16;
+        static constexpr uint32_t kMaxLeafSize = 4;
+        static constexpr int kMaxDepth = 60;
+        static constexpr float kTraversalCost = 1.0f;
+        static constexpr float kIntersectionCost = 1.0f;
+
+        // nodes with fewer primitives are binned by one thread, the workers would mostly wait on each other
+        static constexpr uint32_t kParallelBinSize = 32768;
+        // the parallel build hands subtrees of at most max(kMinTaskSize, primitives / (workers * kTasksPerWorker)) primitives to one worker
+        static constexpr uint32_t kMinTaskSize = 4096;
+        static constexpr uint32_t kTasksPerWorker = 8;
+
+        /**
+         * @brief Build the hierarchy
+         *
+         * @param bounds The world space bounds of every primitive
+         * @param nodes Output, the flattened nodes with the root at index 0
+         * @param indices Output, the primitive indices in leaf order
+         * @param pool Workers to build with, nullptr (or a pool with one worker) builds on the calling thread. Must not be called from a job of the pool
+         * @param root_depth The depth the root will have in the final tree, a subtree spliced under a deep node stops splitting at kMaxDepth overall
+         */
+        static void build(const std::vector<AABB> &bounds, std::vector<BVHNode> &nodes, std::vector<uint32_t> &indices, ThreadPool *pool = nullptr,
+                          const int root_depth = 0)
+        {
+            PROFILE_FUNCTION();
+
+            nodes.clear();
+            indices.resize(bounds.size());
+
+            for (uint32_t i = 0; i < bounds.size(); i++)
+                indices[i] = i;
+
+            if (bounds.empty())
+                return;
+
+            if (pool && (pool->get_thread_count() <= 1 || bounds.size() <= kMinTaskSize))
+                pool = nullptr;
+
+            std::vector<Point> centroids(bounds.size());
+
+            for_range(pool, bounds.size(), [&](const size_t begin, const size_t end, [[maybe_unused]] const int worker)
+                      {
+                for (size_t i = begin; i < end; i++)
+                    centroids[i] = bounds[i].centroid(); });
+
+            nodes.reserve(bounds.size() * 2 - 1);
+
+            BVHNode root;
+            root.m_left_first = 0;
+            root.m_count = (uint32_t)bounds.size();
+            nodes.emplace_back(root);
+
+            if (pool)
+                build_parallel(*pool, root_depth, bounds, centroids, nodes, indices);
+            else
+                subdivide(0, root_depth, bounds, centroids, nodes, indices);
+        }
+
+        /**
+         * @brief The SAH cost of a built hierarchy, normalized by the area of the root
+         *
+         * @param nodes The flattened nodes
+         * @return float
+         */
+        [[nodiscard]] static float sah_cost(const std::vector<BVHNode> &nodes) noexcept
+        {
+            if (nodes.empty())
+                return 0;
+
+            float root_area = nodes[0].m_bounds.surface_area();
+
+            if (root_area <= 0)
+                return (float)nodes[0].m_count * kIntersectionCost;
+
+            float cost = 0;
+
+            for (const auto &node : nodes)
+            {
+                float area = node.m_bounds.surface_area() / root_area;
+
+                if (node.is_leaf())
+                    cost += area * (float)node.m_count * kIntersectionCost;
+                else
+                    cost += area * kTraversalCost;
+            }
+
+            return cost;
+        }
+
+    private:
+        struct Bin
+        {
+            AABB m_bounds;
+            uint32_t m_count = 0;
+        };
+
+        // the bounds of a node's primitives and of their centroids
+        struct NodeBounds
+        {
+            AABB m_bounds;
+            AABB m_centroid_bounds;
+        };
+
+        // a worker's bins along one axis
+        struct Bins
+        {
+            Bin m_bins[kBinCount];
+        };
+
+        // a subtree of the parallel build, its root is a node of the top of the tree
+        struct Task
+        {
+            uint32_t m_node;
+            int m_depth;
+            std::vector<BVHNode> m_nodes;
+        };
+
+        // fn(begin, end, worker) over [0, count), on the pool's workers if there is a pool
+        template <typename Function>
+        static void for_range(ThreadPool *pool, const size_t count, Function &&fn)
+        {
+            if (pool)
+                pool->parallel_for(count, fn);
+            else
+                fn(0, count, 0);
+        }
+
+        [[nodiscard]] static int bin_index(const float centroid, const float axis_min, const float scale) noexcept
+        {
+            return std::min(kBinCount - 1, (int)((centroid - axis_min) * scale));
+        }
+
+        /**
+         * @brief Split a node in two, or leave it a leaf
+         *
+         * Sets the node's bounds and, if splitting it is cheaper than testing its primitives, partitions its range and appends the two
+         * children.
+         *
+         * @param pool Bins nodes of at least kParallelBinSize primitives on the workers, may be nullptr
+         * @return true if the node was split
+         */
+        static bool split(const uint32_t node_index, const int depth, const std::vector<AABB> &bounds, const std::vector<Point> &centroids,
+                          std::vector<BVHNode> &nodes, std::vector<uint32_t> &indices, ThreadPool *pool)
+        {
+            const uint32_t first = nodes[node_index].m_left_first;
+            const uint32_t count = nodes[node_index].m_count;
+
+            if (count < kParallelBinSize)
+                pool = nullptr;
+
+            // with a pool every worker bins its chunk into its own copy, the copies are merged in worker order
+            const size_t workers = pool ? (size_t)pool->get_thread_count() : 0;
+
+            AABB node_bounds;
+            AABB centroid_bounds;
+
+            if (pool)
+            {
+                std::vector<NodeBounds> partial(workers);
+
+                pool->parallel_for(count, [&](const size_t begin, const size_t end, const int worker)
+                                   {
+                    NodeBounds &chunk = partial[(size_t)worker];
+
+                    for (size_t i = first + begin; i < first + end; i++)
+                    {
+                        chunk.m_bounds.expand(bounds[indices[i]]);
+                        chunk.m_centroid_bounds.expand(centroids[indices[i]]);
+                    } });
+
+                for (const NodeBounds &chunk : partial)
+                {
+                    node_bounds.expand(chunk.m_bounds);
+                    centroid_bounds.expand(chunk.m_centroid_bounds);
+                }
+            }
+            else
+            {
+                for (uint32_t i = first; i < first + count; i++)
+                {
+                    node_bounds.expand(bounds[indices[i]]);
+                    centroid_bounds.expand(centroids[indices[i]]);
+                }
+            }
+
+            nodes[node_index].m_bounds = node_bounds;
+
+            if (count <= 1 || depth >= kMaxDepth)
+                return false;
+
+            // find the cheapest split plane over all three axes
+            int best_axis = -1;
+            int best_split = 0;
+            float best_cost = std::numeric_limits<float>::infinity();
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const float axis_min = centroid_bounds.m_min[(char)axis];
+                const float axis_max = centroid_bounds.m_max[(char)axis];
+
+                if (axis_max <= axis_min)
+                    continue;
+
+                Bin bins[kBinCount];
+                const float scale = kBinCount / (axis_max - axis_min);
+
+                auto bin_range = [&](Bin(&out)[kBinCount], const size_t begin, const size_t end)
+                {
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        Bin &bin = out[bin_index(centroids[indices[i]][(char)axis], axis_min, scale)];
+                        bin.m_count++;
+                        bin.m_bounds.expand(bounds[indices[i]]);
+                    }
+                };
+
+                if (pool)
+                {
+                    std::vector<Bins> partial(workers);
+
+                    pool->parallel_for(count, [&](const size_t begin, const size_t end, const int worker)
+                                       { bin_range(partial[(size_t)worker].m_bins, first + begin, first + end); });
+
+                    for (const Bins &chunk : partial)
+                    {
+                        for (int i = 0; i < kBinCount; i++)
+                        {
+                            bins[i].m_count += chunk.m_bins[i].m_count;
+                            bins[i].m_bounds.expand(chunk.m_bins[i].m_bounds);
+                        }
+                    }
+                }
+                else
+                {
+                    bin_range(bins, first, first + count);
+                }
+
+                float left_area[kBinCount - 1];
+                uint32_t left_count[kBinCount - 1];
+
+                AABB left_box;
+                uint32_t left_sum = 0;
+
+                for (int i = 0; i < kBinCount - 1; i++)
+                {
+                    left_sum += bins[i].m_count;
+                    left_box.expand(bins[i].m_bounds);
+                    left_count[i] = left_sum;
+                    left_area[i] = left_box.surface_area();
+                }
+
+                AABB right_box;
+                uint32_t right_sum = 0;
+
+                for (int i = kBinCount - 1; i > 0; i--)
+                {
+                    right_sum += bins[i].m_count;
+                    right_box.expand(bins[i].m_bounds);
+
+                    if (left_count[i - 1] == 0 || right_sum == 0)
+                        continue;
+
+                    float cost = (float)left_count[i - 1] * left_area[i - 1] + (float)right_sum * right_box.surface_area();
+
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_split = i;
+                    }
+                }
+            }
+
+            uint32_t left_count = 0;
+
+            if (best_axis >= 0)
+            {
+                float node_area = node_bounds.surface_area();
+                float split_cost = kTraversalCost + (node_area > 0 ? kIntersectionCost * best_cost / node_area : 0);
+                float leaf_cost = (float)count * kIntersectionCost;
+
+                if (count <= kMaxLeafSize && split_cost >= leaf_cost)
+                    return false;
+
+                const float axis_min = centroid_bounds.m_min[(char)best_axis];
+                const float scale = kBinCount / (centroid_bounds.m_max[(char)best_axis] - axis_min);
+
+                // one thread partitions, the order inside each half has to match the serial build
+                auto middle = std::partition(indices.begin() + first, indices.begin() + first + count, [&](const uint32_t index)
+                                             { return bin_index(centroids[index][(char)best_axis], axis_min, scale) < best_split; });
+
+                left_count = (uint32_t)(middle - (indices.begin() + first));
+            }
+            else
+            {
+                // every centroid is in the same spot, only split to keep leaves small
+                if (count <= kMaxLeafSize)
+                    return false;
+
+                left_count = count / 2;
+            }
+
+            if (left_count == 0 || left_count == count)
+                return false;
+
+            const uint32_t left_index = (uint32_t)nodes.size();
+
+            BVHNode left;
+            left.m_left_first = first;
+            left.m_count = left_count;
+
+            BVHNode right;
+            right.m_left_first = first + left_count;
+            right.m_count = count - left_count;
+
+            nodes.emplace_back(left);
+            nodes.emplace_back(right);
+
+            nodes[node_index].m_left_first = left_index;
+            nodes[node_index].m_count = 0;
+
+            return true;
+        }
+
+        static void subdivide(const uint32_t node_index, const int depth, const std::vector<AABB> &bounds, const std::vector<Point> &centroids,
+                              std::vector<BVHNode> &nodes, std::vector<uint32_t> &indices)
+        {
+            if (!split(node_index, depth, bounds, centroids, nodes, indices, nullptr))
+                return;
+
+            const uint32_t left_index = nodes[node_index].m_left_first;
+
+            subdivide(left_index, depth + 1, bounds, centroids, nodes, indices);
+            subdivide(left_index + 1, depth + 1, bounds, centroids, nodes, indices);
+        }
+
+        /**
+         * @brief The top of the tree on this thread, the subtrees below it as tasks on the workers
+         *
+         * The serial build appends the nodes of a subtree as one block right when it starts on it, so every task's nodes are copied in as
+         * one block at the point the serial build would reach its root. nodes holds the root on entry.
+         */
+        static void build_parallel(ThreadPool &pool, const int root_depth, const std::vector<AABB> &bounds, const std::vector<Point> &centroids,
+                                   std::vector<BVHNode> &nodes, std::vector<uint32_t> &indices)
+        {
+            const uint32_t task_size = std::max(kMinTaskSize, (uint32_t)(bounds.size() / ((size_t)pool.get_thread_count() * kTasksPerWorker)));
+
+            std::vector<BVHNode> top = std::move(nodes);
+            std::vector<Task> tasks;
+
+            auto split_top = [&](auto &&self, const uint32_t node_index, const int depth) -> void
+            {
+                if (top[node_index].m_count <= task_size)
+                {
+                    tasks.push_back({node_index, depth, {}});
+                    return;
+                }
+
+                if (!split(node_index, depth, bounds, centroids, top, indices, &pool))
+                    return;
+
+                const uint32_t left_index = top[node_index].m_left_first;
+
+                self(self, left_index, depth + 1);
+                self(self, left_index + 1, depth + 1);
+            };
+
+            split_top(split_top, 0, root_depth);
+
+            // the largest subtrees first, so no worker starts a big one last
+            std::vector<uint32_t> order(tasks.size());
+
+            for (uint32_t i = 0; i < order.size(); i++)
+                order[i] = i;
+
+            std::sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b)
+                      { return top[tasks[a].m_node].m_count > top[tasks[b].m_node].m_count; });
+
+            std::atomic<size_t> next = 0;
+
+            pool.run([&]([[maybe_unused]] const int worker)
+                     {
+                for (size_t i = next++; i < order.size(); i = next++)
+                {
+                    Task &task = tasks[order[i]];
+
+                    task.m_nodes.reserve((size_t)top[task.m_node].m_count * 2 - 1);
+                    task.m_nodes.emplace_back(top[task.m_node]);
+
+                    subdivide(0, task.m_depth, bounds, centroids, task.m_nodes, indices);
+                } });
+
+            std::vector<int32_t> task_of(top.size(), -1);
+
+            for (size_t i = 0; i < tasks.size(); i++)
+                task_of[tasks[i].m_node] = (int32_t)i;
+
+            nodes.clear();
+            nodes.reserve(bounds.size() * 2 - 1);
+            nodes.emplace_back();
+
+            // place a node of the top at index to, the way the serial build appends the nodes below it
+            auto place = [&](auto &&self, const uint32_t from, const uint32_t to) -> void
+            {
+                if (task_of[from] >= 0)
+                {
+                    const std::vector<BVHNode> &subtree = tasks[(size_t)task_of[from]].m_nodes;
+
+                    // node i > 0 of the task lands at base + i - 1
+                    const uint32_t base = (uint32_t)nodes.size();
+
+                    auto relocate = [&](BVHNode node)
+                    {
+                        if (!node.is_leaf())
+                            node.m_left_first = base + node.m_left_first - 1;
+
+                        return node;
+                    };
+
+                    nodes[to] = relocate(subtree[0]);
+
+                    for (size_t i = 1; i < subtree.size(); i++)
+                        nodes.emplace_back(relocate(subtree[i]));
+
+                    return;
+                }
+
+                const BVHNode &node = top[from];
+
+                nodes[to] = node;
+
+                if (node.is_leaf())
+                    return;
+
+                const auto left = (uint32_t)nodes.size();
+
+                nodes[to].m_left_first = left;
+                nodes.resize(nodes.size() + 2);
+
+                self(self, node.m_left_first, left);
+                self(self, node.m_left_first + 1, left + 1);
+            };
+
+            place(place, 0, 0);
+        }
+    };
+
+    /**
+     * @brief What the last BVH::refit did and where it spent its time
+     *
+     */
+    struct BVHUpdateStats
+    {
+        // moved shapes whose leaves were refit
+        uint32_t m_refit_shapes = 0;
+        // subtrees rebuilt because their quality dropped
+        uint32_t m_rebuilt_subtrees = 0;
+        // the whole tree was built again, moved shapes changed between the tree and the linear list or local rebuilds were not enough
+        bool m_full_rebuild = false;
+
+        // the SAH cost of the last full build, and the cost after the update
+        float m_reference_sah = 0;
+        float m_sah = 0;
+
+        double m_refit_ms = 0;
+        double m_rebuild_ms = 0;
+
+        [[nodiscard]] nlohmann::json to_json() const
+        {
+            nlohmann::json json;
+
+            json["refit_shapes"] = m_refit_shapes;
+            json["rebuilt_subtrees"] = m_rebuilt_subtrees;
+            json["full_rebuild"] = m_full_rebuild;
+            json["reference_sah"] = m_reference_sah;
+            json["sah"] = m_sah;
+            json["refit_ms"] = m_refit_ms;
+            json["rebuild_ms"] = m_rebuild_ms;
+
+            return json;
+        }
+    };
+
+    /**
+     * @brief What the last full BVH build produced and how long it took
+     *
+     */
+    struct BVHBuildStats
+    {
+        // shapes placed in the tree and shapes kept in the linear list
+        uint32_t m_primitives = 0;
+        uint32_t m_linear_shapes = 0;
+        uint32_t m_nodes = 0;
+        // workers of the build, 1 for a build on the calling thread
+        int m_threads = 1;
+        float m_sah = 0;
+        double m_build_ms = 0;
+
+        [[nodiscard]] nlohmann::json to_json() const
+        {
+            nlohmann::json json;
+
+            json["primitives"] = m_primitives;
+            json["linear_shapes"] = m_linear_shapes;
+            json["nodes"] = m_nodes;
+            json["threads"] = m_threads;
+            json["sah"] = m_sah;
+            json["build_ms"] = m_build_ms;
+
+            return json;
+        }
+    };
+
+    /**
+     * @brief Bounding volume hierarchy over the shapes of a World
+     *
+     * Finite shapes (Sphere, Cube) are placed in the tree using their world space bounds while the unbounded planes are kept in a small side list
+     * that is tested linearly for every ray. Scenes of only a few shapes put everything in that list. The scalar queries test the list through
+     * its CompiledShapes copy, grouped by type and intersected with SIMD.
+     *
+     * Moved shapes are refit into the existing tree (refit()), subtrees whose quality dropped too far are rebuilt on their own. Every
+     * subtree holds a contiguous range of m_primitives, so a subtree is rebuilt by building over its range and splicing the result in.
+     */
+    struct BVH
+    {
+        [[nodiscard]] BVH() = default;
+
+        // (re)build the hierarchy over the given shapes, the shapes must outlive the BVH
+        void build(const std::vector<std::shared_ptr<Shape>> &shapes)
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            m_primitives.clear();
+            m_primitive_bounds.clear();
+            m_primitive_inputs.clear();
+            m_unused_primitives = 0;
+            m_linear_shapes.clear();
+
+            std::vector<const Shape *> bounded;
+            std::vector<AABB> bounds;
+            std::vector<uint32_t> inputs;
+
+            // a handful of shapes is tested faster in one SIMD loop than through a tree
+            const bool linear = shapes.size() <= kMaxLinearShapes;
+
+            ThreadPool *pool = m_pool && m_pool->get_thread_count() > 1 && shapes.size() > BVHBuilder::kMinTaskSize ? m_pool : nullptr;
+
+            std::vector<AABB> boxes(shapes.size());
+
+            auto gather = [&](const size_t begin, const size_t end, [[maybe_unused]] const int worker)
+            {
+                for (size_t i = begin; i < end; i++)
+                    boxes[i] = shapes[i]->bounds();
+            };
+
+            if (pool)
+                pool->parallel_for(shapes.size(), gather);
+            else
+                gather(0, shapes.size(), 0);
+
+            for (uint32_t i = 0; i < shapes.size(); i++)
+            {
+                const AABB &box = boxes[i];
+
+                if (box.is_finite() && !linear)
+                {
+                    bounded.emplace_back(shapes[i].get());
+                    bounds.emplace_back(box);
+                    inputs.emplace_back(i);
+                }
+                else
+                    m_linear_shapes.emplace_back(shapes[i].get());
+            }
+
+            m_linear.compile(m_linear_shapes);
+
+            std::vector<uint32_t> indices;
+            BVHBuilder::build(bounds, m_nodes, indices, pool);
+
+            m_primitives.reserve(indices.size());
+            m_primitive_bounds.reserve(indices.size());
+            m_primitive_inputs.reserve(indices.size());
+
+            for (const uint32_t index : indices)
+            {
+                m_primitives.emplace_back(bounded[index]);
+                m_primitive_bounds.emplace_back(bounds[index]);
+                m_primitive_inputs.emplace_back(inputs[index]);
+            }
+
+            m_input_count = (uint32_t)shapes.size();
+
+            m_built_areas.resize(m_nodes.size());
+
+            for (size_t i = 0; i < m_nodes.size(); i++)
+                m_built_areas[i] = m_nodes[i].m_bounds.surface_area();
+
+            index_tree();
+
+            m_reference_sah = BVHBuilder::sah_cost(m_nodes);
+
+            m_update_stats = BVHUpdateStats();
+            m_update_stats.m_full_rebuild = true;
+            m_update_stats.m_reference_sah = m_reference_sah;
+            m_update_stats.m_sah = m_reference_sah;
+            m_update_stats.m_rebuild_ms = elapsed_ms(start);
+
+            m_build_stats.m_primitives = (uint32_t)m_primitives.size();
+            m_build_stats.m_linear_shapes = (uint32_t)m_linear_shapes.size();
+            m_build_stats.m_nodes = (uint32_t)m_nodes.size();
+            m_build_stats.m_threads = pool ? pool->get_thread_count() : 1;
+            m_build_stats.m_sah = m_reference_sah;
+            m_build_stats.m_build_ms = m_update_stats.m_rebuild_ms;
+        }
+
+        /**
+         * @brief Build (and rebuild) on the workers of a pool, the tree is the same as without one
+         *
+         * @param pool The pool, usually the render pool, nullptr builds on the calling thread. Builds must not run inside a job of the pool
+         */
+        void set_thread_pool(ThreadPool *pool) noexcept
+        {
+            m_pool = pool;
+        }
+
+        // the last full build
+        [[nodiscard]] const BVHBuildStats &get_build_stats() const noexcept
+        {
+            return m_build_stats;
+        }
+
+        /**
+         * @brief Bring the tree up to date after some shapes moved, without building it again
+         *
+         * The leaves of the moved shapes and their ancestors get the new bounds. If that raises the SAH cost more than the allowed growth
+         * over the last full build, the subtrees above the moved shapes that grew the most are rebuilt, and the whole tree if that is
+         * not enough. Moved planes (or shapes of the linear list) only compile the list again.
+         *
+         * @param shapes The shapes the BVH was built from, in the same order
+         * @param moved The positions of the moved shapes in shapes
+         */
+        void refit(const std::vector<std::shared_ptr<Shape>> &shapes, std::span<const uint32_t> moved)
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            // shapes were added or removed, or a shape left the tree's side of the split (it became unbounded)
+            auto rebuild = [&]()
+            {
+                build(shapes);
+                m_update_stats.m_refit_shapes = (uint32_t)moved.size();
+            };
+
+            if (shapes.size() != m_input_count)
+                return rebuild();
+
+            BVHUpdateStats stats;
+            stats.m_reference_sah = m_reference_sah;
+
+            bool linear_moved = false;
+            std::vector<uint32_t> leaves;
+
+            for (const uint32_t input : moved)
+            {
+                const uint32_t primitive = m_input_primitives[input];
+
+                if (primitive == kNoPrimitive)
+                {
+                    linear_moved = true;
+                    continue;
+                }
+
+                const AABB box = shapes[input]->bounds();
+
+                if (!box.is_finite())
+                    return rebuild();
+
+                m_primitive_bounds[primitive] = box;
+                leaves.emplace_back(m_primitive_leaves[primitive]);
+            }
+
+            if (linear_moved)
+                m_linear.compile(m_linear_shapes);
+
+            for (const uint32_t leaf : leaves)
+                refit_path(leaf);
+
+            stats.m_refit_shapes = (uint32_t)moved.size();
+            stats.m_sah = BVHBuilder::sah_cost(m_nodes);
+            stats.m_refit_ms = elapsed_ms(start);
+
+            if (!leaves.empty() && stats.m_sah > m_reference_sah * (1 + m_max_sah_growth))
+            {
+                const auto rebuild_start = std::chrono::steady_clock::now();
+
+                const std::vector<uint32_t> subtrees = degraded_subtrees(leaves);
+
+                stats.m_rebuilt_subtrees = (uint32_t)subtrees.size();
+
+                if (std::find(subtrees.begin(), subtrees.end(), 0u) == subtrees.end())
+                {
+                    rebuild_subtrees(subtrees);
+                    stats.m_sah = BVHBuilder::sah_cost(m_nodes);
+                }
+
+                // the root itself grew too much, or the local rebuilds did not win back enough
+                if (stats.m_sah > m_reference_sah * (1 + m_max_sah_growth))
+                {
+                    rebuild_subtrees({0});
+
+                    m_reference_sah = BVHBuilder::sah_cost(m_nodes);
+
+                    stats.m_full_rebuild = true;
+                    stats.m_sah = m_reference_sah;
+                    stats.m_reference_sah = m_reference_sah;
+                }
+
+                stats.m_rebuild_ms = elapsed_ms(rebuild_start);
+            }
+
+            m_update_stats = stats;
+        }
+
+        /**
+         * @brief Take a removed shape out of the tree, without building it again
+         *
+         * Mirrors an erase from the shapes: the shape at position input leaves the tree, and the shapes behind it move up a position. The
+         * primitive leaves its leaf, a leaf left empty is replaced by its sibling, and the bounds above it are refit. Removing only shrinks
+         * boxes, so the tree's quality is not checked, the next full build reclaims the unused entries.
+         *
+         * @param input The position of the removed shape in the shapes the BVH was built from
+         * @param shape The removed shape
+         */
+        void erase(const uint32_t input, const Shape &shape)
+        {
+            PROFILE_FUNCTION();
+
+            const uint32_t primitive = m_input_primitives[input];
+
+            if (primitive == kNoPrimitive)
+            {
+                std::erase(m_linear_shapes, &shape);
+                m_linear.compile(m_linear_shapes);
+            }
+            else
+                erase_primitive(primitive);
+
+            // the shapes behind it move up a position
+            m_input_primitives.erase(m_input_primitives.begin() + input);
+            m_input_count--;
+
+            for (uint32_t &primitive_input : m_primitive_inputs)
+                if (primitive_input != kNoInput && primitive_input > input)
+                    primitive_input--;
+        }
+
+        // how much the SAH cost may grow over the last full build before refit() rebuilds, 0.3 allows 30% more
+        void set_max_sah_growth(const float growth) noexcept
+        {
+            m_max_sah_growth = std::max(0.0f, growth);
+        }
+
+        [[nodiscard]] float get_max_sah_growth() const noexcept
+        {
+            return m_max_sah_growth;
+        }
+
+        // what the last build() or refit() did
+        [[nodiscard]] const BVHUpdateStats &get_update_stats() const noexcept
+        {
+            return m_update_stats;
+        }
+
+        /**
+         * @brief Find the closest intersection inside the ray's range
+         *
+         * Every hit shrinks the range, so boxes and shapes further away than it are skipped.
+         *
+         * @param ray The world space ray
+         * @return Intersection The closest hit, or a default Intersection (m_t < 0) on a miss
+         */
+        [[nodiscard]] Intersection closest_hit(const Ray &ray) const
+        {
+            PROFILE_FUNCTION();
+
+            Intersection closest;
+
+            const bool linear_hit = m_linear.closest_hit(ray, closest);
+
+            if (m_nodes.empty())
+                return closest;
+
+            Ray query = ray;
+
+            if (linear_hit)
+                query.m_t_max = closest.m_t;
+
+            auto test = [&](const Shape *shape)
+            {
+                Intersection xs = shape->intersects(query);
+
+                COUNT_SHAPE_TEST(*shape, query.in_range(xs.m_t));
+
+                if (query.in_range(xs.m_t))
+                {
+                    closest = xs;
+                    query.m_t_max = xs.m_t;
+                }
+            };
+
+            if (m_nodes[0].m_bounds.intersects(query) == std::numeric_limits<float>::infinity())
+                return closest;
+
+            struct StackEntry
+            {
+                uint32_t m_node;
+                float m_t;
+            };
+
+            StackEntry stack[kStackSize];
+            int stack_pointer = 0;
+
+            uint32_t node_index = 0;
+
+            while (true)
+            {
+                const BVHNode &node = m_nodes[node_index];
+
+                COUNT_BVH_NODE();
+
+                if (node.is_leaf())
+                {
+                    for (uint32_t i = node.m_left_first; i < node.m_left_first + node.m_count; i++)
+                        test(m_primitives[i]);
+                }
+                else
+                {
+                    uint32_t near_child = node.m_left_first;
+                    uint32_t far_child = node.m_left_first + 1;
+
+                    float near_t = m_nodes[near_child].m_bounds.intersects(query);
+                    float far_t = m_nodes[far_child].m_bounds.intersects(query);
+
+                    if (far_t < near_t)
+                    {
+                        std::swap(near_child, far_child);
+                        std::swap(near_t, far_t);
+                    }
+
+                    if (near_t != std::numeric_limits<float>::infinity())
+                    {
+                        if (far_t != std::numeric_limits<float>::infinity())
+                            stack[stack_pointer++] = {far_child, far_t};
+
+                        node_index = near_child;
+                        continue;
+                    }
+                }
+
+                // pop the next node that can still hold a closer hit
+                bool found = false;
+
+                while (stack_pointer > 0)
+                {
+                    const StackEntry &entry = stack[--stack_pointer];
+
+                    if (entry.m_t < query.m_t_max)
+                    {
+                        node_index = entry.m_node;
+                        found = true;
+                        break;
+                    }
+                }
+
+                if (!found)
+                    break;
+            }
+
+            return closest;
+        }
+
+        /**
+         * @brief Find the closest intersection of every active lane of a packet
+         *
+         * Walks the tree once for the whole packet, a node is entered while any lane still overlaps it. Every lane sees the same box
+         * and shape tests the scalar closest_hit would run for its ray, so the hits match it (up to which of two shapes at exactly the
+         * same distance wins). Shapes without a packet kernel, and packets whose rays diverged down to a few active lanes, are tested lane by
+         * lane.
+         *
+         * @param packet The rays, m_t and m_hit receive the closest hit per lane
+         */
+        void closest_hit(RayPacket &packet) const
+        {
+            PROFILE_FUNCTION();
+
+            auto test = [&](const Shape *shape, const uint32_t mask)
+            {
+                uint32_t hits = 0;
+
+                if (std::popcount(mask) <= kPacketScalarLanes || !shape->intersects(packet, mask, hits))
+                {
+                    hits = 0;
+
+                    for (int lane = 0; lane < kPacketSize; lane++)
+                    {
+                        if (!(mask & (1u << lane)))
+                            continue;
+
+                        const Ray ray = packet.get_ray(lane);
+                        Intersection xs = shape->intersects(ray);
+
+                        if (ray.in_range(xs.m_t))
+                        {
+                            hits |= 1u << lane;
+                            packet.m_t[lane] = xs.m_t;
+                            packet.m_hit[lane] = shape;
+                            packet.m_geometry[lane] = xs.m_geometry;
+                            packet.m_primitive[lane] = xs.m_primitive;
+                        }
+                    }
+                }
+
+                COUNT_SHAPE_PACKET_TEST(*shape, mask, hits);
+            };
+
+            for (const Shape *shape : m_linear_shapes)
+                test(shape, packet.m_active);
+
+            if (m_nodes.empty())
+                return;
+
+            struct StackEntry
+            {
+                alignas(32) float m_t[kPacketSize];
+                uint32_t m_node;
+                uint32_t m_mask;
+            };
+
+            StackEntry stack[kStackSize];
+            int stack_pointer = 0;
+
+            PacketFloat root_t;
+            uint32_t mask = intersect_box(m_nodes[0].m_bounds, packet, packet.m_active, root_t);
+
+            uint32_t node_index = 0;
+
+            while (mask)
+            {
+                const BVHNode &node = m_nodes[node_index];
+
+                COUNT_BVH_NODE();
+
+                if (node.is_leaf())
+                {
+                    for (uint32_t i = node.m_left_first; i < node.m_left_first + node.m_count; i++)
+                        test(m_primitives[i], mask);
+                }
+                else
+                {
+                    uint32_t near_child = node.m_left_first;
+                    uint32_t far_child = node.m_left_first + 1;
+
+                    PacketFloat near_t, far_t;
+                    uint32_t near_mask = intersect_box(m_nodes[near_child].m_bounds, packet, mask, near_t);
+                    uint32_t far_mask = intersect_box(m_nodes[far_child].m_bounds, packet, mask, far_t);
+
+                    // the first lane that sees both children decides which one is visited first
+                    if (const uint32_t both = near_mask & far_mask)
+                    {
+                        alignas(32) float near_distances[kPacketSize], far_distances[kPacketSize];
+                        near_t.store(near_distances);
+                        far_t.store(far_distances);
+
+                        const int lane = std::countr_zero(both);
+
+                        if (far_distances[lane] < near_distances[lane])
+                        {
+                            std::swap(near_child, far_child);
+                            std::swap(near_mask, far_mask);
+                            std::swap(near_t, far_t);
+                        }
+                    }
+                    else if (!near_mask)
+                    {
+                        std::swap(near_child, far_child);
+                        std::swap(near_mask, far_mask);
+                        std::swap(near_t, far_t);
+                    }
+
+                    if (near_mask)
+                    {
+                        if (far_mask)
+                        {
+                            StackEntry &entry = stack[stack_pointer++];
+                            far_t.store(entry.m_t);
+                            entry.m_node = far_child;
+                            entry.m_mask = far_mask;
+                        }
+
+                        node_index = near_child;
+                        mask = near_mask;
+                        continue;
+                    }
+                }
+
+                // pop the next node where a lane can still find a closer hit
+                mask = 0;
+
+                while (stack_pointer > 0 && !mask)
+                {
+                    const StackEntry &entry = stack[--stack_pointer];
+
+                    mask = (PacketFloat::load(entry.m_t) < PacketFloat::load(packet.m_t)).bits() & entry.m_mask;
+                    node_index = entry.m_node;
+                }
+            }
+        }
+
+        /**
+         * @brief Check if anything blocks the ray inside its range
+         *
+         * Stops at the first blocking hit, nothing is sorted or allocated.
+         *
+         * @param ray The world space ray, a shadow ray ends at its light
+         * @return true if any shape is hit in range
+         */
+        [[nodiscard]] bool any_hit(const Ray &ray) const
+        {
+            PROFILE_FUNCTION();
+
+            if (m_linear.any_hit(ray))
+                return true;
+
+            return visit(ray, [&](const Shape *shape)
+                         {
+                const bool hit = ray.in_range(shape->intersects(ray).m_t);
+
+                COUNT_SHAPE_TEST(*shape, hit);
+
+                return hit; });
+        }
+
+        /**
+         * @brief Call a function for every intersection inside the ray's range, in no particular order
+         *
+         * @param ray The world space ray
+         * @param fn Called as fn(const Intersection &)
+         */
+        template <typename Function>
+        void all_hits(const Ray &ray, Function &&fn) const
+        {
+            PROFILE_FUNCTION();
+
+            m_linear.all_hits(ray, fn);
+
+            visit(ray, [&](const Shape *shape)
+                  {
+                Intersection xs = shape->intersects(ray);
+
+                COUNT_SHAPE_TEST(*shape, ray.in_range(xs.m_t));
+
+                if (ray.in_range(xs.m_t))
+                    fn(xs);
+
+                return false; });
+        }
+
+        /**
+         * @brief Call a function for every shape the ray may hit, without testing the shapes themselves
+         *
+         * @param ray The ray, shapes of the linear list are always visited and bounded ones when their leaf overlaps the ray's range
+         * @param fn Called as fn(const Shape *)
+         */
+        template <typename Function>
+        void for_each_candidate(const Ray &ray, Function &&fn) const
+        {
+            PROFILE_FUNCTION();
+
+            for (const Shape *shape : m_linear_shapes)
+                fn(shape);
+
+            visit(ray, [&](const Shape *shape)
+                  {
+                fn(shape);
+
+                return false; });
+        }
+
+        /**
+         * @brief Find the shape whose bounds are closest to a point
+         *
+         * Nodes are visited near child first and skipped once their box is further away than the best shape so far. Ties go to the
+         * shapes of the linear list, then to the bounded shape given to build() first.
+         *
+         * @param p The point
+         * @return const Shape* The nearest shape, nullptr if the tree holds none
+         */
+        [[nodiscard]] const Shape *nearest_bounds(const Point &p) const
+        {
+            PROFILE_FUNCTION();
+
+            const Shape *nearest = nullptr;
+            float nearest_distance = std::numeric_limits<float>::infinity();
+            uint32_t nearest_input = kNoInput;
+
+            for (const Shape *shape : m_linear_shapes)
+            {
+                const float distance = shape->bounds().distance_squared(p);
+
+                if (!nearest || distance < nearest_distance)
+                {
+                    nearest = shape;
+                    nearest_distance = distance;
+                }
+            }
+
+            if (m_nodes.empty())
+                return nearest;
+
+            uint32_t stack[kStackSize];
+            int stack_pointer = 0;
+
+            stack[stack_pointer++] = 0;
+
+            while (stack_pointer > 0)
+            {
+                const BVHNode &node = m_nodes[stack[--stack_pointer]];
+
+                // a box at the same distance can still hold a tie given to build() earlier
+                if (nearest && node.m_bounds.distance_squared(p) > nearest_distance)
+                    continue;
+
+                if (node.is_leaf())
+                {
+                    for (uint32_t i = node.m_left_first; i < node.m_left_first + node.m_count; i++)
+                    {
+                        const float distance = m_primitive_bounds[i].distance_squared(p);
+
+                        if (!nearest || distance < nearest_distance || (distance == nearest_distance && nearest_input != kNoInput && m_primitive_inputs[i] < nearest_input))
+                        {
+                            nearest = m_primitives[i];
+                            nearest_distance = distance;
+                            nearest_input = m_primitive_inputs[i];
+                        }
+                    }
+
+                    continue;
+                }
+
+                uint32_t near_child = node.m_left_first;
+                uint32_t far_child = node.m_left_first + 1;
+
+                if (m_nodes[far_child].m_bounds.distance_squared(p) < m_nodes[near_child].m_bounds.distance_squared(p))
+                    std::swap(near_child, far_child);
+
+                stack[stack_pointer++] = far_child;
+                stack[stack_pointer++] = near_child;
+            }
+
+            return nearest;
+        }
+
+        // getters
+        [[nodiscard]] size_t get_node_count() const noexcept { return m_nodes.size(); }
+        [[nodiscard]] size_t get_bounded_count() const noexcept { return m_primitives.size() - m_unused_primitives; }
+        [[nodiscard]] size_t get_linear_count() const noexcept { return m_linear_shapes.size(); }
+        [[nodiscard]] float get_sah_cost() const noexcept { return BVHBuilder::sah_cost(m_nodes); }
+        [[nodiscard]] const std::vector<BVHNode> &get_nodes() const noexcept { return m_nodes; }
+
+    private:
+        static constexpr int kStackSize = BVHBuilder::kMaxDepth + 4;
+
+        // the primitive of an input shape kept in the linear list, the parent of the root and the input of an unused primitive entry
+        static constexpr uint32_t kNoPrimitive = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t kNoParent = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t kNoInput = std::numeric_limits<uint32_t>::max();
+
+        [[nodiscard]] static double elapsed_ms(const std::chrono::steady_clock::time_point start) noexcept
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // the parent of every node, the leaf of every primitive and the primitive of every input shape
+        void index_tree()
+        {
+            m_parents.assign(m_nodes.size(), kNoParent);
+            m_primitive_leaves.assign(m_primitives.size(), 0);
+            m_input_primitives.assign(m_input_count, kNoPrimitive);
+
+            for (uint32_t i = 0; i < m_nodes.size(); i++)
+            {
+                const BVHNode &node = m_nodes[i];
+
+                if (node.is_leaf())
+                {
+                    for (uint32_t p = node.m_left_first; p < node.m_left_first + node.m_count; p++)
+                        m_primitive_leaves[p] = i;
+                }
+                else
+                {
+                    m_parents[node.m_left_first] = i;
+                    m_parents[node.m_left_first + 1] = i;
+                }
+            }
+
+            for (uint32_t p = 0; p < m_primitives.size(); p++)
+                if (m_primitive_inputs[p] != kNoInput)
+                    m_input_primitives[m_primitive_inputs[p]] = p;
+        }
+
+        // how many nodes lie above a node
+        [[nodiscard]] int node_depth(uint32_t node_index) const noexcept
+        {
+            int depth = 0;
+
+            while ((node_index = m_parents[node_index]) != kNoParent)
+                depth++;
+
+            return depth;
+        }
+
+        // recompute the bounds of a leaf from its primitives and of every node above it from their children
+        void refit_path(const uint32_t node_index)
+        {
+            BVHNode &leaf = m_nodes[node_index];
+
+            leaf.m_bounds = AABB();
+
+            for (uint32_t p = leaf.m_left_first; p < leaf.m_left_first + leaf.m_count; p++)
+                leaf.m_bounds.expand(m_primitive_bounds[p]);
+
+            refit_ancestors(node_index);
+        }
+
+        // recompute the bounds of every node above a node from their children
+        void refit_ancestors(uint32_t node_index)
+        {
+            while ((node_index = m_parents[node_index]) != kNoParent)
+            {
+                BVHNode &node = m_nodes[node_index];
+
+                node.m_bounds = m_nodes[node.m_left_first].m_bounds;
+                node.m_bounds.expand(m_nodes[node.m_left_first + 1].m_bounds);
+            }
+        }
+
+        /**
+         * @brief Remove a primitive from its leaf
+         *
+         * The leaf's last primitive takes its place, and the entry at the end of the leaf stays unused until the next build. A leaf left
+         * empty is replaced by its sibling, the pair of children is left unreachable with empty bounds so it adds nothing to the SAH cost.
+         */
+        void erase_primitive(const uint32_t primitive)
+        {
+            const uint32_t leaf_index = m_primitive_leaves[primitive];
+            BVHNode &leaf = m_nodes[leaf_index];
+            const uint32_t last = leaf.m_left_first + leaf.m_count - 1;
+
+            if (primitive != last)
+            {
+                m_primitives[primitive] = m_primitives[last];
+                m_primitive_bounds[primitive] = m_primitive_bounds[last];
+                m_primitive_inputs[primitive] = m_primitive_inputs[last];
+                m_input_primitives[m_primitive_inputs[primitive]] = primitive;
+            }
+
+            m_primitives[last] = nullptr;
+            m_primitive_bounds[last] = AABB();
+            m_primitive_inputs[last] = kNoInput;
+            m_unused_primitives++;
+
+            leaf.m_count--;
+
+            if (leaf.m_count > 0)
+                return refit_path(leaf_index);
+
+            const uint32_t parent = m_parents[leaf_index];
+
+            // the tree's last primitive, nothing is left to traverse
+            if (parent == kNoParent)
+            {
+                m_nodes.clear();
+                m_primitives.clear();
+                m_primitive_bounds.clear();
+                m_primitive_inputs.clear();
+                m_parents.clear();
+                m_primitive_leaves.clear();
+                m_built_areas.clear();
+                m_unused_primitives = 0;
+                m_reference_sah = 0;
+
+                return;
+            }
+
+            const uint32_t left = m_nodes[parent].m_left_first;
+            const uint32_t sibling = left == leaf_index ? left + 1 : left;
+
+            m_nodes[parent] = m_nodes[sibling];
+            m_built_areas[parent] = m_built_areas[sibling];
+
+            const BVHNode &node = m_nodes[parent];
+
+            if (node.is_leaf())
+            {
+                for (uint32_t p = node.m_left_first; p < node.m_left_first + node.m_count; p++)
+                    m_primitive_leaves[p] = parent;
+            }
+            else
+            {
+                m_parents[node.m_left_first] = parent;
+                m_parents[node.m_left_first + 1] = parent;
+            }
+
+            m_nodes[left] = BVHNode();
+            m_nodes[left + 1] = BVHNode();
+            m_built_areas[left] = 0;
+            m_built_areas[left + 1] = 0;
+
+            refit_ancestors(parent);
+        }
+
+        [[nodiscard]] bool is_ancestor(const uint32_t ancestor, uint32_t node_index) const noexcept
+        {
+            while ((node_index = m_parents[node_index]) != kNoParent)
+                if (node_index == ancestor)
+                    return true;
+
+            return false;
+        }
+
+        /**
+         * @brief The subtrees to rebuild after the leaves were refit
+         *
+         * For every leaf the highest ancestor whose surface area grew past the allowed growth since it was built, or the leaf's parent
+         * if none did. Subtrees inside another one of the list are dropped.
+         */
+        [[nodiscard]] std::vector<uint32_t> degraded_subtrees(const std::vector<uint32_t> &leaves) const
+        {
+            std::vector<uint32_t> subtrees;
+
+            for (const uint32_t leaf : leaves)
+            {
+                uint32_t subtree = m_parents[leaf] != kNoParent ? m_parents[leaf] : leaf;
+
+                for (uint32_t node = leaf; node != kNoParent; node = m_parents[node])
+                    if (m_nodes[node].m_bounds.surface_area() > m_built_areas[node] * (1 + m_max_sah_growth))
+                        subtree = node;
+
+                subtrees.emplace_back(subtree);
+            }
+
+            std::sort(subtrees.begin(), subtrees.end());
+            subtrees.erase(std::unique(subtrees.begin(), subtrees.end()), subtrees.end());
+
+            std::erase_if(subtrees, [&](const uint32_t subtree)
+                          { return std::any_of(subtrees.begin(), subtrees.end(), [&](const uint32_t other)
+                                               { return is_ancestor(other, subtree); }); });
+
+            return subtrees;
+        }
+
+        // the range of m_primitives below a node, from its leftmost to its rightmost leaf
+        void primitive_range(const uint32_t node_index, uint32_t &first, uint32_t &count) const noexcept
+        {
+            uint32_t left = node_index;
+            uint32_t right = node_index;
+
+            while (!m_nodes[left].is_leaf())
+                left = m_nodes[left].m_left_first;
+
+            while (!m_nodes[right].is_leaf())
+                right = m_nodes[right].m_left_first + 1;
+
+            first = m_nodes[left].m_left_first;
+            count = m_nodes[right].m_left_first + m_nodes[right].m_count - first;
+        }
+
+        // a subtree built over a range of primitives, its leaves index the range
+        struct Subtree
+        {
+            uint32_t m_root;
+            uint32_t m_first;
+            std::vector<BVHNode> m_nodes;
+        };
+
+        // build the subtrees again over their primitives and splice them into the tree, the tree is flattened again once for all of them
+        void rebuild_subtrees(const std::vector<uint32_t> &roots)
+        {
+            std::vector<Subtree> subtrees;
+            subtrees.reserve(roots.size());
+
+            for (const uint32_t root : roots)
+            {
+                Subtree &subtree = subtrees.emplace_back();
+                subtree.m_root = root;
+
+                uint32_t count;
+                primitive_range(root, subtree.m_first, count);
+
+                std::vector<AABB> bounds;
+                std::vector<const Shape *> primitives;
+                std::vector<uint32_t> inputs;
+
+                // entries left unused by erase() move behind the rebuilt primitives
+                for (uint32_t p = subtree.m_first; p < subtree.m_first + count; p++)
+                {
+                    if (!m_primitives[p])
+                        continue;
+
+                    bounds.emplace_back(m_primitive_bounds[p]);
+                    primitives.emplace_back(m_primitives[p]);
+                    inputs.emplace_back(m_primitive_inputs[p]);
+                }
+
+                // the subtree is spliced in at the root's depth, the traversal stacks only hold kMaxDepth levels
+                std::vector<uint32_t> indices;
+                BVHBuilder::build(bounds, subtree.m_nodes, indices, m_pool, node_depth(root));
+
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    const bool used = i < indices.size();
+
+                    m_primitives[subtree.m_first + i] = used ? primitives[indices[i]] : nullptr;
+                    m_primitive_bounds[subtree.m_first + i] = used ? bounds[indices[i]] : AABB();
+                    m_primitive_inputs[subtree.m_first + i] = used ? inputs[indices[i]] : kNoInput;
+                }
+            }
+
+            std::vector<BVHNode> nodes;
+            std::vector<float> built_areas;
+
+            nodes.reserve(m_nodes.size());
+            built_areas.reserve(m_nodes.size());
+
+            nodes.emplace_back();
+            built_areas.emplace_back();
+
+            // copy the node to index to, children are appended as a pair like the builder does it
+            auto flatten = [&](auto &&self, const std::vector<BVHNode> &source, const uint32_t from, const uint32_t offset, const bool rebuilt, const uint32_t to) -> void
+            {
+                if (!rebuilt)
+                {
+                    for (const Subtree &subtree : subtrees)
+                        if (subtree.m_root == from)
+                            return self(self, subtree.m_nodes, 0, subtree.m_first, true, to);
+                }
+
+                const BVHNode &node = source[from];
+
+                nodes[to] = node;
+                built_areas[to] = rebuilt ? node.m_bounds.surface_area() : m_built_areas[from];
+
+                if (node.is_leaf())
+                {
+                    nodes[to].m_left_first += offset;
+                    return;
+                }
+
+                const auto left = (uint32_t)nodes.size();
+
+                nodes[to].m_left_first = left;
+
+                nodes.resize(nodes.size() + 2);
+                built_areas.resize(built_areas.size() + 2);
+
+                self(self, source, node.m_left_first, offset, rebuilt, left);
+                self(self, source, node.m_left_first + 1, offset, rebuilt, left + 1);
+            };
+
+            flatten(flatten, m_nodes, 0, 0, false, 0);
+
+            m_nodes = std::move(nodes);
+            m_built_areas = std::move(built_areas);
+
+            index_tree();
+        }
+
+        // scenes with at most this many shapes skip the tree
+        static constexpr size_t kMaxLinearShapes = 8;
+
+        // AABB::intersects for every lane in mask with (t_min, closest t) as the range, returns the lanes that overlap the box
+        static uint32_t intersect_box(const AABB &box, const RayPacket &packet, const uint32_t mask, PacketFloat &t_near) noexcept
+        {
+            auto slab = [&](const float min, const float max, const float *origin, const float *inverse_direction, PacketFloat &t1, PacketFloat &t2)
+            {
+                const PacketFloat o = PacketFloat::load(origin);
+                const PacketFloat inverse = PacketFloat::load(inverse_direction);
+
+                t1 = (PacketFloat::broadcast(min) - o) * inverse;
+                t2 = (PacketFloat::broadcast(max) - o) * inverse;
+            };
+
+            PacketFloat t1, t2;
+
+            slab(box.m_min.x, box.m_max.x, packet.m_origin_x, packet.m_inverse_direction_x, t1, t2);
+
+            t_near = PacketFloat::min(t1, t2);
+            PacketFloat t_far = PacketFloat::max(t1, t2);
+
+            slab(box.m_min.y, box.m_max.y, packet.m_origin_y, packet.m_inverse_direction_y, t1, t2);
+
+            t_near = PacketFloat::max(t_near, PacketFloat::min(t1, t2));
+            t_far = PacketFloat::min(t_far, PacketFloat::max(t1, t2));
+
+            slab(box.m_min.z, box.m_max.z, packet.m_origin_z, packet.m_inverse_direction_z, t1, t2);
+
+            t_near = PacketFloat::max(t_near, PacketFloat::min(t1, t2));
+            t_far = PacketFloat::min(t_far, PacketFloat::max(t1, t2));
+
+            const PacketFloat hit = (t_far >= t_near) & (t_far > PacketFloat::load(packet.m_t_min)) & (t_near < PacketFloat::load(packet.m_t));
+
+            return hit.bits() & mask;
+        }
+
+        // call fn(shape) for every shape in the tree whose bounds overlap the ray's range until it returns true
+        template <typename Function>
+        bool visit(const Ray &ray, Function &&fn) const
+        {
+            if (m_nodes.empty())
+                return false;
+
+            uint32_t stack[kStackSize];
+            int stack_pointer = 0;
+
+            stack[stack_pointer++] = 0;
+
+            while (stack_pointer > 0)
+            {
+                const BVHNode &node = m_nodes[stack[--stack_pointer]];
+
+                COUNT_BVH_NODE();
+
+                if (node.m_bounds.intersects(ray) == std::numeric_limits<float>::infinity())
+                    continue;
+
+                if (node.is_leaf())
+                {
+                    for (uint32_t i = node.m_left_first; i < node.m_left_first + node.m_count; i++)
+                        if (fn(m_primitives[i]))
+                            return true;
+                }
+                else
+                {
+                    stack[stack_pointer++] = node.m_left_first + 1;
+                    stack[stack_pointer++] = node.m_left_first;
+                }
+            }
+
+            return false;
+        }
+
+        std::vector<BVHNode> m_nodes;
+        std::vector<const Shape *> m_primitives;
+
+        // the bounds of every primitive and its position in the shapes the tree was built from
+        std::vector<AABB> m_primitive_bounds;
+        std::vector<uint32_t> m_primitive_inputs;
+
+        // the lookups of refit(), see index_tree()
+        std::vector<uint32_t> m_parents;
+        std::vector<uint32_t> m_primitive_leaves;
+        std::vector<uint32_t> m_input_primitives;
+        uint32_t m_input_count = 0;
+        // entries of m_primitives left behind by erase(), they are in no leaf
+        uint32_t m_unused_primitives = 0;
+
+        // the surface area of every node when it was built, and the SAH cost of the last full build
+        std::vector<float> m_built_areas;
+        float m_reference_sah = 0;
+        float m_max_sah_growth = 0.3f;
+
+        BVHUpdateStats m_update_stats;
+        BVHBuildStats m_build_stats;
+
+        ThreadPool *m_pool = nullptr;
+
+        // the planes, or every shape of a small scene, tested without the tree
+        std::vector<const Shape *> m_linear_shapes;
+        CompiledShapes m_linear;
+    };
+} // namespace COAL
@@ -0,0 +1,465 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Intersection.hpp"
+#include "Profiling/RenderCounters.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "Shapes/Shape.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief kPacketSize shapes of one type, stored lane by lane
+     *
+     * Only the rows of the inverse transform the type's intersection reads are kept, m_inverse[row * 4 + column][lane]. The fourth
+     * row of an affine transform is always (0, 0, 0, 1) and is never needed.
+     */
+    template <int Rows>
+    struct alignas(32) ShapeBlock
+    {
+        // unused lanes stay zero, their results are masked out
+        alignas(32) float m_inverse[static_cast<size_t>(Rows) * 4][kPacketSize] = {};
+        // lanes that hold a shape, only the last block of a group is partially filled
+        uint32_t m_mask = 0;
+    };
+
+    /**
+     * @brief The shapes of one type, their blocks and the shapes they were compiled from
+     *
+     * Lane l of block b was compiled from m_shapes[b * kPacketSize + l].
+     */
+    template <int Rows>
+    struct ShapeGroup
+    {
+        ShapeType m_type = ShapeType::Count;
+        // the inverse transform row of the first stored row, the planes only keep the row of their normal axis
+        int m_first_row = 0;
+        std::vector<ShapeBlock<Rows>> m_blocks;
+        std::vector<const Shape *> m_shapes;
+
+        void clear() noexcept
+        {
+            m_blocks.clear();
+            m_shapes.clear();
+        }
+
+        void add(const Shape &shape)
+        {
+            const size_t lane = m_shapes.size() % kPacketSize;
+
+            if (lane == 0)
+                m_blocks.emplace_back();
+
+            ShapeBlock<Rows> &block = m_blocks.back();
+            const Matrix4 &inverse = shape.get_inverse_transform();
+
+            for (int row = 0; row < Rows; row++)
+                for (int column = 0; column < 4; column++)
+                    block.m_inverse[row * 4 + column][lane] = inverse(m_first_row + row, column);
+
+            block.m_mask |= 1u << lane;
+
+            m_shapes.emplace_back(&shape);
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return m_shapes.size();
+        }
+    };
+
+    /**
+     * @brief A compiled, read-only copy of a set of shapes for the linear intersection loops
+     *
+     * Spheres, cubes and the three plane types are grouped by type into blocks of kPacketSize shapes that only hold the inverse
+     * transform data their intersection needs, one ray is then tested against a whole block with SIMD instead of one virtual call and
+     * four scattered matrices per shape. Every lane repeats the scalar intersection's float operations in the same order, so the
+     * distances match Shape::intersects exactly. Types without a compiled kernel are kept as shape pointers and tested through the
+     * virtual call.
+     *
+     * It refers to the shapes it was compiled from and copies their transforms, compile it again after shapes were added, removed or
+     * edited.
+     */
+    struct CompiledShapes
+    {
+        [[nodiscard]] CompiledShapes()
+        {
+            m_spheres.m_type = ShapeType::Sphere;
+            m_cubes.m_type = ShapeType::Cube;
+
+            // a plane only needs the inverse transform row of the axis it is tested along
+            m_planes[0].m_type = ShapeType::XYPlane;
+            m_planes[0].m_first_row = 2;
+            m_planes[1].m_type = ShapeType::XZPlane;
+            m_planes[1].m_first_row = 1;
+            m_planes[2].m_type = ShapeType::YZPlane;
+            m_planes[2].m_first_row = 0;
+        }
+
+        // (re)compile the given shapes, they must outlive the compiled copy
+        void compile(const std::vector<const Shape *> &shapes)
+        {
+            PROFILE_FUNCTION();
+
+            m_spheres.clear();
+            m_cubes.clear();
+
+            for (auto &planes : m_planes)
+                planes.clear();
+
+            m_other.clear();
+
+            // without SIMD the lanes would be emulated one at a time, the virtual calls are faster
+            if (!COAL_SSE)
+            {
+                m_other = shapes;
+                return;
+            }
+
+            for (const Shape *shape : shapes)
+            {
+                switch (shape->get_type())
+                {
+                case ShapeType::Sphere:
+                    m_spheres.add(*shape);
+                    break;
+                case ShapeType::Cube:
+                    m_cubes.add(*shape);
+                    break;
+                case ShapeType::XYPlane:
+                    m_planes[0].add(*shape);
+                    break;
+                case ShapeType::XZPlane:
+                    m_planes[1].add(*shape);
+                    break;
+                case ShapeType::YZPlane:
+                    m_planes[2].add(*shape);
+                    break;
+                default:
+                    m_other.emplace_back(shape);
+                    break;
+                }
+            }
+        }
+
+        /**
+         * @brief Find the closest intersection inside the ray's range
+         *
+         * Shapes at exactly the same distance resolve to the one compiled first.
+         *
+         * @param ray The world space ray
+         * @param closest Replaced by the closest hit if there is one
+         * @return true if closest was replaced
+         */
+        bool closest_hit(const Ray &ray, Intersection &closest) const
+        {
+            PROFILE_FUNCTION();
+
+            float closest_t = ray.m_t_max;
+            const Shape *closest_shape = nullptr;
+
+            visit(ray, [&]([[maybe_unused]] const ShapeType type, const Shape *const *shapes, const PacketFloat &t, [[maybe_unused]] const uint32_t mask, const uint32_t hits)
+                  {
+                const uint32_t in_front = (t > PacketFloat::broadcast(ray.m_t_min)).bits() & hits;
+
+                COUNT_SHAPE_GROUP_TEST(type, mask, in_front);
+
+                uint32_t closer = (t < PacketFloat::broadcast(closest_t)).bits() & in_front;
+
+                if (closer)
+                {
+                    alignas(32) float distances[kPacketSize];
+                    t.store(distances);
+
+                    // lane order, the first of several equal distances wins like in a sequential loop
+                    for (; closer; closer &= closer - 1)
+                    {
+                        const int lane = std::countr_zero(closer);
+
+                        if (distances[lane] < closest_t)
+                        {
+                            closest_t = distances[lane];
+                            closest_shape = shapes[lane];
+                        }
+                    }
+                }
+
+                return false; });
+
+            // a hit on the other shapes is closer than every compiled one, it is kept whole (an instance's hit knows its geometry)
+            Intersection other;
+
+            if (!m_other.empty())
+            {
+                // the range ends at the closest compiled hit, the shapes skip anything further away
+                Ray query = ray;
+                query.m_t_max = closest_t;
+
+                for (const Shape *shape : m_other)
+                {
+                    Intersection xs = shape->intersects(query);
+
+                    COUNT_SHAPE_TEST(*shape, query.in_range(xs.m_t));
+
+                    if (query.in_range(xs.m_t))
+                    {
+                        other = xs;
+                        closest_t = query.m_t_max = xs.m_t;
+                    }
+                }
+            }
+
+            if (other.m_object)
+                closest = other;
+            else if (closest_shape)
+                closest = Intersection(closest_t, *closest_shape);
+            else
+                return false;
+
+            return true;
+        }
+
+        // true if any shape is hit inside the ray's range
+        [[nodiscard]] bool any_hit(const Ray &ray) const
+        {
+            PROFILE_FUNCTION();
+
+            const bool hit = visit(ray, [&]([[maybe_unused]] const ShapeType type, [[maybe_unused]] const Shape *const *shapes, const PacketFloat &t, [[maybe_unused]] const uint32_t mask, const uint32_t hits)
+                                   {
+                const uint32_t in_range = (t > PacketFloat::broadcast(ray.m_t_min)).bits() & (t < PacketFloat::broadcast(ray.m_t_max)).bits() & hits;
+
+                COUNT_SHAPE_GROUP_TEST(type, mask, in_range);
+
+                return in_range != 0; });
+
+            if (hit)
+                return true;
+
+            for (const Shape *shape : m_other)
+            {
+                const bool blocked = ray.in_range(shape->intersects(ray).m_t);
+
+                COUNT_SHAPE_TEST(*shape, blocked);
+
+                if (blocked)
+                    return true;
+            }
+
+            return false;
+        }
+
+        // call fn(const Intersection &) for every hit inside the ray's range, in no particular order
+        template <typename Function>
+        void all_hits(const Ray &ray, Function &&fn) const
+        {
+            PROFILE_FUNCTION();
+
+            visit(ray, [&]([[maybe_unused]] const ShapeType type, const Shape *const *shapes, const PacketFloat &t, [[maybe_unused]] const uint32_t mask, const uint32_t hits)
+                  {
+                uint32_t in_front = (t > PacketFloat::broadcast(ray.m_t_min)).bits() & (t < PacketFloat::broadcast(ray.m_t_max)).bits() & hits;
+
+                COUNT_SHAPE_GROUP_TEST(type, mask, in_front);
+
+                if (in_front)
+                {
+                    alignas(32) float distances[kPacketSize];
+                    t.store(distances);
+
+                    for (; in_front; in_front &= in_front - 1)
+                    {
+                        const int lane = std::countr_zero(in_front);
+                        fn(Intersection(distances[lane], *shapes[lane]));
+                    }
+                }
+
+                return false; });
+
+            for (const Shape *shape : m_other)
+            {
+                Intersection xs = shape->intersects(ray);
+
+                COUNT_SHAPE_TEST(*shape, ray.in_range(xs.m_t));
+
+                if (ray.in_range(xs.m_t))
+                    fn(xs);
+            }
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            size_t count = m_spheres.size() + m_cubes.size() + m_other.size();
+
+            for (const auto &planes : m_planes)
+                count += planes.size();
+
+            return count;
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return size() == 0;
+        }
+
+    private:
+        // a world space ray with every component in every lane
+        struct BroadcastRay
+        {
+            PacketFloat m_origin_x, m_origin_y, m_origin_z;
+            PacketFloat m_direction_x, m_direction_y, m_direction_z;
+            PacketFloat m_t_min;
+        };
+
+        // the ray in the object space of every lane, like Ray::transform
+        struct BlockRays
+        {
+            PacketFloat m_origin_x, m_origin_y, m_origin_z;
+            PacketFloat m_direction_x, m_direction_y, m_direction_z;
+            // only set by compute_inverse_direction
+            PacketFloat m_inverse_direction_x{}, m_inverse_direction_y{}, m_inverse_direction_z{};
+
+            // the reciprocals of every lane's direction, once per block like the Ray constructor
+            void compute_inverse_direction() noexcept
+            {
+                const PacketFloat one = PacketFloat::broadcast(1.0f);
+
+                m_inverse_direction_x = one / m_direction_x;
+                m_inverse_direction_y = one / m_direction_y;
+                m_inverse_direction_z = one / m_direction_z;
+            }
+        };
+
+        template <int Rows>
+        [[nodiscard]] static PacketFloat transform_point(const ShapeBlock<Rows> &block, const int row, const BroadcastRay &ray) noexcept
+        {
+            return PacketFloat::load(block.m_inverse[row * 4]) * ray.m_origin_x + PacketFloat::load(block.m_inverse[row * 4 + 1]) * ray.m_origin_y +
+                   PacketFloat::load(block.m_inverse[row * 4 + 2]) * ray.m_origin_z + PacketFloat::load(block.m_inverse[row * 4 + 3]);
+        }
+
+        template <int Rows>
+        [[nodiscard]] static PacketFloat transform_vector(const ShapeBlock<Rows> &block, const int row, const BroadcastRay &ray) noexcept
+        {
+            return PacketFloat::load(block.m_inverse[row * 4]) * ray.m_direction_x + PacketFloat::load(block.m_inverse[row * 4 + 1]) * ray.m_direction_y +
+                   PacketFloat::load(block.m_inverse[row * 4 + 2]) * ray.m_direction_z;
+        }
+
+        [[nodiscard]] static BlockRays transform(const ShapeBlock<3> &block, const BroadcastRay &ray) noexcept
+        {
+            return {transform_point(block, 0, ray), transform_point(block, 1, ray), transform_point(block, 2, ray),
+                    transform_vector(block, 0, ray), transform_vector(block, 1, ray), transform_vector(block, 2, ray)};
+        }
+
+        // Sphere::intersects for every lane, returns the lanes that hit
+        [[nodiscard]] static uint32_t intersect_spheres(const ShapeBlock<3> &block, const BroadcastRay &ray, PacketFloat &t) noexcept
+        {
+            const BlockRays rays = transform(block, ray);
+
+            const PacketFloat &ox = rays.m_origin_x, &oy = rays.m_origin_y, &oz = rays.m_origin_z;
+            const PacketFloat &dx = rays.m_direction_x, &dy = rays.m_direction_y, &dz = rays.m_direction_z;
+
+            const PacketFloat zero = PacketFloat::broadcast(0.0f);
+            const PacketFloat two = PacketFloat::broadcast(2.0f);
+
+            PacketFloat a = dx * dx + dy * dy + dz * dz;
+            PacketFloat b = two * (ox * dx + oy * dy + oz * dz);
+            PacketFloat c = (ox * ox + oy * oy + oz * oz) - PacketFloat::broadcast(1.0f);
+
+            PacketFloat discriminant = b * b - PacketFloat::broadcast(4.0f) * a * c;
+            PacketFloat root = discriminant.sqrt();
+
+            PacketFloat t1 = (-b - root) / (two * a);
+            PacketFloat t2 = (-b + root) / (two * a);
+
+            const PacketFloat &t_min = ray.m_t_min;
+
+            t = PacketFloat::select(t1 <= t_min, t2, t1);
+
+            return ~((discriminant < zero) | (t <= t_min)).bits() & block.m_mask;
+        }
+
+        // one slab of the unit cube like Cube::intersects, the sign of the direction picks the face the ray enters through
+        static void slab(const PacketFloat &origin, const PacketFloat &inverse_direction, PacketFloat &t_enter, PacketFloat &t_exit) noexcept
+        {
+            const PacketFloat one = PacketFloat::broadcast(1.0f);
+            const PacketFloat minus_one = PacketFloat::broadcast(-1.0f);
+
+            const PacketFloat negative = inverse_direction < PacketFloat::broadcast(0.0f);
+
+            t_enter = (PacketFloat::select(negative, one, minus_one) - origin) * inverse_direction;
+            t_exit = (PacketFloat::select(negative, minus_one, one) - origin) * inverse_direction;
+        }
+
+        // Cube::intersects for every lane, returns the lanes that hit
+        [[nodiscard]] static uint32_t intersect_cubes(const ShapeBlock<3> &block, const BroadcastRay &ray, PacketFloat &t) noexcept
+        {
+            BlockRays rays = transform(block, ray);
+            rays.compute_inverse_direction();
+
+            PacketFloat xmin, xmax, ymin, ymax, zmin, zmax;
+
+            slab(rays.m_origin_x, rays.m_inverse_direction_x, xmin, xmax);
+            slab(rays.m_origin_y, rays.m_inverse_direction_y, ymin, ymax);
+            slab(rays.m_origin_z, rays.m_inverse_direction_z, zmin, zmax);
+
+            PacketFloat tmin = PacketFloat::max(xmin, PacketFloat::max(ymin, zmin));
+            PacketFloat tmax = PacketFloat::min(xmax, PacketFloat::min(ymax, zmax));
+
+            // the exit for rays starting inside the cube
+            t = PacketFloat::select(tmin <= ray.m_t_min, tmax, tmin);
+
+            return ~((tmin > tmax) | (t <= ray.m_t_min)).bits() & block.m_mask;
+        }
+
+        // the plane intersections for every lane, the block holds the row of the plane's normal axis
+        [[nodiscard]] static uint32_t intersect_planes(const ShapeBlock<1> &block, const BroadcastRay &ray, PacketFloat &t) noexcept
+        {
+            const PacketFloat origin = transform_point(block, 0, ray);
+            const PacketFloat direction = transform_vector(block, 0, ray);
+
+            t = (-origin) / direction;
+
+            PacketFloat parallel = direction.abs() < PacketFloat::broadcast(packet_epsilon());
+
+            return ~(parallel | (t <= ray.m_t_min)).bits() & block.m_mask;
+        }
+
+        // run the kernels over every block, fn(type, shapes, t, mask, hits) returns true to stop
+        template <typename Function>
+        bool visit(const Ray &ray, Function &&fn) const
+        {
+            const BroadcastRay broadcast{PacketFloat::broadcast(ray.m_origin.x), PacketFloat::broadcast(ray.m_origin.y), PacketFloat::broadcast(ray.m_origin.z),
+                                         PacketFloat::broadcast(ray.m_direction.x), PacketFloat::broadcast(ray.m_direction.y), PacketFloat::broadcast(ray.m_direction.z),
+                                         PacketFloat::broadcast(ray.m_t_min)};
+
+            auto run = [&](const auto &group, auto &&kernel)
+            {
+                for (size_t i = 0; i < group.m_blocks.size(); i++)
+                {
+                    PacketFloat t;
+                    const uint32_t hits = kernel(group.m_blocks[i], broadcast, t);
+
+                    if (fn(group.m_type, group.m_shapes.data() + i * kPacketSize, t, group.m_blocks[i].m_mask, hits))
+                        return true;
+                }
+
+                return false;
+            };
+
+            if (run(m_spheres, intersect_spheres) || run(m_cubes, intersect_cubes))
+                return true;
+
+            for (const auto &planes : m_planes)
+                if (run(planes, intersect_planes))
+                    return true;
+
+            return false;
+        }
+
+        ShapeGroup<3> m_spheres;
+        ShapeGroup<3> m_cubes;
+        // XYPlane, XZPlane and YZPlane
+        std::array<ShapeGroup<1>, 3> m_planes;
+        // shapes without a compiled kernel
+        std::vector<const Shape *> m_other;
+    };
+} // namespace COAL
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Accelerators/AABB.hpp"
+#include "Accelerators/BVH.hpp"
+#include "Constants.hpp"
+#include "Intersection.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "Shapes/Shape.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief Shapes built into a BVH once and shared by every instance of them, the bottom level of a scene
+     *
+     * The shapes live in the group's own space, the instances place the group in the world. A group is not edited after it was built,
+     * an edited copy is a new group. Groups hold plain shapes, an instance inside a group would need a third level.
+     */
+    struct GeometryGroup
+    {
+        [[nodiscard]] GeometryGroup(std::string name, std::vector<std::shared_ptr<Shape>> shapes)
+            : m_name(std::move(name)), m_shapes(std::move(shapes))
+        {
+            PROFILE_FUNCTION();
+
+            for (const auto &shape : m_shapes)
+                m_bounds.expand(shape->bounds());
+
+            m_bvh.build(m_shapes);
+        }
+
+        // the closest hit of a ray in the group's space
+        [[nodiscard]] Intersection closest_hit(const Ray &ray) const
+        {
+            return m_bvh.closest_hit(ray);
+        }
+
+        [[nodiscard]] bool any_hit(const Ray &ray) const
+        {
+            return m_bvh.any_hit(ray);
+        }
+
+        // the closest hit of every active lane of a packet in the group's space
+        void closest_hit(RayPacket &packet) const
+        {
+            m_bvh.closest_hit(packet);
+        }
+
+        // from the first shape the ray enters to the last one it leaves
+        [[nodiscard]] Interval interval(const Ray &ray) const
+        {
+            PROFILE_FUNCTION();
+
+            Interval res;
+
+            // the shapes' intervals cover the whole line, so the tree is walked without the ray's range
+            const Ray line(ray.m_origin, ray.m_direction, -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity());
+
+            m_bvh.for_each_candidate(line, [&](const Shape *shape)
+                                     {
+                const Interval shape_interval = shape->interval(ray);
+
+                if (shape_interval.is_empty())
+                    return;
+
+                res.m_t_enter = std::min(res.m_t_enter, shape_interval.m_t_enter);
+                res.m_t_exit = std::max(res.m_t_exit, shape_interval.m_t_exit); });
+
+            return res;
+        }
+
+        // the shape whose bounds are closest to a point of the group's space (0 inside of them), nullptr if the group is empty
+        [[nodiscard]] const Shape *nearest_shape(const Point &p) const
+        {
+            return m_bvh.nearest_bounds(p);
+        }
+
+        // getters
+        [[nodiscard]] const std::string &get_name() const noexcept
+        {
+            return m_name;
+        }
+
+        [[nodiscard]] const std::vector<std::shared_ptr<Shape>> &get_shapes() const noexcept
+        {
+            return m_shapes;
+        }
+
+        // bounds in the group's space
+        [[nodiscard]] const AABB &get_bounds() const noexcept
+        {
+            return m_bounds;
+        }
+
+        [[nodiscard]] const BVH &get_bvh() const noexcept
+        {
+            return m_bvh;
+        }
+
+        // serialize all data to a nlohmann json string object
+        [[nodiscard]] std::string to_json() const noexcept
+        {
+            nlohmann::json j;
+
+            j["name"] = m_name;
+
+            nlohmann::json shapes_json = nlohmann::json::array();
+            for (const auto &shape : m_shapes)
+                shapes_json.emplace_back(nlohmann::json::parse(shape->to_json()));
+            j["shapes"] = shapes_json;
+
+            return j.dump();
+        }
+
+    private:
+        std::string m_name;
+        std::vector<std::shared_ptr<Shape>> m_shapes;
+        BVH m_bvh;
+        AABB m_bounds;
+    };
+} // namespace COAL
@@ -17,6 +17,8 @@
 #include "Intersection.hpp"
 
 #include "Shapes/Cube.hpp"
+#include "Shapes/Instance.hpp"
+#include "Shapes/Mesh.hpp"
 #include "Shapes/Shape.hpp"
 #include "Shapes/Sphere.hpp"
 #include "Shapes/XYPlane.hpp"
@@ -26,6 +28,7 @@
 #include "Patterns/Pattern.hpp"
 
 #include "Material.hpp"
+#include "MeshLoader.hpp"
 
 #include "Computation.hpp"
 
@@ -2,9 +2,14 @@
 
 #include "Constants.hpp"
 #include "Matrix.hpp"
+#include "Profiling/Heatmap.hpp"
+#include "Profiling/RenderCounters.hpp"
+#include "Threading/ThreadPool.hpp"
+#include "Threading/TileScheduler.hpp"
 #include "Tuples/Color.hpp"
 #include "Tuples/Point.hpp"
 #include "Tuples/Vector.hpp"
+#include "WavefrontRenderer.hpp"
 #include "World.hpp"
 
 namespace COAL
@@ -58,11 +63,17 @@ namespace COAL
         }
 
         [[nodiscard]] Ray ray_for_pixel(int x, int y) const
+        {
+            return ray_for_pixel(x, y, 0.5f, 0.5f);
+        }
+
+        // ray through a point inside the pixel, the offsets are in [0, 1) with (0.5, 0.5) being the pixel center
+        [[nodiscard]] Ray ray_for_pixel(int x, int y, float offset_x, float offset_y) const
         {
             PROFILE_FUNCTION();
 
-            float xOffset = (x + 0.5f) * m_pixel_size;
-            float yOffset = (y + 0.5f) * m_pixel_size;
+            float xOffset = (static_cast<float>(x) + offset_x) * m_pixel_size;
+            float yOffset = (static_cast<float>(y) + offset_y) * m_pixel_size;
 
             float world_x = m_half_width - xOffset;
             float world_y = m_half_height - yOffset;
@@ -105,20 +116,20 @@ namespace COAL
 
             std::shared_ptr<Color[]> image(new Color[m_width * m_height]);
 
+            RenderCounters::local().reset();
+            WavefrontRenderer::local().get_stats().reset();
+            m_heatmap.reset(m_heatmap_mode, m_width, m_height);
+
             for (int y = 0; y < m_height; y++)
             {
                 debug_print("[RENDERER]: ", "Thread {" + std::to_string(y + 1) + "}: Calculating Row: [" + std::to_string(y + 1) + '/' + std::to_string(m_height) + "]");
 
-                for (int x = 0; x < m_width; x++)
-                {
-                    Ray r = ray_for_pixel(x, y);
-
-                    Color c = w.color_at(r);
-
-                    image.get()[y * m_width + x] = c;
-                }
+                render_tile(w, Tile{0, y, m_width, y + 1}, image.get());
             }
 
+            m_render_counters = RenderCounters::local();
+            m_wavefront_stats = WavefrontRenderer::local().get_stats();
+
             m_is_finished = true;
 
             debug_print("[RENDERER]: ", "Single-Threaded Rendering done in: " + std::to_string(timer.elapsed_millis()) + " ms");
@@ -138,37 +149,391 @@ namespace COAL
 
             std::shared_ptr<Color[]> image(new Color[m_width * m_height]);
 
-            std::vector<std::thread> threads;
+            ThreadPool &pool = get_thread_pool(thread_count);
+            const int worker_count = pool.get_thread_count();
+
+            TileScheduler scheduler(m_width, m_height, m_tile_size, worker_count);
+
+            m_thread_stats.assign((size_t)worker_count, WorkerStats());
+            m_render_counters.reset();
+            m_wavefront_stats.reset();
+            m_heatmap.reset(m_heatmap_mode, m_width, m_height);
+
+            std::mutex counters_lock;
+
+            pool.run([&](const int index)
+                     {
+                WorkerStats &stats = m_thread_stats[(size_t)index];
+
+                RenderCounters::local().reset();
+                WavefrontRenderer::local().get_stats().reset();
+
+                Tile tile;
+                bool stolen = false;
+
+                while (scheduler.next_tile(index, tile, stolen))
+                {
+                    Timer tile_timer;
+
+                    render_tile(w, tile, image.get());
+
+                    stats.m_busy_ms += tile_timer.elapsed_millis();
+                    stats.m_tiles++;
+                    stats.m_stolen_tiles += stolen ? 1 : 0;
+                }
 
-            for (int i = 0; i < thread_count; i++)
+                if (RenderCounters::is_enabled() || uses_wavefront())
+                {
+                    std::lock_guard<std::mutex> lock(counters_lock);
+                    m_render_counters += RenderCounters::local();
+                    m_wavefront_stats += WavefrontRenderer::local().get_stats();
+                } });
+
+            const float render_time = timer.elapsed_millis();
+
+            for (auto &stats : m_thread_stats)
+                stats.m_idle_ms = std::max(0.0f, render_time - stats.m_busy_ms);
+
+            m_is_finished = true;
+
+            debug_print("[RENDERER]: ", "Multi-Threaded Rendering done in: " + std::to_string(render_time) + " ms");
+
+            return image;
+        }
+
+        // trace every pixel of a tile into the image
+        void render_tile(const World &w, const Tile &tile, Color *image) const
+        {
+            PROFILE_FUNCTION();
+
+            if (uses_wavefront())
+            {
+                render_tile_wavefront(w, tile, image);
+                return;
+            }
+
+            // one sample per pixel can trace the primary rays of a pixel block together
+            if (m_packet_tracing && m_samples <= 1 && !m_heatmap.is_enabled())
             {
-                const int index = i;
+                render_tile_packets(w, tile, image);
+                return;
+            }
 
-                threads.push_back(std::thread([&, index]()
-                                              {
-                    for (int y = index; y < m_height; y += thread_count)
+            for (int y = tile.m_y0; y < tile.m_y1; y++)
+            {
+                for (int x = tile.m_x0; x < tile.m_x1; x++)
+                {
+                    if (!m_heatmap.is_enabled())
                     {
-                        debug_print("[RENDERER]: ","Thread {" + std::to_string(index + 1) + "}: Calculating Row: [" + std::to_string(y + 1) + '/' + std::to_string(m_height) + "]");
+                        image[y * m_width + x] = render_pixel(w, x, y);
+                        continue;
+                    }
 
-                        for (int x = 0; x < m_width; x++)
-                        {
-                            Ray r = ray_for_pixel(x, y);
+                    // the buffer was allocated for this render, every pixel is written by exactly one worker
+                    const RenderCounters &counters = RenderCounters::local();
+                    const uint64_t rays = counters.total_rays();
+                    const uint64_t tests = counters.total_shape_tests();
+                    const auto start = std::chrono::steady_clock::now();
+
+                    image[y * m_width + x] = render_pixel(w, x, y);
+
+                    float cost = 0;
 
-                            Color c = w.color_at(r);
+                    if (m_heatmap.m_mode == HeatmapMode::Time)
+                        cost = (float)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                    else if (m_heatmap.m_mode == HeatmapMode::Rays)
+                        cost = (float)(counters.total_rays() - rays);
+                    else if (m_heatmap.m_mode == HeatmapMode::Tests)
+                        cost = (float)(counters.total_shape_tests() - tests);
 
-                            image.get() [y *m_width + x] = c;
+                    m_heatmap.m_values[(size_t)(y * m_width + x)] = cost;
+                }
+            }
+        }
+
+        // trace a tile in blocks of kPacketWidth x kPacketHeight pixels, blocks cut by the tile's edge keep the pixels outside inactive
+        void render_tile_packets(const World &w, const Tile &tile, Color *image) const
+        {
+            PROFILE_FUNCTION();
+
+            for (int y0 = tile.m_y0; y0 < tile.m_y1; y0 += kPacketHeight)
+            {
+                for (int x0 = tile.m_x0; x0 < tile.m_x1; x0 += kPacketWidth)
+                {
+                    RayPacket packet{};
+
+                    for (int lane = 0; lane < kPacketSize; lane++)
+                    {
+                        const int x = x0 + lane % kPacketWidth;
+                        const int y = y0 + lane / kPacketWidth;
+
+                        if (x < tile.m_x1 && y < tile.m_y1)
+                        {
+                            packet.set_ray(lane, ray_for_pixel(x, y));
+
+                            COUNT_RAY(RayKind::Primary, 0);
                         }
-                    } }));
+                    }
+
+                    Color colors[kPacketSize];
+
+                    w.color_at(packet, colors);
+
+                    for (int lane = 0; lane < kPacketSize; lane++)
+                        if (packet.m_active & (1u << lane))
+                            image[(y0 + lane / kPacketWidth) * m_width + x0 + lane % kPacketWidth] = colors[lane];
+                }
             }
+        }
 
-            for (auto &t : threads)
-                t.join();
+        // trace every sample of a tile through the stages of the calling thread's wavefront renderer
+        void render_tile_wavefront(const World &w, const Tile &tile, Color *image) const
+        {
+            PROFILE_FUNCTION();
 
-            m_is_finished = true;
+            WavefrontRenderer &renderer = WavefrontRenderer::local();
 
-            debug_print("[RENDERER]: ", "Multi-Threaded Rendering done in: " + std::to_string(timer.elapsed_millis()) + " ms");
+            const int tile_width = tile.m_x1 - tile.m_x0;
+            const size_t pixel_count = (size_t)tile_width * (size_t)(tile.m_y1 - tile.m_y0);
+            const size_t samples = (size_t)std::max(1, m_samples);
 
-            return image;
+            // the samples of a pixel are next to each other
+            renderer.generate(pixel_count * samples, [&](const size_t i)
+                              {
+                const int x = tile.m_x0 + (int)(i / samples) % tile_width;
+                const int y = tile.m_y0 + (int)(i / samples) / tile_width;
+
+                COUNT_RAY(RayKind::Primary, 0);
+
+                if (m_samples <= 1)
+                    return ray_for_pixel(x, y);
+
+                float offset_x, offset_y;
+                sample_offset((int)(i % samples), offset_x, offset_y);
+
+                return ray_for_pixel(x, y, offset_x, offset_y); });
+
+            renderer.trace(w, m_packet_tracing);
+
+            for (size_t pixel = 0; pixel < pixel_count; pixel++)
+            {
+                const int x = tile.m_x0 + (int)pixel % tile_width;
+                const int y = tile.m_y0 + (int)pixel / tile_width;
+
+                if (m_samples <= 1)
+                {
+                    image[y * m_width + x] = renderer.get_color(pixel);
+                    continue;
+                }
+
+                // averaged like render_pixel does it
+                float r = 0, g = 0, b = 0;
+
+                for (size_t i = 0; i < samples; i++)
+                {
+                    const Color &sample = renderer.get_color(pixel * samples + i);
+
+                    r += sample.r;
+                    g += sample.g;
+                    b += sample.b;
+                }
+
+                const float inverse_samples = 1.0f / (float)m_samples;
+
+                image[y * m_width + x] = Color(r * inverse_samples, g * inverse_samples, b * inverse_samples);
+            }
+        }
+
+        // trace the samples of one pixel
+        [[nodiscard]] Color render_pixel(const World &w, const int x, const int y) const
+        {
+            if (m_samples <= 1)
+            {
+                Ray r = ray_for_pixel(x, y);
+
+                COUNT_RAY(RayKind::Primary, 0);
+
+                return w.color_at(r);
+            }
+
+            // summed per channel since Color clamps to 255 on construction
+            float r = 0, g = 0, b = 0;
+
+            for (int i = 0; i < m_samples; i++)
+            {
+                float offset_x, offset_y;
+                sample_offset(i, offset_x, offset_y);
+
+                COUNT_RAY(RayKind::Primary, 0);
+
+                Color sample = w.color_at(ray_for_pixel(x, y, offset_x, offset_y));
+
+                r += sample.r;
+                g += sample.g;
+                b += sample.b;
+            }
+
+            const float inverse_samples = 1.0f / (float)m_samples;
+
+            return Color(r * inverse_samples, g * inverse_samples, b * inverse_samples);
+        }
+
+        /**
+         * @brief The sub-pixel position of a sample
+         *
+         * Uses the R2 low discrepancy sequence, sample 0 is the pixel center and every render places its samples at the same positions.
+         */
+        static void sample_offset(const int index, float &offset_x, float &offset_y) noexcept
+        {
+            // 1 / g and 1 / g^2 for the plastic number g
+            constexpr double kAlpha1 = 0.7548776662466927;
+            constexpr double kAlpha2 = 0.5698402909980532;
+
+            double x = 0.5 + kAlpha1 * index;
+            double y = 0.5 + kAlpha2 * index;
+
+            offset_x = (float)(x - std::floor(x));
+            offset_y = (float)(y - std::floor(y));
+        }
+
+        /**
+         * @brief Get the render thread pool, (re)creating it when the requested size changed
+         *
+         * The pool lives as long as the camera (and its copies) so the worker threads are reused across renders.
+         *
+         * A pool of another size is replaced, also one shared through set_thread_pool. The camera then renders on its own new pool while
+         * the other holders (the world, other cameras) keep the old one, so a shared pool should be created with the thread count it
+         * will be asked for.
+         *
+         * @param thread_count The number of workers the pool should have
+         * @return ThreadPool&
+         */
+        [[nodiscard]] ThreadPool &get_thread_pool(const int thread_count = kCORE_COUNT)
+        {
+            const int count = std::max(1, thread_count);
+
+            if (!m_thread_pool || m_thread_pool->get_thread_count() != count)
+                m_thread_pool = std::make_shared<ThreadPool>(count, m_pin_threads);
+
+            return *m_thread_pool;
+        }
+
+        // share an existing pool, e.g. one pool for every camera of a batch job
+        void set_thread_pool(const std::shared_ptr<ThreadPool> &pool)
+        {
+            m_thread_pool = pool;
+        }
+
+        // pin the render workers to cores, takes effect the next time the pool is created
+        void set_pin_threads(const bool pin_threads)
+        {
+            if (m_pin_threads != pin_threads)
+                m_thread_pool.reset();
+
+            m_pin_threads = pin_threads;
+        }
+
+        // busy and idle time of every worker of the last multi-threaded render
+        [[nodiscard]] const std::vector<WorkerStats> &get_thread_stats() const
+        {
+            return m_thread_stats;
+        }
+
+        /**
+         * @brief Record a per-pixel cost buffer next to the image of the following renders
+         *
+         * @param mode HeatmapMode::None turns it off again
+         * @return false if the mode needs the render counters and they are not compiled in, the heatmap stays off then
+         */
+        bool set_heatmap_mode(const HeatmapMode mode)
+        {
+            if (!is_heatmap_mode_available(mode))
+            {
+                debug_print("[RENDERER]: ", std::string("The ") + heatmap_mode_name(mode) + " heatmap needs a build with RENDER_COUNTERS");
+                m_heatmap_mode = HeatmapMode::None;
+                return false;
+            }
+
+            m_heatmap_mode = mode;
+            return true;
+        }
+
+        /**
+         * @brief Trace the primary rays of pixel blocks as SIMD packets
+         *
+         * Produces the same image as the scalar path, only used with one sample per pixel and without a heatmap. Switch it off to
+         * compare both paths.
+         */
+        void set_packet_tracing(const bool packet_tracing) noexcept
+        {
+            m_packet_tracing = packet_tracing;
+        }
+
+        [[nodiscard]] bool get_packet_tracing() const noexcept
+        {
+            return m_packet_tracing;
+        }
+
+        /**
+         * @brief Render tile by tile with the WavefrontRenderer instead of recursing per pixel
+         *
+         * Produces the same image. Ignored while a heatmap is recorded, its costs are measured per pixel.
+         */
+        void set_wavefront(const bool wavefront) noexcept
+        {
+            m_wavefront = wavefront;
+        }
+
+        [[nodiscard]] bool get_wavefront() const noexcept
+        {
+            return m_wavefront;
+        }
+
+        // stage timings of the last wavefront render, summed over the workers
+        [[nodiscard]] const WavefrontStats &get_wavefront_stats() const noexcept
+        {
+            return m_wavefront_stats;
+        }
+
+        [[nodiscard]] HeatmapMode get_heatmap_mode() const noexcept
+        {
+            return m_heatmap_mode;
+        }
+
+        // the cost buffer of the last render, empty unless a heatmap mode was set
+        [[nodiscard]] const Heatmap &get_heatmap() const noexcept
+        {
+            return m_heatmap;
+        }
+
+        /**
+         * @brief What the last render traced, merged over every worker
+         *
+         * Only counted when the renderer was built with RENDER_COUNTERS, otherwise every count is zero.
+         */
+        [[nodiscard]] const RenderCounters &get_render_counters() const noexcept
+        {
+            return m_render_counters;
+        }
+
+        // the busiest worker's time over the average busy time, 1 means perfectly balanced
+        [[nodiscard]] float get_load_imbalance() const
+        {
+            if (m_thread_stats.empty())
+                return 1;
+
+            float max_busy = 0;
+            float total_busy = 0;
+
+            for (const auto &stats : m_thread_stats)
+            {
+                max_busy = std::max(max_busy, stats.m_busy_ms);
+                total_busy += stats.m_busy_ms;
+            }
+
+            float mean_busy = total_busy / (float)m_thread_stats.size();
+
+            return mean_busy > 0 ? max_busy / mean_busy : 1;
         }
 
         // generate getters
@@ -207,6 +572,16 @@ namespace COAL
             return m_pixel_size;
         }
 
+        [[nodiscard]] constexpr int get_tile_size() const
+        {
+            return m_tile_size;
+        }
+
+        [[nodiscard]] constexpr int get_samples() const
+        {
+            return m_samples;
+        }
+
         [[nodiscard]] constexpr const Vector &get_translation() const
         {
             return m_translation;
@@ -277,6 +652,18 @@ namespace COAL
             m_pixel_size = pixel_size;
         }
 
+        // edge length in pixels of the square tiles handed to the render threads
+        void constexpr set_tile_size(int tile_size)
+        {
+            m_tile_size = tile_size > 0 ? tile_size : 1;
+        }
+
+        // rays traced per pixel by the multi-threaded renderer
+        void constexpr set_samples(int samples)
+        {
+            m_samples = samples > 0 ? samples : 1;
+        }
+
         void constexpr set_transform(const Matrix4 &transform)
         {
             m_transform = transform;
@@ -342,6 +729,11 @@ namespace COAL
         }
 
     private:
+        [[nodiscard]] bool uses_wavefront() const noexcept
+        {
+            return m_wavefront && !m_heatmap.is_enabled();
+        }
+
         bool m_is_finished = false;
         int m_width;
         int m_height;
@@ -356,5 +748,19 @@ namespace COAL
 
         float m_half_width;
         float m_half_height;
+
+        int m_tile_size = 16;
+        int m_samples = 1;
+        std::vector<WorkerStats> m_thread_stats;
+        RenderCounters m_render_counters;
+        HeatmapMode m_heatmap_mode = HeatmapMode::None;
+        // the scalar fallback lanes are slower than plain rays, so packets are only on by default with SIMD
+        bool m_packet_tracing = COAL_SSE;
+        bool m_wavefront = false;
+        WavefrontStats m_wavefront_stats;
+        Heatmap m_heatmap;
+
+        bool m_pin_threads = false;
+        std::shared_ptr<ThreadPool> m_thread_pool;
     };
 } // namespace COAL
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "MediumStack.hpp"
 #include "Shapes/Shape.hpp"
 #include "Tuples/Point.hpp"
 #include "Tuples/Vector.hpp"
@@ -12,9 +13,10 @@ namespace COAL
     {
 
         [[nodiscard]] constexpr Computation(const float t, const Shape &s, const Point &p, const Vector &eye_vector, const Vector &normal_vector,
-                                            const bool inside, const Point &over_point, const Vector &reflection_vector, const float n1, const float n2, const Point &under_point)
+                                            const bool inside, const Point &over_point, const Vector &reflection_vector, const float n1, const float n2, const Point &under_point,
+                                            const MediumStack &media = MediumStack::vacuum())
             : m_t(t), m_s(&s), m_p(p), m_eye_vector(eye_vector), m_normal_vector(normal_vector), m_inside(inside), m_over_point(over_point),
-              m_reflection_vector(reflection_vector), m_n1(n1), m_n2(n2), m_under_point(under_point)
+              m_reflection_vector(reflection_vector), m_n1(n1), m_n2(n2), m_under_point(under_point), m_media(&media)
         {
         }
 
@@ -54,5 +56,7 @@ namespace COAL
         float m_n1;
         float m_n2;
         Point m_under_point;
+        // the shapes the ray traveled inside of, reflected rays keep them and refracted rays cross the hit shape
+        const MediumStack *m_media;
     };
 } // namespace COAL
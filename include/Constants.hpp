@@ -3,10 +3,15 @@
 #include <algorithm>
 #include <array>
 #include <assert.h>
+#include <atomic>
+#include <bit>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <limits>
@@ -19,7 +24,9 @@
 #include <queue>
 #include <random>
 #include <set>
+#include <span>
 #include <sstream>
+#include <stdexcept>
 #include <stack>
 #include <string>
 #include <thread>
@@ -28,8 +35,15 @@
 #include <utility>
 #include <vector>
 
-// Set value to 1 to use the Profiling system
+// Set value to 1 to use the Profiling system (or pass -DPROFILING=1)
+#ifndef PROFILING
 #define PROFILING 0
+#endif
+
+// Set value to 1 to count rays and intersection tests per render (or pass -DRENDER_COUNTERS=1)
+#ifndef RENDER_COUNTERS
+#define RENDER_COUNTERS 0
+#endif
 
 #include "Profiling/Instrumentor.hpp"
 #include "Profiling/Timer.hpp"
@@ -64,6 +78,20 @@ inline const std::string BINARY_DIRECTORY = std::filesystem::current_path().stri
 
 #define kEpsilon 0.000001
 
+// SIMD support, COAL_SSE is available on every x64 compiler, COAL_AVX only when the build enables it (-mavx or /arch:AVX)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COAL_SSE 1
+#include <immintrin.h>
+#else
+#define COAL_SSE 0
+#endif
+
+#if COAL_SSE && defined(__AVX__)
+#define COAL_AVX 1
+#else
+#define COAL_AVX 0
+#endif
+
 /**
  * @brief A random number generator
  *
@@ -121,4 +121,72 @@ namespace COAL
         return 1;
     }
 
+    // write a binary (P6) PPM, the colors are truncated to 8 bit the same way save_image does it
+    int write_ppm(const std::shared_ptr<COAL::Color[]> &canvas, int width, int height, const std::string &filename)
+    {
+        PROFILE_FUNCTION();
+
+        std::ofstream out(filename, std::ios::out | std::ios::binary);
+
+        if (!out)
+        {
+            debug_print("[IO]: ", "failed to save ppm (cannot open file)");
+            return -1;
+        }
+
+        out << "P6\n"
+            << width << " " << height << "\n255\n";
+
+        const size_t pixel_count = static_cast<size_t>(width) * static_cast<size_t>(height);
+        const COAL::Color *colors = canvas.get();
+
+        std::vector<uint8_t> pixels(pixel_count * 3);
+
+        for (size_t i = 0; i < pixel_count; i++)
+        {
+            pixels[i * 3 + 0] = static_cast<uint8_t>(colors[i].r);
+            pixels[i * 3 + 1] = static_cast<uint8_t>(colors[i].g);
+            pixels[i * 3 + 2] = static_cast<uint8_t>(colors[i].b);
+        }
+
+        out.write(reinterpret_cast<const char *>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+
+        return out ? 1 : -2;
+    }
+
+    // read a binary (P6) PPM with 8 bit channels, returns an empty canvas on failure
+    [[nodiscard]] std::shared_ptr<COAL::Color[]> read_ppm(const std::string &filename, int &width, int &height)
+    {
+        PROFILE_FUNCTION();
+
+        std::ifstream in(filename, std::ios::in | std::ios::binary);
+
+        std::string magic;
+        int max_value = 0;
+
+        if (!(in >> magic >> width >> height >> max_value) || magic != "P6" || max_value != 255 || width <= 0 || height <= 0)
+        {
+            debug_print("[IO]: ", "failed to read ppm: " + filename);
+            return nullptr;
+        }
+
+        // a single whitespace character separates the header from the pixels
+        in.get();
+
+        const size_t pixel_count = static_cast<size_t>(width) * static_cast<size_t>(height);
+
+        std::vector<uint8_t> pixels(pixel_count * 3);
+
+        if (!in.read(reinterpret_cast<char *>(pixels.data()), static_cast<std::streamsize>(pixels.size())))
+            return nullptr;
+
+        std::shared_ptr<COAL::Color[]> canvas(new COAL::Color[pixel_count]);
+        COAL::Color *colors = canvas.get();
+
+        for (size_t i = 0; i < pixel_count; i++)
+            colors[i] = COAL::Color(pixels[i * 3 + 0], pixels[i * 3 + 1], pixels[i * 3 + 2]);
+
+        return canvas;
+    }
+
 }
@@ -2,6 +2,7 @@
 
 #include "Computation.hpp"
 #include "Constants.hpp"
+#include "MediumStack.hpp"
 #include "Ray.hpp"
 #include "Shapes/Shape.hpp"
 #include "Tuples/Point.hpp"
@@ -11,15 +12,20 @@ namespace COAL
 {
     struct Intersection
     {
-
         [[nodiscard]] constexpr Intersection() : m_t(-1), m_object(nullptr) {}
 
-        [[nodiscard]] constexpr Intersection(const float t, const Shape &object)
-            : m_t(t), m_object(&object)
+        [[nodiscard]] constexpr Intersection(const float t, const Shape &object, const Shape *geometry = nullptr, const uint32_t primitive = 0)
+            : m_t(t), m_primitive(primitive), m_object(&object), m_geometry(geometry)
         {
         }
 
-        [[nodiscard]] Computation prepare_computation(const Ray &ray, const std::vector<Intersection> &xs) const
+        /**
+         * @brief Everything shading needs about the hit
+         *
+         * @param ray The ray that found the hit
+         * @param media The shapes the ray travels inside of, n1 is the index around the ray and n2 the one behind the hit surface
+         */
+        [[nodiscard]] Computation prepare_computation(const Ray &ray, const MediumStack &media) const
         {
             PROFILE_FUNCTION();
 
@@ -27,7 +33,7 @@ namespace COAL
             const Shape *object = m_object;
             Point p = ray.position(m_t);
             Vector eyev = -ray.m_direction;
-            Vector normalv = object->normal_at(p);
+            Vector normalv = object->normal_at_hit(p, *this);
             Vector reflectv = ray.m_direction.reflect(normalv);
 
             bool inside = false;
@@ -41,41 +47,13 @@ namespace COAL
             Point over_point = p + normalv * 1e-4f;
             Point under_point = p - normalv * 1e-4f;
 
-            float n1 = 0;
-            float n2 = 0;
-
-            if (!xs.empty())
-            {
-                std::deque<const COAL::Shape *> shape_deque;
-
-                for (const COAL::Intersection &intersection : xs)
-                {
-                    if (intersection == *this)
-                        if (shape_deque.empty())
-                            n1 = 1;
-                        else
-                            n1 = shape_deque.back()->get_material().get_refractive_index();
-
-                    if (contains(shape_deque, *intersection.m_object))
-                        remove(shape_deque, *intersection.m_object);
-                    else
-                        shape_deque.emplace_back(intersection.m_object);
-
-                    if (intersection == *this)
-                    {
-                        if (shape_deque.empty())
-                            n2 = 1;
-                        else
-                            n2 = shape_deque.back()->get_material().get_refractive_index();
-                        break;
-                    }
-                }
-            }
+            float n1 = media.refractive_index();
+            float n2 = media.refractive_index_across(*object);
 
-            return Computation(t2, *object, p, eyev, normalv, inside, over_point, reflectv, n1, n2, under_point);
+            return Computation(t2, *object, p, eyev, normalv, inside, over_point, reflectv, n1, n2, under_point, media);
         }
 
-        [[nodiscard]] static Intersection hit(std::vector<Intersection> intersections)
+        [[nodiscard]] static Intersection hit(std::span<const Intersection> intersections)
         {
             PROFILE_FUNCTION();
 
@@ -100,35 +78,43 @@ namespace COAL
             return m_t == other.m_t && m_object == other.m_object;
         }
 
-    private:
-        // check if deque containts a certain intersction
-        [[nodiscard]] bool contains(const std::deque<const COAL::Shape *> &deque, const COAL::Shape &element) const
-        {
-            for (const auto &shape : deque)
-            {
-                if (*shape == element)
-                    return true;
-            }
+        float m_t;
+        // the triangle of a mesh that was hit, 0 for every other shape
+        uint32_t m_primitive = 0;
+        // the shape of the world that was hit, it owns the material
+        const Shape *m_object;
+        // the shape of an instance's geometry group that was hit, nullptr unless m_object is an instance
+        const Shape *m_geometry = nullptr;
+    };
 
-            return false;
-        }
+    /**
+     * @brief The distances at which a ray enters and leaves a shape
+     *
+     * The distances are not limited to the ray's range, an interval around the ray's start means the ray starts inside the shape.
+     * The planes are flat, the ray enters and leaves them at the same distance.
+     */
+    struct Interval
+    {
+        float m_t_enter = std::numeric_limits<float>::infinity();
+        float m_t_exit = -std::numeric_limits<float>::infinity();
 
-        // remove a shape from deque
-        [[nodiscard]] void remove(std::deque<const COAL::Shape *> &deque, const COAL::Shape &element) const
+        // true if the ray misses the shape
+        [[nodiscard]] constexpr bool is_empty() const noexcept
         {
-            for (auto it = deque.begin(); it != deque.end(); it++)
-            {
-                if (*it == &element)
-                {
-                    deque.erase(it);
-                    break;
-                }
-            }
+            return !(m_t_enter <= m_t_exit);
         }
 
-    public:
-        float m_t;
-        const Shape *m_object;
+        // the first end inside the ray's range, the exit if the ray starts inside the shape
+        [[nodiscard]] Intersection first_hit(const Ray &ray, const Shape &shape) const noexcept
+        {
+            if (ray.in_range(m_t_enter))
+                return Intersection(m_t_enter, shape);
+
+            if (m_t_enter <= ray.m_t_min && ray.in_range(m_t_exit))
+                return Intersection(m_t_exit, shape);
+
+            return {};
+        }
     };
 
     struct intersection_return_type
@@ -129,6 +129,14 @@ namespace COAL
         {
             Matrix4 result;
 
+#if COAL_SSE
+            if (!std::is_constant_evaluated())
+            {
+                multiply_simd(*this, other, result);
+                return result;
+            }
+#endif
+
             for (char i = 0; i < 4; i++)
                 for (char j = 0; j < 4; j++)
                     result._matrix[i][j] = this->_matrix[i][0] * other._matrix[0][j] +
@@ -154,6 +162,19 @@ namespace COAL
         // multiply vector3 by matrix and return a vector3
         [[nodiscard]] constexpr COAL::Vector operator*(const COAL::Vector &other) const noexcept
         {
+#if COAL_SSE
+            if (!std::is_constant_evaluated())
+            {
+                __m128 columns[4];
+                load_columns(columns);
+
+                float res[4];
+                _mm_storeu_ps(res, transform_simd(columns, other.x, other.y, other.z, false));
+
+                return COAL::Vector(res[0], res[1], res[2]);
+            }
+#endif
+
             COAL::Vector result;
 
             result.x = this->_matrix[0][0] * other.x + this->_matrix[0][1] * other.y +
@@ -168,6 +189,19 @@ namespace COAL
 
         [[nodiscard]] constexpr COAL::Point operator*(const COAL::Point &other) const noexcept
         {
+#if COAL_SSE
+            if (!std::is_constant_evaluated())
+            {
+                __m128 columns[4];
+                load_columns(columns);
+
+                float res[4];
+                _mm_storeu_ps(res, transform_simd(columns, other.x, other.y, other.z, true));
+
+                return COAL::Point(res[0], res[1], res[2]);
+            }
+#endif
+
             COAL::Point result;
 
             result.x = this->_matrix[0][0] * other.x + this->_matrix[0][1] * other.y +
@@ -180,6 +214,30 @@ namespace COAL
             return result;
         }
 
+        // transform a point and a vector at once (e.g. a ray), sharing the column loads between both
+        constexpr void transform(const COAL::Point &point, const COAL::Vector &vector, COAL::Point &point_result, COAL::Vector &vector_result) const noexcept
+        {
+#if COAL_SSE
+            if (!std::is_constant_evaluated())
+            {
+                __m128 columns[4];
+                load_columns(columns);
+
+                float res[4];
+                _mm_storeu_ps(res, transform_simd(columns, point.x, point.y, point.z, true));
+                point_result = COAL::Point(res[0], res[1], res[2]);
+
+                _mm_storeu_ps(res, transform_simd(columns, vector.x, vector.y, vector.z, false));
+                vector_result = COAL::Vector(res[0], res[1], res[2]);
+
+                return;
+            }
+#endif
+
+            point_result = *this * point;
+            vector_result = *this * vector;
+        }
+
         // *= operator
         [[nodiscard]] constexpr Matrix4 &operator*=(const Matrix4 &other) noexcept
         {
@@ -327,7 +385,7 @@ namespace COAL
                     float temp_matrix[3][3];
                     sub_matrix<3>(_matrix, i, j, temp_matrix);
 
-                    cofactor[i][j] = (float)pow(-1, i + j) * determinant(temp_matrix);
+                    cofactor[i][j] = ((i + j) % 2 == 0 ? 1.0f : -1.0f) * determinant(temp_matrix);
                 }
             }
 
@@ -340,94 +398,159 @@ namespace COAL
             return this->cofactor().transpose();
         }
 
+        // true if the bottom row is (0, 0, 0, 1), which holds for every transform built from translate/scale/rotate/shear
+        [[nodiscard]] constexpr bool is_affine() const noexcept
+        {
+            return _matrix[3][0] == 0 && _matrix[3][1] == 0 && _matrix[3][2] == 0 && _matrix[3][3] == 1;
+        }
+
         // matrix inverse
         [[nodiscard]] constexpr Matrix4 inverse() const noexcept
         {
-            return this->adjugate() / this->determinant4();
+            if (is_affine())
+                return inverse_affine();
+
+            return inverse_general();
         }
 
-        [[nodiscard]] Matrix4 translate(std::vector<float> const &values) const
+        // closed-form inverse of an affine matrix: invert the upper 3x3 block and move the translation through it
+        [[nodiscard]] constexpr Matrix4 inverse_affine() const noexcept
         {
-            std::vector<std::vector<float>> translation_values = {
-                {1, 0, 0, values[0]},
-                {0, 1, 0, values[1]},
-                {0, 0, 1, values[2]},
-                {0, 0, 0, 1},
-            };
+            const auto &m = _matrix;
+
+            const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+            const float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+            const float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+
+            const float det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+            const float inv_det = 1.0f / det;
+
+            Matrix4 res;
+
+            res._matrix[0][0] = c00 * inv_det;
+            res._matrix[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+            res._matrix[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+
+            res._matrix[1][0] = c01 * inv_det;
+            res._matrix[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+            res._matrix[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+
+            res._matrix[2][0] = c02 * inv_det;
+            res._matrix[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+            res._matrix[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+            for (int i = 0; i < 3; i++)
+                res._matrix[i][3] = -(res._matrix[i][0] * m[0][3] + res._matrix[i][1] * m[1][3] + res._matrix[i][2] * m[2][3]);
 
-            return *this * translation_values;
+            res._matrix[3][0] = 0;
+            res._matrix[3][1] = 0;
+            res._matrix[3][2] = 0;
+            res._matrix[3][3] = 1;
+
+            return res;
         }
 
-        [[nodiscard]] Matrix4 translate(const float x, const float y, const float z) const
+        // closed-form inverse of a general 4x4 matrix using shared 2x2 sub-determinants
+        [[nodiscard]] constexpr Matrix4 inverse_general() const noexcept
         {
-            std::vector<std::vector<float>> translation_values = {
-                {1, 0, 0, x},
-                {0, 1, 0, y},
-                {0, 0, 1, z},
-                {0, 0, 0, 1},
-            };
+            const auto &m = _matrix;
+
+            const float s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+            const float s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+            const float s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+            const float s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+            const float s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+            const float s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+
+            const float c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+            const float c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+            const float c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+            const float c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+            const float c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+            const float c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
 
-            return *this * translation_values;
+            const float inv_det = 1.0f / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+            return Matrix4(
+                (m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * inv_det,
+                (-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * inv_det,
+                (m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * inv_det,
+                (-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * inv_det,
+
+                (-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * inv_det,
+                (m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * inv_det,
+                (-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * inv_det,
+                (m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * inv_det,
+
+                (m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * inv_det,
+                (-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * inv_det,
+                (m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * inv_det,
+                (-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * inv_det,
+
+                (-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * inv_det,
+                (m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * inv_det,
+                (-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * inv_det,
+                (m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * inv_det);
         }
 
-        [[nodiscard]] Matrix4 scale(std::vector<float> const &values) const
+        [[nodiscard]] constexpr Matrix4 translate(std::vector<float> const &values) const
         {
-            std::vector<std::vector<float>> translation_values = {
-                {values[0], 0, 0, 0},
-                {0, values[1], 0, 0},
-                {0, 0, values[2], 0},
-                {0, 0, 0, 1},
-            };
+            return translate(values[0], values[1], values[2]);
+        }
 
-            return *this * translation_values;
+        [[nodiscard]] constexpr Matrix4 translate(const float x, const float y, const float z) const
+        {
+            return *this * Matrix4(1, 0, 0, x,
+                                   0, 1, 0, y,
+                                   0, 0, 1, z,
+                                   0, 0, 0, 1);
         }
 
-        [[nodiscard]] Matrix4 scale(const float x, const float y, const float z) const
+        [[nodiscard]] constexpr Matrix4 scale(std::vector<float> const &values) const
         {
-            std::vector<std::vector<float>> translation_values = {
-                {x, 0, 0, 0},
-                {0, y, 0, 0},
-                {0, 0, z, 0},
-                {0, 0, 0, 1},
-            };
+            return scale(values[0], values[1], values[2]);
+        }
 
-            return *this * translation_values;
+        [[nodiscard]] constexpr Matrix4 scale(const float x, const float y, const float z) const
+        {
+            return *this * Matrix4(x, 0, 0, 0,
+                                   0, y, 0, 0,
+                                   0, 0, z, 0,
+                                   0, 0, 0, 1);
         }
 
+        // the rotations stay non-constexpr since std::sin/std::cos are not constexpr before C++26
         [[nodiscard]] Matrix4 rotate_x(const float radians) const
         {
-            std::vector<std::vector<float>> rotate_x_values = {
-                {1, 0, 0, 0},
-                {0, std::cos(radians), -std::sin(radians), 0},
-                {0, std::sin(radians), std::cos(radians), 0},
-                {0, 0, 0, 1},
-            };
+            const float c = std::cos(radians);
+            const float s = std::sin(radians);
 
-            return *this * rotate_x_values;
+            return *this * Matrix4(1, 0, 0, 0,
+                                   0, c, -s, 0,
+                                   0, s, c, 0,
+                                   0, 0, 0, 1);
         }
 
         [[nodiscard]] Matrix4 rotate_y(const float radians) const
         {
-            std::vector<std::vector<float>> rotate_y_values = {
-                {std::cos(radians), 0, std::sin(radians), 0},
-                {0, 1, 0, 0},
-                {-std::sin(radians), 0, std::cos(radians), 0},
-                {0, 0, 0, 1},
-            };
+            const float c = std::cos(radians);
+            const float s = std::sin(radians);
 
-            return *this * rotate_y_values;
+            return *this * Matrix4(c, 0, s, 0,
+                                   0, 1, 0, 0,
+                                   -s, 0, c, 0,
+                                   0, 0, 0, 1);
         }
 
         [[nodiscard]] Matrix4 rotate_z(const float radians) const
         {
-            std::vector<std::vector<float>> rotate_z_values = {
-                {std::cos(radians), -std::sin(radians), 0, 0},
-                {std::sin(radians), std::cos(radians), 0, 0},
-                {0, 0, 1, 0},
-                {0, 0, 0, 1},
-            };
+            const float c = std::cos(radians);
+            const float s = std::sin(radians);
 
-            return *this * rotate_z_values;
+            return *this * Matrix4(c, -s, 0, 0,
+                                   s, c, 0, 0,
+                                   0, 0, 1, 0,
+                                   0, 0, 0, 1);
         }
 
         [[nodiscard]] Matrix4 rotate(const float radians_x, const float radians_y, const float radians_z) const
@@ -435,16 +558,12 @@ namespace COAL
             return this->rotate_x(radians_x).rotate_y(radians_y).rotate_z(radians_z);
         }
 
-        [[nodiscard]] Matrix4 shear(float Xy, float Xz, float Yx, float Yz, float Zx, float Zy) const
+        [[nodiscard]] constexpr Matrix4 shear(float Xy, float Xz, float Yx, float Yz, float Zx, float Zy) const
         {
-            std::vector<std::vector<float>> shear_values = {
-                {1, Xy, Xz, 0},
-                {Yx, 1, Yz, 0},
-                {Zx, Zy, 1, 0},
-                {0, 0, 0, 1},
-            };
-
-            return *this * shear_values;
+            return *this * Matrix4(1, Xy, Xz, 0,
+                                   Yx, 1, Yz, 0,
+                                   Zx, Zy, 1, 0,
+                                   0, 0, 0, 1);
         }
 
         // << operator
@@ -507,7 +626,73 @@ namespace COAL
         }
 
     private:
-        float _matrix[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+#if COAL_SSE
+        // result = a * b, row i of the result is a weighted sum of b's rows, added in the same order as the scalar loop
+        static void multiply_simd(const Matrix4 &a, const Matrix4 &b, Matrix4 &result) noexcept
+        {
+#if COAL_AVX
+            const __m256 b0 = _mm256_broadcast_ps((const __m128 *)b._matrix[0]);
+            const __m256 b1 = _mm256_broadcast_ps((const __m128 *)b._matrix[1]);
+            const __m256 b2 = _mm256_broadcast_ps((const __m128 *)b._matrix[2]);
+            const __m256 b3 = _mm256_broadcast_ps((const __m128 *)b._matrix[3]);
+
+            // two rows of the result per iteration
+            for (int i = 0; i < 4; i += 2)
+            {
+                const float *r0 = a._matrix[i];
+                const float *r1 = a._matrix[i + 1];
+
+                __m256 row = _mm256_mul_ps(_mm256_setr_ps(r0[0], r0[0], r0[0], r0[0], r1[0], r1[0], r1[0], r1[0]), b0);
+                row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_setr_ps(r0[1], r0[1], r0[1], r0[1], r1[1], r1[1], r1[1], r1[1]), b1));
+                row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_setr_ps(r0[2], r0[2], r0[2], r0[2], r1[2], r1[2], r1[2], r1[2]), b2));
+                row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_setr_ps(r0[3], r0[3], r0[3], r0[3], r1[3], r1[3], r1[3], r1[3]), b3));
+
+                _mm256_store_ps(result._matrix[i], row);
+            }
+#else
+            const __m128 b0 = _mm_load_ps(b._matrix[0]);
+            const __m128 b1 = _mm_load_ps(b._matrix[1]);
+            const __m128 b2 = _mm_load_ps(b._matrix[2]);
+            const __m128 b3 = _mm_load_ps(b._matrix[3]);
+
+            for (int i = 0; i < 4; i++)
+            {
+                __m128 row = _mm_mul_ps(_mm_set1_ps(a._matrix[i][0]), b0);
+                row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a._matrix[i][1]), b1));
+                row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a._matrix[i][2]), b2));
+                row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a._matrix[i][3]), b3));
+
+                _mm_store_ps(result._matrix[i], row);
+            }
+#endif
+        }
+
+        // the four columns of the matrix, one per register
+        void load_columns(__m128 (&columns)[4]) const noexcept
+        {
+            columns[0] = _mm_load_ps(_matrix[0]);
+            columns[1] = _mm_load_ps(_matrix[1]);
+            columns[2] = _mm_load_ps(_matrix[2]);
+            columns[3] = _mm_load_ps(_matrix[3]);
+
+            _MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+        }
+
+        // columns * (x, y, z, w), with w = 1 for points and 0 (the translation is skipped) for vectors
+        static __m128 transform_simd(const __m128 (&columns)[4], const float x, const float y, const float z, const bool is_point) noexcept
+        {
+            __m128 res = _mm_mul_ps(columns[0], _mm_set1_ps(x));
+            res = _mm_add_ps(res, _mm_mul_ps(columns[1], _mm_set1_ps(y)));
+            res = _mm_add_ps(res, _mm_mul_ps(columns[2], _mm_set1_ps(z)));
+
+            if (is_point)
+                res = _mm_add_ps(res, columns[3]);
+
+            return res;
+        }
+#endif
+
+        alignas(32) float _matrix[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
     };
 
     constexpr const Matrix4 IDENTITY = Matrix4();
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Memory/InlineVector.hpp"
+#include "Shapes/Shape.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief The shapes a ray travels inside of, innermost last
+     *
+     * Every ray carries the stack of the ray it was spawned from, a refracted ray with the crossed shape entered or left. n1/n2 of a
+     * hit are read off the stack instead of being rebuilt from a sorted list of every hit along the ray. Shapes are compared by
+     * address.
+     */
+    struct MediumStack
+    {
+        // nesting deeper than this is ignored, every level costs a refraction and the max depth cuts those off long before
+        static constexpr size_t kMaxDepth = 8;
+
+        // the stack of rays that start outside of every shape
+        [[nodiscard]] static const MediumStack &vacuum() noexcept
+        {
+            static const MediumStack stack;
+            return stack;
+        }
+
+        // the refractive index around the ray, 1 outside of every shape
+        [[nodiscard]] float refractive_index() const noexcept
+        {
+            return m_shapes.empty() ? 1.0f : m_shapes.back()->get_material().get_refractive_index();
+        }
+
+        /**
+         * @brief The refractive index on the other side of a surface of shape
+         *
+         * The shape's own index if the ray enters it there, the index of the next outer shape if the ray leaves the innermost one.
+         * Leaving a shape that is not the innermost one keeps the ray in the innermost shape.
+         */
+        [[nodiscard]] float refractive_index_across(const Shape &shape) const noexcept
+        {
+            const size_t index = find(shape);
+
+            if (index == m_shapes.size())
+                return shape.get_material().get_refractive_index();
+
+            if (index + 1 < m_shapes.size())
+                return refractive_index();
+
+            return index == 0 ? 1.0f : m_shapes[index - 1]->get_material().get_refractive_index();
+        }
+
+        // the stack on the other side of a surface of shape, the shape is left if the ray is inside of it and entered otherwise
+        [[nodiscard]] MediumStack crossed(const Shape &shape) const noexcept
+        {
+            MediumStack stack = *this;
+
+            const size_t index = find(shape);
+
+            if (index != m_shapes.size())
+                stack.m_shapes.erase(index);
+            else if (m_shapes.size() < kMaxDepth)
+                stack.m_shapes.push_back(&shape);
+
+            return stack;
+        }
+
+        [[nodiscard]] bool contains(const Shape &shape) const noexcept
+        {
+            return find(shape) != m_shapes.size();
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return m_shapes.size();
+        }
+
+    private:
+        // the position of shape, size() if the ray is not inside of it
+        [[nodiscard]] size_t find(const Shape &shape) const noexcept
+        {
+            size_t index = 0;
+
+            while (index < m_shapes.size() && m_shapes[index] != &shape)
+                index++;
+
+            return index;
+        }
+
+        InlineVector<const Shape *, kMaxDepth> m_shapes;
+    };
+} // namespace COAL
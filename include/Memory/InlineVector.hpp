@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Constants.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief A vector with a fixed capacity that stores its elements inline (on the stack)
+     *
+     * @tparam T The element type
+     * @tparam Capacity The maximum number of elements, pushes beyond it are dropped (and assert in debug builds)
+     */
+    template <typename T, size_t Capacity>
+    struct InlineVector
+    {
+        [[nodiscard]] constexpr InlineVector() = default;
+
+        constexpr void push_back(const T &value) noexcept
+        {
+            assert(m_size < Capacity);
+
+            if (m_size < Capacity)
+                m_data[m_size++] = value;
+        }
+
+        constexpr void pop_back() noexcept
+        {
+            assert(m_size > 0);
+
+            m_size--;
+        }
+
+        // remove the element at index, keeping the order of the others
+        constexpr void erase(const size_t index) noexcept
+        {
+            for (size_t i = index + 1; i < m_size; i++)
+                m_data[i - 1] = m_data[i];
+
+            m_size--;
+        }
+
+        constexpr void clear() noexcept { m_size = 0; }
+
+        [[nodiscard]] constexpr size_t size() const noexcept { return m_size; }
+        [[nodiscard]] constexpr bool empty() const noexcept { return m_size == 0; }
+        [[nodiscard]] static constexpr size_t capacity() noexcept { return Capacity; }
+
+        [[nodiscard]] constexpr T &back() noexcept { return m_data[m_size - 1]; }
+        [[nodiscard]] constexpr const T &back() const noexcept { return m_data[m_size - 1]; }
+
+        [[nodiscard]] constexpr T *begin() noexcept { return m_data; }
+        [[nodiscard]] constexpr T *end() noexcept { return m_data + m_size; }
+        [[nodiscard]] constexpr const T *begin() const noexcept { return m_data; }
+        [[nodiscard]] constexpr const T *end() const noexcept { return m_data + m_size; }
+
+        [[nodiscard]] constexpr T &operator[](const size_t index) noexcept { return m_data[index]; }
+        [[nodiscard]] constexpr const T &operator[](const size_t index) const noexcept { return m_data[index]; }
+
+    private:
+        T m_data[Capacity]{};
+        size_t m_size = 0;
+    };
+} // namespace COAL
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Constants.hpp"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace COAL
+{
+    /**
+     * @brief A read only view of a whole file through the page cache
+     *
+     * The file is not copied, pages are read when they are first touched, so large files can be parsed by several threads at once
+     * without a read buffer per thread. The view stays valid until the object is destroyed.
+     */
+    struct MappedFile
+    {
+        /**
+         * @brief Map a file
+         *
+         * @param filepath The file, is_open() is false if it can not be opened or is empty
+         */
+        [[nodiscard]] explicit MappedFile(const std::string &filepath)
+        {
+            PROFILE_FUNCTION();
+
+#if defined(_WIN32)
+            m_file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+            if (m_file == INVALID_HANDLE_VALUE)
+                return;
+
+            LARGE_INTEGER size;
+
+            if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+                return;
+
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+            if (!m_mapping)
+                return;
+
+            m_data = (const char *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+
+            if (m_data)
+                m_size = (size_t)size.QuadPart;
+#else
+            m_descriptor = open(filepath.c_str(), O_RDONLY);
+
+            if (m_descriptor < 0)
+                return;
+
+            struct stat info;
+
+            if (fstat(m_descriptor, &info) != 0 || info.st_size == 0)
+                return;
+
+            void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, m_descriptor, 0);
+
+            if (data == MAP_FAILED)
+                return;
+
+            // the parsers walk their chunks front to back
+            madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+            m_data = (const char *)data;
+            m_size = (size_t)info.st_size;
+#endif
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile()
+        {
+#if defined(_WIN32)
+            if (m_data)
+                UnmapViewOfFile(m_data);
+
+            if (m_mapping)
+                CloseHandle(m_mapping);
+
+            if (m_file != INVALID_HANDLE_VALUE)
+                CloseHandle(m_file);
+#else
+            if (m_data)
+                munmap((void *)m_data, m_size);
+
+            if (m_descriptor >= 0)
+                close(m_descriptor);
+#endif
+        }
+
+        // getters
+        [[nodiscard]] bool is_open() const noexcept { return m_data != nullptr; }
+        [[nodiscard]] const char *data() const noexcept { return m_data; }
+        [[nodiscard]] size_t size() const noexcept { return m_size; }
+
+    private:
+#if defined(_WIN32)
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+#else
+        int m_descriptor = -1;
+#endif
+
+        const char *m_data = nullptr;
+        size_t m_size = 0;
+    };
+} // namespace COAL
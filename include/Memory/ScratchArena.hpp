@@ -0,0 +1,201 @@
+#pragma once
+
+#include "Constants.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief A per-thread bump allocator for short lived per-ray data
+     *
+     * Memory is handed out from large blocks that are kept after a rewind, so once a thread has warmed up it no longer touches the heap.
+     * Nothing is destructed on rewind, only trivially destructible data should be placed in the arena.
+     */
+    struct ScratchArena
+    {
+        static constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+        /**
+         * @brief A position in the arena that can be rewound to
+         *
+         */
+        struct Marker
+        {
+            size_t m_block;
+            size_t m_offset;
+        };
+
+        [[nodiscard]] explicit ScratchArena(const size_t block_size = kDefaultBlockSize) : m_block_size(block_size) {}
+
+        ScratchArena(const ScratchArena &) = delete;
+        ScratchArena &operator=(const ScratchArena &) = delete;
+
+        /**
+         * @brief Get the arena of the calling thread
+         *
+         * @return ScratchArena&
+         */
+        [[nodiscard]] static ScratchArena &local()
+        {
+            thread_local ScratchArena arena;
+            return arena;
+        }
+
+        /**
+         * @brief Allocate uninitialized memory
+         *
+         * @param size The size in bytes
+         * @param alignment A power of two
+         * @return void* The memory, valid until the arena is rewound past it
+         */
+        [[nodiscard]] void *allocate(const size_t size, const size_t alignment = alignof(std::max_align_t))
+        {
+            while (m_block < m_blocks.size())
+            {
+                Block &block = m_blocks[m_block];
+
+                size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+
+                if (offset + size <= block.m_size)
+                {
+                    m_offset = offset + size;
+                    return block.m_data.get() + offset;
+                }
+
+                m_block++;
+                m_offset = 0;
+            }
+
+            // only reached while warming up or for oversized requests
+            Block block;
+            block.m_size = std::max(m_block_size, size + alignment);
+            block.m_data.reset(new std::byte[block.m_size]);
+
+            m_blocks.emplace_back(std::move(block));
+            m_block = m_blocks.size() - 1;
+            m_offset = 0;
+
+            return allocate(size, alignment);
+        }
+
+        // allocate room for count objects of type T
+        template <typename T>
+        [[nodiscard]] T *allocate_array(const size_t count)
+        {
+            static_assert(std::is_trivially_destructible_v<T>, "the arena never runs destructors");
+
+            return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+        }
+
+        [[nodiscard]] Marker get_marker() const noexcept
+        {
+            return {m_block, m_offset};
+        }
+
+        // release everything allocated after the marker, the blocks stay around for reuse
+        void rewind(const Marker &marker) noexcept
+        {
+            m_block = marker.m_block;
+            m_offset = marker.m_offset;
+        }
+
+        void reset() noexcept
+        {
+            m_block = 0;
+            m_offset = 0;
+        }
+
+        // bytes reserved from the heap so far
+        [[nodiscard]] size_t get_capacity() const noexcept
+        {
+            size_t capacity = 0;
+
+            for (const auto &block : m_blocks)
+                capacity += block.m_size;
+
+            return capacity;
+        }
+
+    private:
+        struct Block
+        {
+            std::unique_ptr<std::byte[]> m_data;
+            size_t m_size = 0;
+        };
+
+        std::vector<Block> m_blocks;
+        size_t m_block = 0;
+        size_t m_offset = 0;
+        size_t m_block_size;
+    };
+
+    /**
+     * @brief Rewinds an arena to where it was when the scope was entered
+     *
+     */
+    struct ArenaScope
+    {
+        [[nodiscard]] explicit ArenaScope(ScratchArena &arena = ScratchArena::local()) : m_arena(arena), m_marker(arena.get_marker()) {}
+
+        ArenaScope(const ArenaScope &) = delete;
+        ArenaScope &operator=(const ArenaScope &) = delete;
+
+        ~ArenaScope()
+        {
+            m_arena.rewind(m_marker);
+        }
+
+        ScratchArena &m_arena;
+        ScratchArena::Marker m_marker;
+    };
+
+    /**
+     * @brief A growable array that lives in a ScratchArena
+     *
+     * Growing copies the elements into a bigger region of the arena, the old region is reclaimed when the arena is rewound.
+     *
+     * @tparam T A trivially copyable type
+     */
+    template <typename T>
+    struct ArenaVector
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "ArenaVector elements are moved with memcpy");
+
+        [[nodiscard]] explicit ArenaVector(ScratchArena &arena = ScratchArena::local(), const size_t capacity = 16)
+            : m_arena(&arena), m_data(arena.allocate_array<T>(capacity)), m_capacity(capacity)
+        {
+        }
+
+        void push_back(const T &value)
+        {
+            if (m_size == m_capacity)
+            {
+                T *data = m_arena->allocate_array<T>(m_capacity * 2);
+                std::memcpy(data, m_data, sizeof(T) * m_size);
+
+                m_data = data;
+                m_capacity *= 2;
+            }
+
+            m_data[m_size++] = value;
+        }
+
+        void clear() noexcept { m_size = 0; }
+
+        [[nodiscard]] size_t size() const noexcept { return m_size; }
+        [[nodiscard]] bool empty() const noexcept { return m_size == 0; }
+
+        [[nodiscard]] T *begin() noexcept { return m_data; }
+        [[nodiscard]] T *end() noexcept { return m_data + m_size; }
+        [[nodiscard]] const T *begin() const noexcept { return m_data; }
+        [[nodiscard]] const T *end() const noexcept { return m_data + m_size; }
+
+        [[nodiscard]] T &operator[](const size_t index) noexcept { return m_data[index]; }
+        [[nodiscard]] const T &operator[](const size_t index) const noexcept { return m_data[index]; }
+
+    private:
+        ScratchArena *m_arena;
+        T *m_data;
+        size_t m_size = 0;
+        size_t m_capacity;
+    };
+} // namespace COAL
@@ -0,0 +1,809 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Memory/MappedFile.hpp"
+#include "Shapes/Mesh.hpp"
+#include "Threading/ThreadPool.hpp"
+#include "Tuples/Point.hpp"
+
+#include <charconv>
+
+namespace COAL
+{
+    /**
+     * @brief Reads triangle meshes from Wavefront OBJ and binary PLY files
+     *
+     * The file is memory mapped and cut into one chunk per worker of the pool. The chunks are parsed at the same time into their own
+     * buffers, which are then copied into the mesh in file order, so the triangles come out the same with or without a pool. Polygons
+     * are split into fans of triangles. Only the positions are read, normals and texture coordinates are skipped.
+     */
+    struct MeshLoader
+    {
+        // smaller files are parsed by the calling thread
+        static constexpr size_t kMinParallelSize = 1 << 20;
+
+        /**
+         * @brief Load a mesh, the format is picked by the file's extension (.obj or .ply)
+         *
+         * @param filepath The file, it is also stored in the mesh so a scene can refer to it
+         * @param pool Workers to parse and build the BVH with, may be nullptr. Must not be called from a job of the pool
+         * @return std::shared_ptr<const MeshData> The mesh, nullptr if the file can not be read
+         */
+        [[nodiscard]] static std::shared_ptr<const MeshData> load(const std::string &filepath, ThreadPool *pool = nullptr)
+        {
+            std::string extension = std::filesystem::path(filepath).extension().string();
+
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](const unsigned char c)
+                           { return (char)std::tolower(c); });
+
+            if (extension == ".obj")
+                return load_obj(filepath, pool);
+            if (extension == ".ply")
+                return load_ply(filepath, pool);
+
+            debug_print("[IO]: ", "unsupported mesh format: " + filepath);
+
+            return nullptr;
+        }
+
+        /**
+         * @brief Load the vertices (v) and faces (f) of an OBJ file
+         *
+         * Faces may use negative (relative) indices and the v/vt/vn form, everything but the vertex index is ignored.
+         */
+        [[nodiscard]] static std::shared_ptr<const MeshData> load_obj(const std::string &filepath, ThreadPool *pool = nullptr)
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            MappedFile file(filepath);
+
+            if (!file.is_open())
+            {
+                debug_print("[IO]: ", "failed to open mesh: " + filepath);
+                return nullptr;
+            }
+
+            const char *data = file.data();
+            const size_t size = file.size();
+
+            if (size < kMinParallelSize)
+                pool = nullptr;
+
+            // chunks start at the beginning of a line
+            const size_t chunk_count = pool ? (size_t)std::max(1, pool->get_thread_count()) : 1;
+            std::vector<size_t> starts(chunk_count + 1, size);
+            starts[0] = 0;
+
+            for (size_t c = 1; c < chunk_count; c++)
+            {
+                const size_t from = std::max(starts[c - 1], size * c / chunk_count);
+                const char *line_end = from < size ? (const char *)std::memchr(data + from, '\n', size - from) : nullptr;
+
+                starts[c] = line_end ? (size_t)(line_end - data) + 1 : size;
+            }
+
+            // relative face indices count back from the vertices before them, so every chunk needs the number of vertices in front of it
+            std::vector<size_t> vertex_offsets(chunk_count + 1, 0);
+
+            for_chunks(pool, chunk_count, [&](const size_t c)
+                       {
+                size_t count = 0;
+
+                for_each_line(data + starts[c], data + starts[c + 1], [&](const char *line, const char *line_end)
+                              {
+                    if (line + 1 < line_end && line[0] == 'v' && is_space(line[1]))
+                        count++; });
+
+                vertex_offsets[c + 1] = count; });
+
+            for (size_t c = 0; c < chunk_count; c++)
+                vertex_offsets[c + 1] += vertex_offsets[c];
+
+            std::vector<Chunk> chunks(chunk_count);
+
+            for_chunks(pool, chunk_count, [&](const size_t c)
+                       { parse_obj_chunk(data + starts[c], data + starts[c + 1], vertex_offsets[c], chunks[c]); });
+
+            return finish(filepath, std::move(chunks), pool, start);
+        }
+
+        /**
+         * @brief Load the vertex and face elements of a binary PLY file, either endianness
+         *
+         * The positions are read from the vertex element's x, y and z properties and the faces from a list named vertex_indices (or
+         * vertex_index). Other scalar properties are skipped. ASCII files are rejected.
+         */
+        [[nodiscard]] static std::shared_ptr<const MeshData> load_ply(const std::string &filepath, ThreadPool *pool = nullptr)
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            MappedFile file(filepath);
+
+            if (!file.is_open())
+            {
+                debug_print("[IO]: ", "failed to open mesh: " + filepath);
+                return nullptr;
+            }
+
+            const char *data = file.data();
+            const size_t size = file.size();
+
+            if (size < kMinParallelSize)
+                pool = nullptr;
+
+            PlyHeader header;
+
+            if (!parse_ply_header(data, size, header))
+            {
+                debug_print("[IO]: ", "unsupported PLY header: " + filepath);
+                return nullptr;
+            }
+
+            Chunk mesh;
+            size_t offset = header.m_body;
+            bool has_vertices = false;
+            bool has_faces = false;
+
+            for (const PlyElement &element : header.m_elements)
+            {
+                if (element.m_name == "vertex" && !has_vertices)
+                {
+                    if (!read_ply_vertices(data, size, offset, element, header.m_swap, pool, mesh.m_positions))
+                        break;
+
+                    has_vertices = true;
+                }
+                else if (element.m_name == "face" && !has_faces)
+                {
+                    if (!read_ply_faces(data, size, offset, element, header.m_swap, pool, mesh.m_indices))
+                        break;
+
+                    has_faces = true;
+                }
+                else if (has_vertices && has_faces)
+                {
+                    break;
+                }
+                else
+                {
+                    // an element in front of the mesh, only fixed size records can be skipped
+                    const size_t stride = element.fixed_stride();
+
+                    if (stride == 0 || offset + element.m_count * stride > size)
+                        break;
+
+                    offset += element.m_count * stride;
+                }
+            }
+
+            if (!has_vertices || !has_faces)
+            {
+                debug_print("[IO]: ", "failed to read the vertices and faces of: " + filepath);
+                return nullptr;
+            }
+
+            std::vector<Chunk> chunks;
+            chunks.emplace_back(std::move(mesh));
+
+            return finish(filepath, std::move(chunks), pool, start);
+        }
+
+    private:
+        // the part of a mesh one worker read
+        struct Chunk
+        {
+            std::vector<Point> m_positions;
+            std::vector<uint32_t> m_indices;
+            bool m_failed = false;
+        };
+
+        enum class PlyType
+        {
+            Int8,
+            UInt8,
+            Int16,
+            UInt16,
+            Int32,
+            UInt32,
+            Float32,
+            Float64,
+            Invalid
+        };
+
+        struct PlyProperty
+        {
+            std::string m_name;
+            PlyType m_type = PlyType::Invalid;
+            // the type of a list's length, Invalid for scalar properties
+            PlyType m_count_type = PlyType::Invalid;
+        };
+
+        struct PlyElement
+        {
+            std::string m_name;
+            size_t m_count = 0;
+            std::vector<PlyProperty> m_properties;
+
+            // the size of one record, 0 if it holds a list
+            [[nodiscard]] size_t fixed_stride() const noexcept
+            {
+                size_t stride = 0;
+
+                for (const PlyProperty &property : m_properties)
+                {
+                    if (property.m_count_type != PlyType::Invalid)
+                        return 0;
+
+                    stride += type_size(property.m_type);
+                }
+
+                return stride;
+            }
+        };
+
+        struct PlyHeader
+        {
+            std::vector<PlyElement> m_elements;
+            // the offset of the first record
+            size_t m_body = 0;
+            // the file's endianness is not the machine's
+            bool m_swap = false;
+        };
+
+        [[nodiscard]] static bool is_space(const char c) noexcept
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        // fn(chunk) for every chunk, on the pool's workers if there is a pool
+        template <typename Function>
+        static void for_chunks(ThreadPool *pool, const size_t count, Function &&fn)
+        {
+            if (!pool || count <= 1)
+            {
+                for (size_t c = 0; c < count; c++)
+                    fn(c);
+
+                return;
+            }
+
+            pool->parallel_for(count, [&](const size_t begin, const size_t end, [[maybe_unused]] const int worker)
+                               {
+                for (size_t c = begin; c < end; c++)
+                    fn(c); });
+        }
+
+        // fn(line, line_end) for every line of [begin, end) without its line break and leading white space
+        template <typename Function>
+        static void for_each_line(const char *begin, const char *end, Function &&fn)
+        {
+            while (begin < end)
+            {
+                const char *line_end = (const char *)std::memchr(begin, '\n', (size_t)(end - begin));
+
+                if (!line_end)
+                    line_end = end;
+
+                const char *line = begin;
+
+                while (line < line_end && is_space(*line))
+                    line++;
+
+                fn(line, line_end);
+
+                begin = line_end + 1;
+            }
+        }
+
+        // skip white space, then read one number, p is left behind it
+        template <typename T>
+        [[nodiscard]] static bool parse_number(const char *&p, const char *end, T &value) noexcept
+        {
+            while (p < end && is_space(*p))
+                p++;
+
+            if (p < end && *p == '+')
+                p++;
+
+            const auto [ptr, error] = std::from_chars(p, end, value);
+
+            if (error != std::errc())
+                return false;
+
+            p = ptr;
+
+            return true;
+        }
+
+        static void parse_obj_chunk(const char *begin, const char *end, const size_t vertex_offset, Chunk &chunk)
+        {
+            std::vector<uint32_t> polygon;
+
+            for_each_line(begin, end, [&](const char *line, const char *line_end)
+                          {
+                if (chunk.m_failed || line + 1 >= line_end || !is_space(line[1]))
+                    return;
+
+                const char *p = line + 2;
+
+                if (line[0] == 'v')
+                {
+                    float x, y, z;
+
+                    if (!parse_number(p, line_end, x) || !parse_number(p, line_end, y) || !parse_number(p, line_end, z))
+                        chunk.m_failed = true;
+                    else
+                        chunk.m_positions.emplace_back(x, y, z);
+                }
+                else if (line[0] == 'f')
+                {
+                    polygon.clear();
+
+                    while (true)
+                    {
+                        while (p < line_end && is_space(*p))
+                            p++;
+
+                        if (p >= line_end || *p == '#')
+                            break;
+
+                        int64_t index;
+
+                        if (!parse_number(p, line_end, index) || index == 0)
+                        {
+                            chunk.m_failed = true;
+                            return;
+                        }
+
+                        // positive indices count from 1, negative ones back from the last vertex
+                        const int64_t resolved = index > 0 ? index - 1 : (int64_t)(vertex_offset + chunk.m_positions.size()) + index;
+
+                        if (resolved < 0 || resolved > std::numeric_limits<uint32_t>::max())
+                        {
+                            chunk.m_failed = true;
+                            return;
+                        }
+
+                        polygon.emplace_back((uint32_t)resolved);
+
+                        // the texture coordinate and normal indices of v/vt/vn
+                        while (p < line_end && !is_space(*p))
+                            p++;
+                    }
+
+                    for (size_t i = 2; i < polygon.size(); i++)
+                    {
+                        chunk.m_indices.emplace_back(polygon[0]);
+                        chunk.m_indices.emplace_back(polygon[i - 1]);
+                        chunk.m_indices.emplace_back(polygon[i]);
+                    }
+                } });
+        }
+
+        [[nodiscard]] static PlyType parse_ply_type(const std::string &name) noexcept
+        {
+            if (name == "char" || name == "int8")
+                return PlyType::Int8;
+            if (name == "uchar" || name == "uint8")
+                return PlyType::UInt8;
+            if (name == "short" || name == "int16")
+                return PlyType::Int16;
+            if (name == "ushort" || name == "uint16")
+                return PlyType::UInt16;
+            if (name == "int" || name == "int32")
+                return PlyType::Int32;
+            if (name == "uint" || name == "uint32")
+                return PlyType::UInt32;
+            if (name == "float" || name == "float32")
+                return PlyType::Float32;
+            if (name == "double" || name == "float64")
+                return PlyType::Float64;
+
+            return PlyType::Invalid;
+        }
+
+        [[nodiscard]] static size_t type_size(const PlyType type) noexcept
+        {
+            constexpr size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+
+            return sizes[(int)type];
+        }
+
+        template <typename T>
+        [[nodiscard]] static T load(const char *p, const bool swap) noexcept
+        {
+            char bytes[sizeof(T)];
+            std::memcpy(bytes, p, sizeof(T));
+
+            if (swap)
+                std::reverse(bytes, bytes + sizeof(T));
+
+            T value;
+            std::memcpy(&value, bytes, sizeof(T));
+
+            return value;
+        }
+
+        // a value of any type as a double, which holds every one of them exactly
+        [[nodiscard]] static double read_ply_value(const char *p, const PlyType type, const bool swap) noexcept
+        {
+            switch (type)
+            {
+            case PlyType::Int8:
+                return load<int8_t>(p, swap);
+            case PlyType::UInt8:
+                return load<uint8_t>(p, swap);
+            case PlyType::Int16:
+                return load<int16_t>(p, swap);
+            case PlyType::UInt16:
+                return load<uint16_t>(p, swap);
+            case PlyType::Int32:
+                return load<int32_t>(p, swap);
+            case PlyType::UInt32:
+                return load<uint32_t>(p, swap);
+            case PlyType::Float32:
+                return load<float>(p, swap);
+            case PlyType::Float64:
+                return load<double>(p, swap);
+            default:
+                return 0;
+            }
+        }
+
+        // a list entry as a vertex index, negative and too large values are rejected instead of wrapping around in the cast
+        [[nodiscard]] static bool read_ply_index(const char *p, const PlyType type, const bool swap, uint32_t &index) noexcept
+        {
+            const double value = read_ply_value(p, type, swap);
+
+            if (!(value >= 0 && value <= (double)std::numeric_limits<uint32_t>::max()))
+                return false;
+
+            index = (uint32_t)value;
+
+            return true;
+        }
+
+        [[nodiscard]] static bool parse_ply_header(const char *data, const size_t size, PlyHeader &header)
+        {
+            const std::string_view file(data, size);
+            const size_t end = file.find("end_header");
+
+            if (file.substr(0, 3) != "ply" || end == std::string_view::npos)
+                return false;
+
+            const size_t body = file.find('\n', end);
+
+            if (body == std::string_view::npos)
+                return false;
+
+            header.m_body = body + 1;
+
+            std::istringstream lines(std::string(file.substr(0, end)));
+            std::string line;
+            bool binary = false;
+
+            while (std::getline(lines, line))
+            {
+                std::istringstream words(line);
+                std::string keyword;
+                words >> keyword;
+
+                if (keyword == "format")
+                {
+                    std::string format;
+                    words >> format;
+
+                    const bool little_endian = format == "binary_little_endian";
+
+                    if (!little_endian && format != "binary_big_endian")
+                        return false;
+
+                    binary = true;
+                    header.m_swap = little_endian != (std::endian::native == std::endian::little);
+                }
+                else if (keyword == "element")
+                {
+                    PlyElement &element = header.m_elements.emplace_back();
+                    words >> element.m_name >> element.m_count;
+                }
+                else if (keyword == "property")
+                {
+                    if (header.m_elements.empty())
+                        return false;
+
+                    PlyProperty property;
+                    std::string type;
+                    words >> type;
+
+                    if (type == "list")
+                    {
+                        std::string count_type;
+                        words >> count_type >> type;
+
+                        property.m_count_type = parse_ply_type(count_type);
+
+                        if (property.m_count_type == PlyType::Invalid)
+                            return false;
+                    }
+
+                    property.m_type = parse_ply_type(type);
+                    words >> property.m_name;
+
+                    if (property.m_type == PlyType::Invalid)
+                        return false;
+
+                    header.m_elements.back().m_properties.emplace_back(property);
+                }
+            }
+
+            return binary;
+        }
+
+        [[nodiscard]] static bool read_ply_vertices(const char *data, const size_t size, size_t &offset, const PlyElement &element, const bool swap,
+                                                    ThreadPool *pool, std::vector<Point> &positions)
+        {
+            const size_t stride = element.fixed_stride();
+
+            if (stride == 0 || offset + element.m_count * stride > size)
+                return false;
+
+            // the offsets and types of x, y and z inside a record
+            size_t offsets[3] = {};
+            PlyType types[3] = {PlyType::Invalid, PlyType::Invalid, PlyType::Invalid};
+            size_t property_offset = 0;
+
+            for (const PlyProperty &property : element.m_properties)
+            {
+                const int axis = property.m_name == "x" ? 0 : property.m_name == "y" ? 1
+                                                          : property.m_name == "z"   ? 2
+                                                                                     : -1;
+
+                if (axis >= 0)
+                {
+                    offsets[axis] = property_offset;
+                    types[axis] = property.m_type;
+                }
+
+                property_offset += type_size(property.m_type);
+            }
+
+            if (types[0] == PlyType::Invalid || types[1] == PlyType::Invalid || types[2] == PlyType::Invalid)
+                return false;
+
+            positions.resize(element.m_count);
+
+            const char *records = data + offset;
+            const size_t chunks = pool ? (size_t)std::max(1, pool->get_thread_count()) : 1;
+
+            for_chunks(pool, chunks, [&](const size_t c)
+                       {
+                for (size_t i = element.m_count * c / chunks; i < element.m_count * (c + 1) / chunks; i++)
+                {
+                    const char *record = records + i * stride;
+
+                    positions[i] = Point((float)read_ply_value(record + offsets[0], types[0], swap), (float)read_ply_value(record + offsets[1], types[1], swap),
+                                         (float)read_ply_value(record + offsets[2], types[2], swap));
+                } });
+
+            offset += element.m_count * stride;
+
+            return true;
+        }
+
+        /**
+         * @brief Read the faces, the records are taken to have the size of the first one
+         *
+         * Files with one polygon size (all triangles, all quads) are read in parallel. A record with another vertex count sends the
+         * whole element to a serial pass that walks the records one by one.
+         */
+        [[nodiscard]] static bool read_ply_faces(const char *data, const size_t size, size_t &offset, const PlyElement &element, const bool swap,
+                                                 ThreadPool *pool, std::vector<uint32_t> &indices)
+        {
+            // the sizes of the scalar properties around the index list
+            size_t before = 0;
+            size_t after = 0;
+            const PlyProperty *list = nullptr;
+
+            for (const PlyProperty &property : element.m_properties)
+            {
+                if (property.m_count_type != PlyType::Invalid)
+                {
+                    if (list || (property.m_name != "vertex_indices" && property.m_name != "vertex_index"))
+                        return false;
+
+                    list = &property;
+                }
+                else
+                {
+                    (list ? after : before) += type_size(property.m_type);
+                }
+            }
+
+            if (!list)
+                return false;
+
+            const size_t count_size = type_size(list->m_count_type);
+            const size_t index_size = type_size(list->m_type);
+
+            if (element.m_count == 0)
+                return true;
+
+            if (offset + before + count_size > size)
+                return false;
+
+            const double first_count = read_ply_value(data + offset + before, list->m_count_type, swap);
+            const size_t corners = first_count >= 3 ? (size_t)first_count : 0;
+            const size_t stride = before + count_size + corners * index_size + after;
+
+            if (corners > 0 && offset + element.m_count * stride <= size)
+            {
+                const size_t triangles = corners - 2;
+                indices.resize(element.m_count * triangles * 3);
+
+                const size_t chunks = pool ? (size_t)std::max(1, pool->get_thread_count()) : 1;
+                std::atomic<bool> uniform = true;
+                std::atomic<bool> valid = true;
+
+                for_chunks(pool, chunks, [&](const size_t c)
+                           {
+                    for (size_t i = element.m_count * c / chunks; i < element.m_count * (c + 1) / chunks; i++)
+                    {
+                        const char *record = data + offset + i * stride + before;
+
+                        if (read_ply_value(record, list->m_count_type, swap) != first_count)
+                        {
+                            uniform = false;
+                            return;
+                        }
+
+                        const char *corner = record + count_size;
+                        uint32_t *out = indices.data() + i * triangles * 3;
+
+                        uint32_t first = 0;
+                        uint32_t previous = 0;
+
+                        if (!read_ply_index(corner, list->m_type, swap, first) || !read_ply_index(corner + index_size, list->m_type, swap, previous))
+                        {
+                            valid = false;
+                            return;
+                        }
+
+                        for (size_t k = 2; k < corners; k++)
+                        {
+                            uint32_t current = 0;
+
+                            if (!read_ply_index(corner + k * index_size, list->m_type, swap, current))
+                            {
+                                valid = false;
+                                return;
+                            }
+
+                            *out++ = first;
+                            *out++ = previous;
+                            *out++ = current;
+
+                            previous = current;
+                        }
+                    } });
+
+                if (!valid)
+                    return false;
+
+                if (uniform)
+                {
+                    offset += element.m_count * stride;
+                    return true;
+                }
+            }
+
+            // mixed polygon sizes
+            indices.clear();
+
+            for (size_t i = 0; i < element.m_count; i++)
+            {
+                if (offset + before + count_size > size)
+                    return false;
+
+                const double count_value = read_ply_value(data + offset + before, list->m_count_type, swap);
+
+                // a negative count or one past the end of the file would wrap the offset around
+                if (!(count_value >= 0 && count_value * (double)index_size <= (double)(size - offset)))
+                    return false;
+
+                const size_t count = (size_t)count_value;
+                const char *corner = data + offset + before + count_size;
+
+                offset += before + count_size + count * index_size + after;
+
+                if (offset > size)
+                    return false;
+
+                for (size_t k = 2; k < count; k++)
+                {
+                    uint32_t triangle[3];
+
+                    if (!read_ply_index(corner, list->m_type, swap, triangle[0]) || !read_ply_index(corner + (k - 1) * index_size, list->m_type, swap, triangle[1]) ||
+                        !read_ply_index(corner + k * index_size, list->m_type, swap, triangle[2]))
+                        return false;
+
+                    indices.insert(indices.end(), triangle, triangle + 3);
+                }
+            }
+
+            return true;
+        }
+
+        // join the chunks in order, check the indices and build the mesh
+        [[nodiscard]] static std::shared_ptr<const MeshData> finish(const std::string &filepath, std::vector<Chunk> chunks, ThreadPool *pool,
+                                                                    const std::chrono::steady_clock::time_point start)
+        {
+            std::vector<size_t> position_offsets(chunks.size() + 1, 0);
+            std::vector<size_t> index_offsets(chunks.size() + 1, 0);
+
+            for (size_t c = 0; c < chunks.size(); c++)
+            {
+                if (chunks[c].m_failed)
+                {
+                    debug_print("[IO]: ", "malformed mesh: " + filepath);
+                    return nullptr;
+                }
+
+                position_offsets[c + 1] = position_offsets[c] + chunks[c].m_positions.size();
+                index_offsets[c + 1] = index_offsets[c] + chunks[c].m_indices.size();
+            }
+
+            const size_t vertex_count = position_offsets.back();
+
+            if (vertex_count > std::numeric_limits<uint32_t>::max() || index_offsets.back() / 3 > std::numeric_limits<uint32_t>::max())
+            {
+                debug_print("[IO]: ", "mesh is too large: " + filepath);
+                return nullptr;
+            }
+
+            std::vector<Point> positions;
+            std::vector<uint32_t> indices;
+
+            // a single chunk is moved, not copied
+            if (chunks.size() == 1)
+            {
+                positions = std::move(chunks[0].m_positions);
+                indices = std::move(chunks[0].m_indices);
+            }
+            else
+            {
+                positions.resize(vertex_count);
+                indices.resize(index_offsets.back());
+
+                for_chunks(pool, chunks.size(), [&](const size_t c)
+                           {
+                    std::copy(chunks[c].m_positions.begin(), chunks[c].m_positions.end(), positions.begin() + (ptrdiff_t)position_offsets[c]);
+                    std::copy(chunks[c].m_indices.begin(), chunks[c].m_indices.end(), indices.begin() + (ptrdiff_t)index_offsets[c]);
+
+                    std::vector<Point>().swap(chunks[c].m_positions);
+                    std::vector<uint32_t>().swap(chunks[c].m_indices); });
+            }
+
+            const uint32_t max_index = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end());
+
+            if (!indices.empty() && max_index >= vertex_count)
+            {
+                debug_print("[IO]: ", "mesh refers to a missing vertex: " + filepath);
+                return nullptr;
+            }
+
+            auto mesh = std::make_shared<const MeshData>(std::move(positions), std::move(indices), filepath, pool);
+
+            // only read by debug_print, which is empty outside of debug builds
+            [[maybe_unused]] const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            debug_print("[IO]: ", "Loaded " + filepath + ": " + std::to_string(mesh->get_triangle_count()) + " triangles, " +
+                                      std::to_string(mesh->get_positions().size()) + " vertices in " + std::to_string(ms) + " ms");
+
+            return mesh;
+        }
+    };
+} // namespace COAL
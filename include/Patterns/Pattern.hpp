@@ -16,23 +16,37 @@ namespace COAL
 
     struct Pattern
     {
-        [[nodiscard]] constexpr Pattern(){};
+        [[nodiscard]] Pattern(){};
 
         // init pattern with first and second color
-        [[nodiscard]] constexpr Pattern(Color &first, Color &second)
+        [[nodiscard]] Pattern(Color &first, Color &second)
         {
             m_first_color = first;
             m_second_color = second;
         }
 
         // init pattern with first and second color and transform matrix
-        [[nodiscard]] constexpr Pattern(Color &first, Color &second, COAL::Matrix4 &transform)
+        [[nodiscard]] Pattern(Color &first, Color &second, COAL::Matrix4 &transform)
         {
             m_first_color = first;
             m_second_color = second;
+            set_transform(transform);
+        }
+
+        // set the transform and cache its inverse, shapes using the pattern pick the change up through the revision
+        Pattern &set_transform(const COAL::Matrix4 &transform) noexcept
+        {
             m_transform = transform;
+            m_inverse_transform = transform.inverse();
+            m_revision = next_revision();
+
+            return *this;
         }
 
+        [[nodiscard]] constexpr const COAL::Matrix4 &get_transform() const noexcept { return m_transform; }
+        [[nodiscard]] constexpr const COAL::Matrix4 &get_inverse_transform() const noexcept { return m_inverse_transform; }
+        [[nodiscard]] constexpr uint64_t get_revision() const noexcept { return m_revision; }
+
         [[nodiscard]] virtual COAL::Color color_at(const COAL::Point &p) const = 0;
 
         [[nodiscard]] COAL::Color colot_at(const Shape &s, const COAL::Point &p) const;
@@ -54,9 +68,21 @@ namespace COAL
         // serialize all data to a nlohmann json string object
         [[nodiscard]] virtual std::string to_json() const noexcept = 0;
 
-        COAL::Matrix4 m_transform = COAL::IDENTITY;
         COAL::Color m_first_color = COAL::WHITE;
         COAL::Color m_second_color = COAL::BLACK;
+
+    private:
+        // revisions are unique across all patterns, so a pattern allocated where a freed one lived never matches a shape's cache
+        [[nodiscard]] static uint64_t next_revision() noexcept
+        {
+            static std::atomic<uint64_t> revision = 1;
+            return revision.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // written through set_transform so the inverse and the revision stay in sync
+        COAL::Matrix4 m_transform = COAL::IDENTITY;
+        COAL::Matrix4 m_inverse_transform = COAL::IDENTITY;
+        uint64_t m_revision = next_revision();
     };
 
 } // namespace COAL
@@ -8,11 +8,11 @@ namespace COAL
 {
     struct Ring : public Pattern
     {
-        [[nodiscard]] constexpr Ring() : Pattern() {}
+        [[nodiscard]] Ring() : Pattern() {}
 
-        [[nodiscard]] constexpr Ring(COAL::Color &first, COAL::Color &second) : Pattern(first, second) {}
+        [[nodiscard]] Ring(COAL::Color &first, COAL::Color &second) : Pattern(first, second) {}
 
-        [[nodiscard]] constexpr Ring(COAL::Color &first, COAL::Color &second, COAL::Matrix4 &transform) : Pattern(first, second, transform) {}
+        [[nodiscard]] Ring(COAL::Color &first, COAL::Color &second, COAL::Matrix4 &transform) : Pattern(first, second, transform) {}
 
         [[nodiscard]] COAL::Color color_at(const COAL::Point &p) const override
         {
@@ -35,7 +35,7 @@ namespace COAL
             json["type"] = "Ring";
             json["first_color"] = nlohmann::json::parse(m_first_color.to_json());
             json["second_color"] = nlohmann::json::parse(m_second_color.to_json());
-            json["transform"] = nlohmann::json::parse(m_transform.to_json());
+            json["transform"] = nlohmann::json::parse(get_transform().to_json());
             return json.dump();
         }
 
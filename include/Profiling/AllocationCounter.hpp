@@ -0,0 +1,221 @@
+#pragma once
+
+#include "../Constants.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief Counts heap allocations made through the global operator new
+     *
+     * Replacing operator new affects the whole program, so the counting allocator is opt-in: define COAL_ALLOCATION_COUNTER_IMPLEMENTATION
+     * in exactly one translation unit before including this header (the same way STB_IMAGE_WRITE_IMPLEMENTATION is used). Without it every
+     * count stays at zero and is_enabled() returns false.
+     */
+    struct AllocationCounter
+    {
+        // allocations made by every thread
+        [[nodiscard]] static uint64_t get_count() noexcept
+        {
+            return global().load(std::memory_order_relaxed);
+        }
+
+        // allocations made by the calling thread
+        [[nodiscard]] static uint64_t get_thread_count() noexcept
+        {
+            return local();
+        }
+
+        [[nodiscard]] static bool is_enabled() noexcept
+        {
+            return enabled();
+        }
+
+        static void record() noexcept
+        {
+            global().fetch_add(1, std::memory_order_relaxed);
+            local()++;
+        }
+
+        static std::atomic<uint64_t> &global() noexcept
+        {
+            static std::atomic<uint64_t> count{0};
+            return count;
+        }
+
+        static uint64_t &local() noexcept
+        {
+            thread_local uint64_t count = 0;
+            return count;
+        }
+
+        static bool &enabled() noexcept
+        {
+            static bool is_enabled = false;
+            return is_enabled;
+        }
+    };
+
+    /**
+     * @brief Counts the allocations the calling thread makes while the scope is alive
+     *
+     */
+    struct AllocationScope
+    {
+        [[nodiscard]] AllocationScope() : m_start(AllocationCounter::get_thread_count()) {}
+
+        [[nodiscard]] uint64_t allocations() const noexcept
+        {
+            return AllocationCounter::get_thread_count() - m_start;
+        }
+
+        uint64_t m_start;
+    };
+} // namespace COAL
+
+#ifdef COAL_ALLOCATION_COUNTER_IMPLEMENTATION
+
+static const bool coal_allocation_counter_enabled = (COAL::AllocationCounter::enabled() = true);
+
+// every form of new and delete is replaced, so every pointer is allocated and freed by the same pair of functions below
+namespace COAL::AllocationDetail
+{
+    [[nodiscard]] inline void *allocate(std::size_t size, const std::size_t alignment = 0) noexcept
+    {
+        COAL::AllocationCounter::record();
+
+        if (size == 0)
+            size = 1;
+
+        if (alignment == 0)
+            return std::malloc(size);
+
+#if defined(_WIN32)
+        return _aligned_malloc(size, alignment);
+#else
+        // aligned_alloc wants a multiple of the alignment
+        return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+    }
+
+    inline void deallocate(void *ptr, [[maybe_unused]] const bool aligned = false) noexcept
+    {
+#if defined(_WIN32)
+        if (aligned)
+        {
+            _aligned_free(ptr);
+            return;
+        }
+#endif
+        std::free(ptr);
+    }
+
+    [[nodiscard]] inline void *allocate_or_throw(const std::size_t size, const std::size_t alignment = 0)
+    {
+        if (void *ptr = allocate(size, alignment))
+            return ptr;
+
+        throw std::bad_alloc();
+    }
+} // namespace COAL::AllocationDetail
+
+void *operator new(std::size_t size)
+{
+    return COAL::AllocationDetail::allocate_or_throw(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return COAL::AllocationDetail::allocate_or_throw(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return COAL::AllocationDetail::allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return COAL::AllocationDetail::allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return COAL::AllocationDetail::allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return COAL::AllocationDetail::allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return COAL::AllocationDetail::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return COAL::AllocationDetail::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr, true);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr, true);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr, true);
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr, true);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr, true);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    COAL::AllocationDetail::deallocate(ptr, true);
+}
+
+#endif
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "../Constants.hpp"
+#include "../Tuples/Color.hpp"
+#include "RenderCounters.hpp"
+
+namespace COAL
+{
+    // what a heatmap records per pixel
+    enum class HeatmapMode
+    {
+        None,
+        // nanoseconds spent on the pixel
+        Time,
+        // rays of every kind started for the pixel, needs RENDER_COUNTERS
+        Rays,
+        // shape intersection tests made for the pixel, needs RENDER_COUNTERS
+        Tests
+    };
+
+    [[nodiscard]] constexpr const char *heatmap_mode_name(const HeatmapMode mode) noexcept
+    {
+        switch (mode)
+        {
+        case HeatmapMode::Time:
+            return "time";
+        case HeatmapMode::Rays:
+            return "rays";
+        case HeatmapMode::Tests:
+            return "tests";
+        default:
+            return "none";
+        }
+    }
+
+    [[nodiscard]] inline std::optional<HeatmapMode> heatmap_mode_from_name(const std::string &name) noexcept
+    {
+        for (const HeatmapMode mode : {HeatmapMode::None, HeatmapMode::Time, HeatmapMode::Rays, HeatmapMode::Tests})
+            if (name == heatmap_mode_name(mode))
+                return mode;
+
+        return std::nullopt;
+    }
+
+    // the counter based modes only work when the counters are compiled in
+    [[nodiscard]] constexpr bool is_heatmap_mode_available(const HeatmapMode mode) noexcept
+    {
+        return mode == HeatmapMode::None || mode == HeatmapMode::Time || RenderCounters::is_enabled();
+    }
+
+    /**
+     * @brief Map [0, 1] to the Turbo color map, dark blue over green and yellow to dark red
+     *
+     * Uses the polynomial approximation of the map, values outside of [0, 1] are clamped.
+     */
+    [[nodiscard]] inline Color false_color(const float value) noexcept
+    {
+        const float x = std::clamp(value, 0.0f, 1.0f);
+
+        const float r = 0.13572138f + x * (4.61539260f + x * (-42.66032258f + x * (132.13108234f + x * (-152.94239396f + x * 59.28637943f))));
+        const float g = 0.09140261f + x * (2.19418839f + x * (4.84296658f + x * (-14.18503333f + x * (4.27729857f + x * 2.82956604f))));
+        const float b = 0.10667330f + x * (12.64194608f + x * (-60.58204836f + x * (110.36276771f + x * (-89.90310912f + x * 27.34824973f))));
+
+        return Color::create_SDR(std::clamp(r, 0.0f, 1.0f), std::clamp(g, 0.0f, 1.0f), std::clamp(b, 0.0f, 1.0f));
+    }
+
+    /**
+     * @brief A per-pixel cost buffer recorded next to the beauty render
+     *
+     */
+    struct Heatmap
+    {
+        HeatmapMode m_mode = HeatmapMode::None;
+        int m_width = 0;
+        int m_height = 0;
+        std::shared_ptr<float[]> m_values;
+
+        // (re)allocate the buffer for a render, every value starts at zero
+        void reset(const HeatmapMode mode, const int width, const int height)
+        {
+            m_mode = mode;
+            m_width = width;
+            m_height = height;
+            m_values = mode == HeatmapMode::None ? nullptr : std::shared_ptr<float[]>(new float[static_cast<size_t>(width) * static_cast<size_t>(height)]());
+        }
+
+        [[nodiscard]] bool is_enabled() const noexcept
+        {
+            return m_values != nullptr;
+        }
+
+        [[nodiscard]] float total() const noexcept
+        {
+            double sum = 0;
+            const float *values = m_values.get();
+
+            for (size_t i = 0; i < pixel_count(); i++)
+                sum += static_cast<double>(values[i]);
+
+            return static_cast<float>(sum);
+        }
+
+        /**
+         * @brief The value the color map saturates at
+         *
+         * @param fraction The share of pixels that stay below it, a few very expensive pixels would otherwise turn the rest dark blue
+         */
+        [[nodiscard]] float percentile(const float fraction) const
+        {
+            if (pixel_count() == 0)
+                return 0;
+
+            std::vector<float> sorted(m_values.get(), m_values.get() + pixel_count());
+
+            const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * static_cast<float>(sorted.size() - 1)));
+
+            std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(index), sorted.end());
+
+            return sorted[index];
+        }
+
+        /**
+         * @brief Turn the values into a false color image
+         *
+         * @param saturation_percentile Values at or above this percentile map to the hottest color
+         * @return std::shared_ptr<Color[]> An image that can be passed to save_image
+         */
+        [[nodiscard]] std::shared_ptr<Color[]> to_image(const float saturation_percentile = 0.99f) const
+        {
+            std::shared_ptr<Color[]> image(new Color[pixel_count()]);
+
+            const float saturation = percentile(saturation_percentile);
+            const float scale = saturation > 0 ? 1.0f / saturation : 0.0f;
+
+            Color *colors = image.get();
+            const float *values = m_values.get();
+
+            for (size_t i = 0; i < pixel_count(); i++)
+                colors[i] = false_color(values[i] * scale);
+
+            return image;
+        }
+
+        [[nodiscard]] size_t pixel_count() const noexcept
+        {
+            return m_values ? static_cast<size_t>(m_width) * static_cast<size_t>(m_height) : 0;
+        }
+    };
+} // namespace COAL
@@ -2,6 +2,7 @@
 
 #include "../Constants.hpp"
 #include <filesystem>
+#include <iomanip>
 
 #if PROFILING
 
@@ -31,30 +32,291 @@
 #endif
 
 /**
- * @brief The result of a profiling session
+ * @brief A finished profiling scope, kept compact so recording one is a handful of stores
  *
+ * The name has to outlive the session, PROFILE_FUNCTION and PROFILE_SCOPE only pass string literals.
  */
-struct ProfileResult
+struct ProfileEvent
 {
-    const std::string name;
-    long long start, end;
-    uint32_t threadID;
+    const char *name;
+    // nanoseconds
+    long long start;
+    long long end;
 };
 
 /**
- * @brief A simple timer class that can be used to measure the time it takes to execute a function or a block of code.
+ * @brief How a session handles the finished scopes
+ *
+ */
+enum class ProfileMode
+{
+    // every scope becomes an event of the Perfetto trace
+    Trace,
+    // scopes are only summed up per name, the session ends with a hot-spot table instead of a trace
+    Aggregate
+};
+
+/**
+ * @brief Call count, duration bounds and a latency histogram of one scope
+ *
+ * Durations are inclusive, a scope's time contains the time of the scopes nested in it.
+ */
+struct ScopeStatistics
+{
+    // bucket i holds the durations in [2^i, 2^(i+1)) nanoseconds
+    static constexpr size_t kBuckets = 40;
+
+    uint64_t count = 0;
+    long long total = 0;
+    long long min = std::numeric_limits<long long>::max();
+    long long max = 0;
+    std::array<uint64_t, kBuckets> histogram{};
+
+    void add(const long long duration) noexcept
+    {
+        count++;
+        total += duration;
+        min = std::min(min, duration);
+        max = std::max(max, duration);
+
+        size_t bucket = 0;
+
+        for (long long d = duration; d > 1 && bucket < kBuckets - 1; d >>= 1)
+            bucket++;
+
+        histogram[bucket]++;
+    }
+
+    void merge(const ScopeStatistics &other) noexcept
+    {
+        count += other.count;
+        total += other.total;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+
+        for (size_t i = 0; i < kBuckets; i++)
+            histogram[i] += other.histogram[i];
+    }
+
+    double mean() const noexcept
+    {
+        return count ? static_cast<double>(total) / static_cast<double>(count) : 0;
+    }
+
+    /**
+     * @brief Estimate a percentile from the histogram
+     *
+     * @param fraction 0.5 for the median, 0.99 for the 99th percentile
+     * @return long long The upper bound of the bucket the percentile falls into, clamped to the measured maximum
+     */
+    long long percentile(const double fraction) const noexcept
+    {
+        const uint64_t target = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count)));
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < kBuckets; i++)
+        {
+            seen += histogram[i];
+
+            if (seen >= target && seen > 0)
+                return std::min(max, (2ll << i) - 1);
+        }
+
+        return max;
+    }
+};
+
+/**
+ * @brief The merged statistics of one scope name over every thread
+ *
+ */
+struct ScopeSummary
+{
+    std::string name;
+    ScopeStatistics statistics;
+};
+
+/**
+ * @brief Per-thread table of scope statistics, keyed by the name literal
+ *
+ * Only the owning thread writes, the lock is uncontended except for the merge at the end of a session.
+ */
+class ThreadScopeTable
+{
+public:
+    void add(const ProfileEvent &event)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_scopes[event.name].add(event.end - event.start);
+    }
+
+    template <typename Callback>
+    void forEach(Callback &&callback)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        for (const auto &[name, statistics] : m_scopes)
+            callback(name, statistics);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_scopes.clear();
+    }
+
+private:
+    std::mutex m_lock;
+    std::unordered_map<const char *, ScopeStatistics> m_scopes;
+};
+
+/**
+ * @brief A fixed size single-producer single-consumer ring of events
+ *
+ * The owning thread pushes, the Instrumentor's flusher pops. Nothing is allocated or locked after construction, when the ring is full
+ * the event is dropped and counted instead.
+ */
+class ThreadTraceBuffer
+{
+public:
+    static constexpr size_t kCapacity = 1 << 16;
+
+    explicit ThreadTraceBuffer(const uint32_t threadID) : m_threadID(threadID), m_events(new ProfileEvent[kCapacity]) {}
+
+    /**
+     * @brief Called by the owning thread
+     *
+     * @return false if the ring was full and the event was dropped
+     */
+    bool push(const ProfileEvent &event) noexcept
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head - m_tail.load(std::memory_order_acquire) >= kCapacity)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_events[head & (kCapacity - 1)] = event;
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * @brief Called by the flusher, hands every pending event to the callback
+     *
+     * @return size_t The number of events drained
+     */
+    template <typename Callback>
+    size_t drain(Callback &&callback)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t head = m_head.load(std::memory_order_acquire);
+
+        for (size_t i = tail; i != head; i++)
+            callback(m_events[i & (kCapacity - 1)]);
+
+        m_tail.store(head, std::memory_order_release);
+
+        return head - tail;
+    }
+
+    // events waiting for the flusher, only exact when called by the owning thread
+    size_t pending() const noexcept
+    {
+        return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire);
+    }
+
+    // called once the owning thread exited, nothing is pushed after this
+    void retire() noexcept
+    {
+        m_retired.store(true, std::memory_order_release);
+    }
+
+    // true once the owning thread exited and the flusher drained everything it pushed
+    bool isFinished() const noexcept
+    {
+        return m_retired.load(std::memory_order_acquire) && m_tail.load(std::memory_order_relaxed) == m_head.load(std::memory_order_acquire);
+    }
+
+    // events lost since the last call, resets the counter
+    uint64_t takeDropped() noexcept
+    {
+        return m_dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    uint32_t getThreadID() const noexcept
+    {
+        return m_threadID;
+    }
+
+private:
+    const uint32_t m_threadID;
+    std::unique_ptr<ProfileEvent[]> m_events;
+
+    // producer and consumer indices live on their own cache lines
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+    alignas(64) std::atomic<uint64_t> m_dropped{0};
+    std::atomic<bool> m_retired{false};
+};
+
+/**
+ * @brief A thread's hold on its ThreadTraceBuffer, retires the buffer when the thread exits
+ *
+ */
+struct ThreadTraceLease
+{
+    std::shared_ptr<ThreadTraceBuffer> buffer;
+
+    ~ThreadTraceLease()
+    {
+        if (buffer)
+            buffer->retire();
+    }
+};
+
+/**
+ * @brief Collects profiling scopes from every thread into a Perfetto (chrome trace) JSON file
+ *
+ * Each thread records into its own ThreadTraceBuffer. A background thread drains the buffers and formats the JSON while the session runs,
+ * so recording a scope never takes a lock or touches the file. Events that did not fit into a full buffer are counted and reported in
+ * the trace's metadata.
  */
 class Instrumentor
 {
     std::string m_sessionName;
+    std::string m_filepath;
     std::ofstream m_outputStream;
+    std::atomic<ProfileMode> m_mode = ProfileMode::Trace;
     int m_profileCount = 0;
-    std::mutex m_lock;
-    bool m_activeSession = false;
+    long long m_sessionStart = 0;
+    uint64_t m_droppedCount = 0;
+    std::atomic<bool> m_activeSession = false;
+
+    // the buffers of running threads, and of exited ones until their last events were flushed
+    std::mutex m_buffersLock;
+    std::vector<std::shared_ptr<ThreadTraceBuffer>> m_buffers;
+    uint32_t m_nextThreadID = 0;
+    std::vector<std::shared_ptr<ThreadScopeTable>> m_tables;
+
+    // hot spots of the last aggregating session
+    std::vector<ScopeSummary> m_summaries;
+
+    std::thread m_flusher;
+    std::mutex m_flushLock;
+    std::condition_variable m_flushWake;
+    bool m_stopFlusher = false;
+    std::atomic<bool> m_flushRequested = false;
 
     Instrumentor() {}
 
 public:
+    // how often the background thread drains the buffers
+    static constexpr std::chrono::milliseconds kFlushInterval{10};
+
     /**
      * @brief Get the singleton instance of the Instrumentor
      *
@@ -76,86 +338,365 @@ public:
      *
      * @param name The name of the session
      * @param filepath The filepath to write the results to
+     * @param mode Trace writes perfetto_trace.json, Aggregate writes profile_statistics.json and prints the hot spots
      */
-    void beginSession(const std::string &name, const std::string &filepath = std::filesystem::current_path().string() + "/profiling")
+    void beginSession(const std::string &name, const std::string &filepath = std::filesystem::current_path().string() + "/profiling",
+                      const ProfileMode mode = ProfileMode::Trace)
     {
         if (m_activeSession)
         {
             endSession();
         }
-        m_activeSession = true;
+
         std::filesystem::create_directories(filepath);
-        m_outputStream.open(filepath + "/perfetto_trace.json");
-        writeHeader();
         m_sessionName = name;
+        m_filepath = filepath;
+        m_mode = mode;
+        m_droppedCount = 0;
+        m_sessionStart = std::chrono::time_point_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now()).time_since_epoch().count();
+
+        // events recorded between sessions are stale
+        drainAll(false);
+        clearTables();
+
+        if (mode == ProfileMode::Trace)
+        {
+            m_outputStream.open(filepath + "/perfetto_trace.json");
+            writeHeader();
+
+            m_stopFlusher = false;
+            m_flusher = std::thread([this]()
+                                    { flushLoop(); });
+        }
+
+        m_activeSession.store(true, std::memory_order_release);
     }
 
     /**
-     * @brief End the current profiling session
+     * @brief End the current profiling session, flushing every recorded event
      *
      */
     void endSession()
     {
-        if (!m_activeSession)
+        if (!m_activeSession.exchange(false))
+        {
+            return;
+        }
+
+        if (m_mode == ProfileMode::Aggregate)
         {
+            mergeTables();
+            writeStatistics();
+            printHotSpots(std::cerr);
             return;
         }
-        m_activeSession = false;
+
+        {
+            std::lock_guard<std::mutex> lock(m_flushLock);
+            m_stopFlusher = true;
+        }
+
+        m_flushWake.notify_all();
+
+        if (m_flusher.joinable())
+            m_flusher.join();
+
+        drainAll(true);
+
         writeFooter();
         m_outputStream.close();
         m_profileCount = 0;
     }
 
+    bool isActive() const noexcept
+    {
+        return m_activeSession.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief The scopes of the last aggregating session, sorted by total time
+     *
+     * @return const std::vector<ScopeSummary>&
+     */
+    const std::vector<ScopeSummary> &getHotSpots() const noexcept
+    {
+        return m_summaries;
+    }
+
+    /**
+     * @brief Print the hot spots as a table
+     *
+     * @param stream
+     * @param limit The number of scopes to print
+     */
+    void printHotSpots(std::ostream &stream, const size_t limit = 25) const
+    {
+        stream << "Hot spots of \"" << m_sessionName << "\" (inclusive times)\n";
+        stream << std::right << std::setw(12) << "calls" << std::setw(12) << "total ms" << std::setw(12) << "mean ns" << std::setw(12)
+               << "min ns" << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns" << std::setw(14) << "max ns"
+               << "  scope\n";
+
+        const auto flags = stream.flags();
+        const auto precision = stream.precision();
+
+        for (size_t i = 0; i < std::min(limit, m_summaries.size()); i++)
+        {
+            const ScopeStatistics &statistics = m_summaries[i].statistics;
+
+            stream << std::setw(12) << statistics.count << std::fixed << std::setprecision(2) << std::setw(12) << static_cast<double>(statistics.total) / 1e6
+                   << std::setprecision(0) << std::setw(12) << statistics.mean() << std::setw(12) << statistics.min << std::setw(12)
+                   << statistics.percentile(0.5) << std::setw(12) << statistics.percentile(0.99) << std::setw(14) << statistics.max
+                   << "  " << m_summaries[i].name << "\n";
+        }
+
+        stream.flags(flags);
+        stream.precision(precision);
+    }
+
+    // events lost to full buffers in the current (or last) session
+    uint64_t getDroppedCount() const noexcept
+    {
+        return m_droppedCount;
+    }
+
+    /**
+     * @brief Record a finished scope into the calling thread's buffer
+     *
+     * @param event
+     */
+    void record(const ProfileEvent &event)
+    {
+        if (!isActive())
+            return;
+
+        if (m_mode.load(std::memory_order_relaxed) == ProfileMode::Aggregate)
+        {
+            threadTable().add(event);
+            return;
+        }
+
+        ThreadTraceBuffer &buffer = threadBuffer();
+
+        // wake the flusher early instead of waiting out the interval when a buffer is filling up fast
+        if (buffer.push(event) && buffer.pending() == ThreadTraceBuffer::kCapacity / 2)
+        {
+            m_flushRequested.store(true, std::memory_order_relaxed);
+            m_flushWake.notify_one();
+        }
+    }
+
+private:
+    ThreadTraceBuffer &threadBuffer()
+    {
+        thread_local ThreadTraceLease lease{registerThread()};
+        return *lease.buffer;
+    }
+
+    std::shared_ptr<ThreadTraceBuffer> registerThread()
+    {
+        std::lock_guard<std::mutex> lock(m_buffersLock);
+
+        m_buffers.emplace_back(std::make_shared<ThreadTraceBuffer>(m_nextThreadID++));
+
+        return m_buffers.back();
+    }
+
+    ThreadScopeTable &threadTable()
+    {
+        thread_local std::shared_ptr<ThreadScopeTable> table = registerTable();
+        return *table;
+    }
+
+    std::shared_ptr<ThreadScopeTable> registerTable()
+    {
+        std::lock_guard<std::mutex> lock(m_buffersLock);
+
+        m_tables.emplace_back(std::make_shared<ThreadScopeTable>());
+
+        return m_tables.back();
+    }
+
+    void clearTables()
+    {
+        std::lock_guard<std::mutex> lock(m_buffersLock);
+
+        for (const auto &table : m_tables)
+            table->clear();
+
+        m_summaries.clear();
+    }
+
+    // merge the tables of every thread by name, the same function can have a different literal in every translation unit
+    void mergeTables()
+    {
+        std::unordered_map<std::string, ScopeStatistics> merged;
+
+        {
+            std::lock_guard<std::mutex> lock(m_buffersLock);
+
+            for (const auto &table : m_tables)
+                table->forEach([&](const char *name, const ScopeStatistics &statistics)
+                               { merged[name].merge(statistics); });
+        }
+
+        m_summaries.clear();
+
+        for (auto &[name, statistics] : merged)
+            m_summaries.emplace_back(ScopeSummary{name, statistics});
+
+        std::sort(m_summaries.begin(), m_summaries.end(), [](const ScopeSummary &a, const ScopeSummary &b)
+                  { return a.statistics.total > b.statistics.total; });
+    }
+
+    void writeStatistics()
+    {
+        std::ofstream stream(m_filepath + "/profile_statistics.json");
+
+        stream << "{\"session\":\"" << m_sessionName << "\",\"histogram\":\"log2 nanoseconds\",\"scopes\":[";
+
+        for (size_t i = 0; i < m_summaries.size(); i++)
+        {
+            const ScopeStatistics &statistics = m_summaries[i].statistics;
+
+            stream << (i ? "," : "") << "{\"name\":\"";
+            writeEscaped(stream, m_summaries[i].name.c_str());
+            stream << "\",\"count\":" << statistics.count << ",\"total_ns\":" << statistics.total << ",\"min_ns\":" << statistics.min
+                   << ",\"max_ns\":" << statistics.max << ",\"p50_ns\":" << statistics.percentile(0.5) << ",\"p99_ns\":"
+                   << statistics.percentile(0.99) << ",\"histogram\":[";
+
+            // trailing empty buckets carry no information
+            size_t used = ScopeStatistics::kBuckets;
+
+            while (used > 0 && statistics.histogram[used - 1] == 0)
+                used--;
+
+            for (size_t b = 0; b < used; b++)
+                stream << (b ? "," : "") << statistics.histogram[b];
+
+            stream << "]}";
+        }
+
+        stream << "]}";
+    }
+
+    // quotes would end the JSON string early
+    static void writeEscaped(std::ostream &stream, const char *text)
+    {
+        for (const char *c = text; *c; c++)
+            stream << (*c == '"' ? '\'' : *c);
+    }
+
+    void flushLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_flushLock);
+
+        while (!m_stopFlusher)
+        {
+            m_flushWake.wait_for(lock, kFlushInterval, [this]()
+                                 { return m_stopFlusher || m_flushRequested.load(std::memory_order_relaxed); });
+
+            m_flushRequested.store(false, std::memory_order_relaxed);
+
+            lock.unlock();
+            drainAll(true);
+            lock.lock();
+        }
+    }
+
+    // only ever called by one thread at a time: the flusher, or the session owner while no flusher runs
+    void drainAll(const bool write)
+    {
+        std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+
+        {
+            std::lock_guard<std::mutex> lock(m_buffersLock);
+            buffers = m_buffers;
+        }
+
+        for (const auto &buffer : buffers)
+        {
+            const uint32_t threadID = buffer->getThreadID();
+
+            if (write)
+            {
+                buffer->drain([&](const ProfileEvent &event)
+                              { writeProfile(event, threadID); });
+
+                m_droppedCount += buffer->takeDropped();
+            }
+            else
+            {
+                buffer->drain([](const ProfileEvent &) {});
+                buffer->takeDropped();
+            }
+        }
+
+        // the rings of exited threads are freed once drained, otherwise every recreated thread pool would add another one
+        std::lock_guard<std::mutex> lock(m_buffersLock);
+
+        std::erase_if(m_buffers, [](const std::shared_ptr<ThreadTraceBuffer> &buffer)
+                      { return buffer->isFinished(); });
+    }
+
     /**
      * @brief Write a profiling result to the output stream
      *
      * @param result
      */
-    void writeProfile(const ProfileResult &result)
+    void writeProfile(const ProfileEvent &result, const uint32_t threadID)
     {
-        std::lock_guard<std::mutex> lock(m_lock);
-
         if (m_profileCount++ > 0)
         {
             m_outputStream << ",";
         }
 
-        std::string name = result.name;
-        std::replace(name.begin(), name.end(), '"', '\'');
-
         m_outputStream << "{";
         m_outputStream << "\"cat\":\"function\",";
-        m_outputStream << "\"dur\":" << (result.end - result.start) << ',';
-        m_outputStream << "\"name\":\"" << name << "\",";
+        m_outputStream << "\"dur\":";
+        writeMicroseconds(m_outputStream, result.end - result.start);
+        m_outputStream << ',';
+        m_outputStream << "\"name\":\"";
+        writeEscaped(m_outputStream, result.name);
+        m_outputStream << "\",";
         m_outputStream << "\"ph\":\"X\",";
         m_outputStream << "\"pid\":0,";
-        m_outputStream << "\"tid\":" << result.threadID << ",";
-        m_outputStream << "\"ts\":" << result.start;
+        m_outputStream << "\"tid\":" << threadID << ",";
+        m_outputStream << "\"ts\":";
+        writeMicroseconds(m_outputStream, std::max(0ll, result.start - m_sessionStart));
         m_outputStream << "}";
     }
 
+    // the trace format counts in microseconds, the fraction keeps the nanoseconds (timestamps are relative to the session start to fit a double)
+    static void writeMicroseconds(std::ostream &stream, const long long nanoseconds)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%lld.%03lld", nanoseconds / 1000, nanoseconds % 1000);
+        stream << text;
+    }
+
     /**
      * @brief Write the header of the profiling session to the output stream
      *
      */
     void writeHeader()
     {
-        m_outputStream << "{\"otherData\": {},\"traceEvents\":[";
+        m_outputStream << "{\"traceEvents\":[";
     }
 
     /**
-     * @brief Write the footer of the profiling session to the output stream
+     * @brief Write the footer of the profiling session to the output stream, the metadata is only known once every event was flushed
      *
      */
     void writeFooter()
     {
-        m_outputStream << "]}";
+        m_outputStream << "],\"otherData\": {\"session\":\"" << m_sessionName << "\",\"events\":" << m_profileCount
+                       << ",\"dropped_events\":" << m_droppedCount << "}}";
     }
 };
 
 class InstrumentationTimer
 {
-    ProfileResult m_result;
+    const char *m_name;
 
     /**
      * @brief Variable to store the start time of the timer
@@ -168,10 +709,10 @@ public:
     /**
      * @brief Construct a new Instrumentation Timer object
      *
-     * @param name The name of the timer
+     * @param name The name of the timer, has to outlive the session (a string literal)
      */
-    InstrumentationTimer(const std::string &name)
-        : m_result({name, 0, 0, 0}), m_stopped(false)
+    InstrumentationTimer(const char *name)
+        : m_name(name), m_stopped(false)
     {
         m_startTimepoint = std::chrono::high_resolution_clock::now();
     }
@@ -185,18 +726,20 @@ public:
     }
 
     /**
-     * @brief Stop the timer and write the result to the output stream
+     * @brief Stop the timer and record the result into the thread's trace buffer or statistics table
      *
      */
     void stop()
     {
         auto endTimepoint = std::chrono::high_resolution_clock::now();
 
-        m_result.start = std::chrono::time_point_cast<std::chrono::microseconds>(m_startTimepoint).time_since_epoch().count();
-        m_result.end = std::chrono::time_point_cast<std::chrono::microseconds>(endTimepoint).time_since_epoch().count();
-        m_result.threadID = static_cast<unsigned int>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
-        Instrumentor::Get().writeProfile(m_result);
+        ProfileEvent event;
+        event.name = m_name;
+        event.start = std::chrono::time_point_cast<std::chrono::nanoseconds>(m_startTimepoint).time_since_epoch().count();
+        event.end = std::chrono::time_point_cast<std::chrono::nanoseconds>(endTimepoint).time_since_epoch().count();
+
+        Instrumentor::Get().record(event);
 
         m_stopped = true;
     }
-};
\ No newline at end of file
+};
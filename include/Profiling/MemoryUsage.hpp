@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Constants.hpp"
+
+#if defined(_WIN32)
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+namespace COAL
+{
+    /**
+     * @brief The largest resident set size the process reached so far
+     *
+     * @return size_t The size in bytes, 0 where the platform does not report it
+     */
+    [[nodiscard]] inline size_t get_peak_rss()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return (size_t)counters.PeakWorkingSetSize;
+
+        return 0;
+#else
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+
+#if defined(__APPLE__)
+        return (size_t)usage.ru_maxrss;
+#else
+        // Linux reports kilobytes
+        return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+} // namespace COAL
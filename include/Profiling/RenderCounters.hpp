@@ -0,0 +1,208 @@
+#pragma once
+
+#include "../Constants.hpp"
+#include "../Shapes/Shape.hpp"
+
+#if RENDER_COUNTERS
+#define COUNT_RAY(kind, depth) COAL::RenderCounters::local().count_ray(kind, depth)
+#define COUNT_RAY_RESULT(hit) COAL::RenderCounters::local().count_ray_result(hit)
+#define COUNT_SHADOW_RESULT(occluded) COAL::RenderCounters::local().count_shadow_result(occluded)
+#define COUNT_SHAPE_TEST(shape, hit) COAL::RenderCounters::local().count_shape_test((shape).get_type(), hit)
+#define COUNT_SHAPE_PACKET_TEST(shape, mask, hits) COAL::RenderCounters::local().count_shape_tests((shape).get_type(), mask, hits)
+#define COUNT_SHAPE_GROUP_TEST(type, mask, hits) COAL::RenderCounters::local().count_shape_tests(type, mask, hits)
+#define COUNT_BVH_NODE() COAL::RenderCounters::local().m_bvh_nodes_visited++
+#define COUNT_MAX_DEPTH() COAL::RenderCounters::local().m_max_depth_terminations++
+#else
+#define COUNT_RAY(kind, depth) ((void)0)
+#define COUNT_RAY_RESULT(hit) ((void)0)
+#define COUNT_SHADOW_RESULT(occluded) ((void)0)
+#define COUNT_SHAPE_TEST(shape, hit) ((void)0)
+#define COUNT_SHAPE_PACKET_TEST(shape, mask, hits) ((void)0)
+#define COUNT_SHAPE_GROUP_TEST(type, mask, hits) ((void)0)
+#define COUNT_BVH_NODE() ((void)0)
+#define COUNT_MAX_DEPTH() ((void)0)
+#endif
+
+namespace COAL
+{
+    enum class RayKind
+    {
+        Primary,
+        Shadow,
+        Reflection,
+        Refraction,
+        Count
+    };
+
+    [[nodiscard]] constexpr const char *ray_kind_name(const RayKind kind) noexcept
+    {
+        constexpr const char *names[] = {"primary", "shadow", "reflection", "refraction"};
+
+        return kind < RayKind::Count ? names[(int)kind] : "unknown";
+    }
+
+    /**
+     * @brief What a render traced: rays by kind and depth, shape tests by type, hits and misses
+     *
+     * Every thread counts into its own instance (local()), the camera merges the workers' counters once the frame is done. The counting
+     * macros (COUNT_RAY, COUNT_SHAPE_TEST, ...) compile to nothing unless RENDER_COUNTERS is set, without it every count stays zero.
+     */
+    struct RenderCounters
+    {
+        // rays deeper than this are counted in the last depth bucket
+        static constexpr int kMaxTrackedDepth = 16;
+
+        static constexpr size_t kRayKinds = (size_t)RayKind::Count;
+        static constexpr size_t kShapeTypes = (size_t)ShapeType::Count;
+
+        std::array<uint64_t, kRayKinds> m_rays{};
+        std::array<uint64_t, kMaxTrackedDepth> m_rays_by_depth{};
+        std::array<uint64_t, kShapeTypes> m_shape_tests{};
+        std::array<uint64_t, kShapeTypes> m_shape_hits{};
+
+        // closest hit queries (primary, reflection and refraction rays) that hit or missed everything
+        uint64_t m_ray_hits = 0;
+        uint64_t m_ray_misses = 0;
+
+        // shadow rays that found a blocker
+        uint64_t m_shadow_occluded = 0;
+
+        uint64_t m_bvh_nodes_visited = 0;
+
+        // reflections and refractions cut off by the world's max depth
+        uint64_t m_max_depth_terminations = 0;
+
+        [[nodiscard]] static constexpr bool is_enabled() noexcept
+        {
+            return RENDER_COUNTERS;
+        }
+
+        // the calling thread's counters
+        [[nodiscard]] static RenderCounters &local() noexcept
+        {
+            thread_local RenderCounters counters;
+            return counters;
+        }
+
+        void count_ray(const RayKind kind, const int depth) noexcept
+        {
+            m_rays[(size_t)kind]++;
+            m_rays_by_depth[(size_t)std::clamp(depth, 0, kMaxTrackedDepth - 1)]++;
+        }
+
+        void count_ray_result(const bool hit) noexcept
+        {
+            m_ray_hits += hit ? 1 : 0;
+            m_ray_misses += hit ? 0 : 1;
+        }
+
+        void count_shadow_result(const bool occluded) noexcept
+        {
+            m_shadow_occluded += occluded ? 1 : 0;
+        }
+
+        void count_shape_test(const ShapeType type, const bool hit) noexcept
+        {
+            m_shape_tests[(size_t)type]++;
+            m_shape_hits[(size_t)type] += hit ? 1 : 0;
+        }
+
+        // a packet or shape group test counts once per lane
+        void count_shape_tests(const ShapeType type, const uint32_t mask, const uint32_t hits) noexcept
+        {
+            m_shape_tests[(size_t)type] += (uint64_t)std::popcount(mask);
+            m_shape_hits[(size_t)type] += (uint64_t)std::popcount(hits & mask);
+        }
+
+        void reset() noexcept
+        {
+            *this = RenderCounters();
+        }
+
+        RenderCounters &operator+=(const RenderCounters &other) noexcept
+        {
+            for (size_t i = 0; i < kRayKinds; i++)
+                m_rays[i] += other.m_rays[i];
+
+            for (size_t i = 0; i < (size_t)kMaxTrackedDepth; i++)
+                m_rays_by_depth[i] += other.m_rays_by_depth[i];
+
+            for (size_t i = 0; i < kShapeTypes; i++)
+            {
+                m_shape_tests[i] += other.m_shape_tests[i];
+                m_shape_hits[i] += other.m_shape_hits[i];
+            }
+
+            m_ray_hits += other.m_ray_hits;
+            m_ray_misses += other.m_ray_misses;
+            m_shadow_occluded += other.m_shadow_occluded;
+            m_bvh_nodes_visited += other.m_bvh_nodes_visited;
+            m_max_depth_terminations += other.m_max_depth_terminations;
+
+            return *this;
+        }
+
+        [[nodiscard]] uint64_t total_rays() const noexcept
+        {
+            uint64_t total = 0;
+
+            for (const uint64_t count : m_rays)
+                total += count;
+
+            return total;
+        }
+
+        [[nodiscard]] uint64_t total_shape_tests() const noexcept
+        {
+            uint64_t total = 0;
+
+            for (const uint64_t count : m_shape_tests)
+                total += count;
+
+            return total;
+        }
+
+        [[nodiscard]] uint64_t total_shape_hits() const noexcept
+        {
+            uint64_t total = 0;
+
+            for (const uint64_t count : m_shape_hits)
+                total += count;
+
+            return total;
+        }
+
+        [[nodiscard]] nlohmann::json to_json() const
+        {
+            nlohmann::json json;
+
+            json["enabled"] = is_enabled();
+            json["rays"] = total_rays();
+
+            for (size_t i = 0; i < kRayKinds; i++)
+                json["rays_by_kind"][ray_kind_name((RayKind)i)] = m_rays[i];
+
+            // trailing empty depths carry no information
+            size_t depths = (size_t)kMaxTrackedDepth;
+
+            while (depths > 1 && m_rays_by_depth[depths - 1] == 0)
+                depths--;
+
+            json["rays_by_depth"] = std::vector<uint64_t>(m_rays_by_depth.begin(), m_rays_by_depth.begin() + (std::ptrdiff_t)depths);
+
+            json["shape_tests"] = total_shape_tests();
+            json["shape_hits"] = total_shape_hits();
+
+            for (size_t i = 0; i < kShapeTypes; i++)
+                json["shape_tests_by_type"][shape_type_name((ShapeType)i)] = {{"tests", m_shape_tests[i]}, {"hits", m_shape_hits[i]}};
+
+            json["ray_hits"] = m_ray_hits;
+            json["ray_misses"] = m_ray_misses;
+            json["shadow_occluded"] = m_shadow_occluded;
+            json["bvh_nodes_visited"] = m_bvh_nodes_visited;
+            json["max_depth_terminations"] = m_max_depth_terminations;
+
+            return json;
+        }
+    };
+} // namespace COAL
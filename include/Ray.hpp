@@ -5,12 +5,31 @@
 
 namespace COAL
 {
+    /**
+     * @brief A ray with the range (m_t_min, m_t_max) its hits have to lie in
+     *
+     * The inverse direction and the direction's sign bits are computed once here instead of in every box and slab test. The signs are
+     * the sign bits of the inverse, so a -0 component counts as negative like its -infinity reciprocal.
+     */
     struct Ray
     {
     public:
-        [[nodiscard]] constexpr Ray(const Point &origin, const Vector &direction)
-            : m_origin(origin), m_direction(direction)
+        [[nodiscard]] Ray(const Point &origin, const Vector &direction, const float t_min = 0, const float t_max = std::numeric_limits<float>::infinity())
+            : m_origin(origin), m_direction(direction), m_t_min(t_min), m_t_max(t_max)
         {
+#if COAL_SSE
+            // one division for the three reciprocals, every ray pays for it
+            const __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_setr_ps(direction.x, direction.y, direction.z, 1.0f));
+
+            float res[4];
+            _mm_storeu_ps(res, inverse);
+
+            m_inverse_direction = Vector(res[0], res[1], res[2]);
+            m_octant = (uint32_t)_mm_movemask_ps(inverse) & 7u;
+#else
+            m_inverse_direction = Vector(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+            m_octant = (std::signbit(m_inverse_direction.x) ? 1u : 0u) | (std::signbit(m_inverse_direction.y) ? 2u : 0u) | (std::signbit(m_inverse_direction.z) ? 4u : 0u);
+#endif
         }
 
         [[nodiscard]] Point position(const float t) const
@@ -20,25 +39,46 @@ namespace COAL
             return m_origin + m_direction * t;
         }
 
+        // the direction is not normalized again, so the range carries over unchanged
         [[nodiscard]] Ray transform(const Matrix4 &matrix) const
         {
             PROFILE_FUNCTION();
 
-            Point new_origin = matrix * m_origin;
-            Vector new_direction = matrix * m_direction;
+            Point new_origin;
+            Vector new_direction;
+
+            matrix.transform(m_origin, m_direction, new_origin, new_direction);
+
+            return Ray(new_origin, new_direction, m_t_min, m_t_max);
+        }
 
-            return Ray(new_origin, new_direction);
+        // true if the direction points toward negative values along axis 0 (x), 1 (y) or 2 (z)
+        [[nodiscard]] bool is_negative(const int axis) const noexcept
+        {
+            return (m_octant >> axis) & 1u;
+        }
+
+        // true if t lies inside (m_t_min, m_t_max)
+        [[nodiscard]] bool in_range(const float t) const noexcept
+        {
+            return t > m_t_min && t < m_t_max;
         }
 
         // << operator
         friend std::ostream &operator<<(std::ostream &os, const Ray &r)
         {
 
-            os << "Ray(origin=" << r.m_origin << ", direction=" << r.m_direction << ")";
+            os << "Ray(origin=" << r.m_origin << ", direction=" << r.m_direction << ", t=(" << r.m_t_min << ", " << r.m_t_max << "))";
             return os;
         }
 
         Point m_origin;
         Vector m_direction;
+        Vector m_inverse_direction;
+        float m_t_min;
+        float m_t_max;
+        // the sign bits of the direction, bit i is set if axis i points toward negative values. One word instead of a bool per axis,
+        // separate byte stores stall the copies of freshly built rays
+        uint32_t m_octant;
     };
 } // namespace COAL
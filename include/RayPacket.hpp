@@ -0,0 +1,318 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Matrix.hpp"
+#include "Ray.hpp"
+
+namespace COAL
+{
+    struct Shape;
+
+    // a packet covers a 4x2 pixel block with AVX and a 2x2 block otherwise, one register per packet
+#if COAL_AVX
+    inline constexpr int kPacketSize = 8;
+    inline constexpr int kPacketWidth = 4;
+#else
+    inline constexpr int kPacketSize = 4;
+    inline constexpr int kPacketWidth = 2;
+#endif
+
+    inline constexpr int kPacketHeight = kPacketSize / kPacketWidth;
+
+    // every lane of a packet
+    inline constexpr uint32_t kPacketMask = (1u << kPacketSize) - 1;
+
+    // packets that diverged down to this many active lanes test their shapes with the scalar kernels
+    inline constexpr int kPacketScalarLanes = kPacketSize / 4;
+
+    /**
+     * @brief The lanes of a packet, one float per ray
+     *
+     * Comparisons return masks (all bits set in lanes where they hold) and, like the scalar operators, are false for NaN. min and max
+     * follow std::min and std::max exactly so the packet kernels produce the same floats as the scalar ones.
+     */
+    struct PacketFloat
+    {
+#if COAL_AVX
+        __m256 m_v;
+
+        [[nodiscard]] static PacketFloat load(const float *p) noexcept { return {_mm256_load_ps(p)}; }
+        [[nodiscard]] static PacketFloat broadcast(const float f) noexcept { return {_mm256_set1_ps(f)}; }
+        void store(float *p) const noexcept { _mm256_store_ps(p, m_v); }
+
+        [[nodiscard]] PacketFloat operator+(const PacketFloat &o) const noexcept { return {_mm256_add_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator-(const PacketFloat &o) const noexcept { return {_mm256_sub_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator*(const PacketFloat &o) const noexcept { return {_mm256_mul_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator/(const PacketFloat &o) const noexcept { return {_mm256_div_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator-() const noexcept { return {_mm256_xor_ps(m_v, _mm256_set1_ps(-0.0f))}; }
+
+        [[nodiscard]] PacketFloat operator<(const PacketFloat &o) const noexcept { return {_mm256_cmp_ps(m_v, o.m_v, _CMP_LT_OQ)}; }
+        [[nodiscard]] PacketFloat operator>(const PacketFloat &o) const noexcept { return {_mm256_cmp_ps(m_v, o.m_v, _CMP_GT_OQ)}; }
+        [[nodiscard]] PacketFloat operator<=(const PacketFloat &o) const noexcept { return {_mm256_cmp_ps(m_v, o.m_v, _CMP_LE_OQ)}; }
+        [[nodiscard]] PacketFloat operator>=(const PacketFloat &o) const noexcept { return {_mm256_cmp_ps(m_v, o.m_v, _CMP_GE_OQ)}; }
+        [[nodiscard]] PacketFloat operator&(const PacketFloat &o) const noexcept { return {_mm256_and_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator|(const PacketFloat &o) const noexcept { return {_mm256_or_ps(m_v, o.m_v)}; }
+
+        [[nodiscard]] PacketFloat sqrt() const noexcept { return {_mm256_sqrt_ps(m_v)}; }
+        [[nodiscard]] PacketFloat abs() const noexcept { return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), m_v)}; }
+
+        // mask ? a : b
+        [[nodiscard]] static PacketFloat select(const PacketFloat &mask, const PacketFloat &a, const PacketFloat &b) noexcept
+        {
+            return {_mm256_blendv_ps(b.m_v, a.m_v, mask.m_v)};
+        }
+
+        // minps(x, y) is x < y ? x : y, so swapping the operands gives std::min(a, b) = b < a ? b : a in one instruction
+        [[nodiscard]] static PacketFloat min(const PacketFloat &a, const PacketFloat &b) noexcept { return {_mm256_min_ps(b.m_v, a.m_v)}; }
+        [[nodiscard]] static PacketFloat max(const PacketFloat &a, const PacketFloat &b) noexcept { return {_mm256_max_ps(b.m_v, a.m_v)}; }
+
+        // one bit per lane of a mask
+        [[nodiscard]] uint32_t bits() const noexcept { return (uint32_t)_mm256_movemask_ps(m_v); }
+#elif COAL_SSE
+        __m128 m_v;
+
+        [[nodiscard]] static PacketFloat load(const float *p) noexcept { return {_mm_load_ps(p)}; }
+        [[nodiscard]] static PacketFloat broadcast(const float f) noexcept { return {_mm_set1_ps(f)}; }
+        void store(float *p) const noexcept { _mm_store_ps(p, m_v); }
+
+        [[nodiscard]] PacketFloat operator+(const PacketFloat &o) const noexcept { return {_mm_add_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator-(const PacketFloat &o) const noexcept { return {_mm_sub_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator*(const PacketFloat &o) const noexcept { return {_mm_mul_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator/(const PacketFloat &o) const noexcept { return {_mm_div_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator-() const noexcept { return {_mm_xor_ps(m_v, _mm_set1_ps(-0.0f))}; }
+
+        [[nodiscard]] PacketFloat operator<(const PacketFloat &o) const noexcept { return {_mm_cmplt_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator>(const PacketFloat &o) const noexcept { return {_mm_cmpgt_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator<=(const PacketFloat &o) const noexcept { return {_mm_cmple_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator>=(const PacketFloat &o) const noexcept { return {_mm_cmpge_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator&(const PacketFloat &o) const noexcept { return {_mm_and_ps(m_v, o.m_v)}; }
+        [[nodiscard]] PacketFloat operator|(const PacketFloat &o) const noexcept { return {_mm_or_ps(m_v, o.m_v)}; }
+
+        [[nodiscard]] PacketFloat sqrt() const noexcept { return {_mm_sqrt_ps(m_v)}; }
+        [[nodiscard]] PacketFloat abs() const noexcept { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), m_v)}; }
+
+        // mask ? a : b, without SSE4.1 blendv
+        [[nodiscard]] static PacketFloat select(const PacketFloat &mask, const PacketFloat &a, const PacketFloat &b) noexcept
+        {
+            return {_mm_or_ps(_mm_and_ps(mask.m_v, a.m_v), _mm_andnot_ps(mask.m_v, b.m_v))};
+        }
+
+        // minps(x, y) is x < y ? x : y, so swapping the operands gives std::min(a, b) = b < a ? b : a in one instruction
+        [[nodiscard]] static PacketFloat min(const PacketFloat &a, const PacketFloat &b) noexcept { return {_mm_min_ps(b.m_v, a.m_v)}; }
+        [[nodiscard]] static PacketFloat max(const PacketFloat &a, const PacketFloat &b) noexcept { return {_mm_max_ps(b.m_v, a.m_v)}; }
+
+        // one bit per lane of a mask
+        [[nodiscard]] uint32_t bits() const noexcept { return (uint32_t)_mm_movemask_ps(m_v); }
+#else
+        float m_v[kPacketSize];
+
+        template <typename Function>
+        [[nodiscard]] static PacketFloat map(Function &&fn) noexcept
+        {
+            PacketFloat result;
+
+            for (int i = 0; i < kPacketSize; i++)
+                result.m_v[i] = fn(i);
+
+            return result;
+        }
+
+        // comparisons store all bits set (a NaN) or zero, like the SIMD masks
+        [[nodiscard]] static float mask(const bool value) noexcept { return std::bit_cast<float>(value ? 0xffffffffu : 0u); }
+        [[nodiscard]] bool lane(const int i) const noexcept { return std::bit_cast<uint32_t>(m_v[i]) != 0; }
+
+        [[nodiscard]] static PacketFloat load(const float *p) noexcept { return map([&](int i) { return p[i]; }); }
+        [[nodiscard]] static PacketFloat broadcast(const float f) noexcept { return map([&](int) { return f; }); }
+        void store(float *p) const noexcept { std::memcpy(p, m_v, sizeof(m_v)); }
+
+        [[nodiscard]] PacketFloat operator+(const PacketFloat &o) const noexcept { return map([&](int i) { return m_v[i] + o.m_v[i]; }); }
+        [[nodiscard]] PacketFloat operator-(const PacketFloat &o) const noexcept { return map([&](int i) { return m_v[i] - o.m_v[i]; }); }
+        [[nodiscard]] PacketFloat operator*(const PacketFloat &o) const noexcept { return map([&](int i) { return m_v[i] * o.m_v[i]; }); }
+        [[nodiscard]] PacketFloat operator/(const PacketFloat &o) const noexcept { return map([&](int i) { return m_v[i] / o.m_v[i]; }); }
+        [[nodiscard]] PacketFloat operator-() const noexcept { return map([&](int i) { return -m_v[i]; }); }
+
+        [[nodiscard]] PacketFloat operator<(const PacketFloat &o) const noexcept { return map([&](int i) { return mask(m_v[i] < o.m_v[i]); }); }
+        [[nodiscard]] PacketFloat operator>(const PacketFloat &o) const noexcept { return map([&](int i) { return mask(m_v[i] > o.m_v[i]); }); }
+        [[nodiscard]] PacketFloat operator<=(const PacketFloat &o) const noexcept { return map([&](int i) { return mask(m_v[i] <= o.m_v[i]); }); }
+        [[nodiscard]] PacketFloat operator>=(const PacketFloat &o) const noexcept { return map([&](int i) { return mask(m_v[i] >= o.m_v[i]); }); }
+        [[nodiscard]] PacketFloat operator&(const PacketFloat &o) const noexcept { return map([&](int i) { return mask(lane(i) && o.lane(i)); }); }
+        [[nodiscard]] PacketFloat operator|(const PacketFloat &o) const noexcept { return map([&](int i) { return mask(lane(i) || o.lane(i)); }); }
+
+        [[nodiscard]] PacketFloat sqrt() const noexcept { return map([&](int i) { return std::sqrt(m_v[i]); }); }
+        [[nodiscard]] PacketFloat abs() const noexcept { return map([&](int i) { return std::abs(m_v[i]); }); }
+
+        [[nodiscard]] static PacketFloat select(const PacketFloat &mask, const PacketFloat &a, const PacketFloat &b) noexcept
+        {
+            return map([&](int i) { return mask.lane(i) ? a.m_v[i] : b.m_v[i]; });
+        }
+
+        [[nodiscard]] static PacketFloat min(const PacketFloat &a, const PacketFloat &b) noexcept { return map([&](int i) { return std::min(a.m_v[i], b.m_v[i]); }); }
+        [[nodiscard]] static PacketFloat max(const PacketFloat &a, const PacketFloat &b) noexcept { return map([&](int i) { return std::max(a.m_v[i], b.m_v[i]); }); }
+
+        [[nodiscard]] uint32_t bits() const noexcept
+        {
+            uint32_t result = 0;
+
+            for (int i = 0; i < kPacketSize; i++)
+                result |= lane(i) ? 1u << i : 0u;
+
+            return result;
+        }
+#endif
+    };
+
+    /**
+     * @brief The smallest float f with (double)f >= kEpsilon
+     *
+     * kEpsilon is a double, so the scalar kernels compare the promoted float against it. Comparing against this float instead gives the
+     * same answer for every input.
+     */
+    [[nodiscard]] inline float packet_epsilon() noexcept
+    {
+        float epsilon = (float)kEpsilon;
+
+        if ((double)epsilon < kEpsilon)
+            epsilon = std::nextafter(epsilon, std::numeric_limits<float>::infinity());
+
+        return epsilon;
+    }
+
+    /**
+     * @brief The origins and directions of a packet's rays transformed into a shape's object space
+     *
+     * Computed in the same order as Matrix4::transform, so every lane matches Ray::transform bit for bit.
+     */
+    struct PacketRays
+    {
+        PacketFloat m_origin_x, m_origin_y, m_origin_z;
+        PacketFloat m_direction_x, m_direction_y, m_direction_z;
+        // only set by compute_inverse_direction
+        PacketFloat m_inverse_direction_x, m_inverse_direction_y, m_inverse_direction_z;
+
+        // the reciprocals of every lane's direction, once per transformed packet like the Ray constructor, for the shapes clipping slabs
+        void compute_inverse_direction() noexcept
+        {
+            const PacketFloat one = PacketFloat::broadcast(1.0f);
+
+            m_inverse_direction_x = one / m_direction_x;
+            m_inverse_direction_y = one / m_direction_y;
+            m_inverse_direction_z = one / m_direction_z;
+        }
+    };
+
+    /**
+     * @brief Up to kPacketSize coherent rays in SoA layout, together with the closest hit found so far per lane
+     *
+     */
+    struct RayPacket
+    {
+        alignas(32) float m_origin_x[kPacketSize];
+        alignas(32) float m_origin_y[kPacketSize];
+        alignas(32) float m_origin_z[kPacketSize];
+        alignas(32) float m_direction_x[kPacketSize];
+        alignas(32) float m_direction_y[kPacketSize];
+        alignas(32) float m_direction_z[kPacketSize];
+        alignas(32) float m_inverse_direction_x[kPacketSize];
+        alignas(32) float m_inverse_direction_y[kPacketSize];
+        alignas(32) float m_inverse_direction_z[kPacketSize];
+
+        // the near end of each lane's range
+        alignas(32) float m_t_min[kPacketSize];
+
+        // closest hit per lane, the ray's far end and nullptr until something was hit
+        alignas(32) float m_t[kPacketSize];
+        const Shape *m_hit[kPacketSize];
+        // Intersection::m_geometry of the closest hit
+        const Shape *m_geometry[kPacketSize];
+        // Intersection::m_primitive of the closest hit
+        uint32_t m_primitive[kPacketSize];
+
+        // lanes holding a ray
+        uint32_t m_active = 0;
+
+        void set_ray(const int lane, const Ray &ray) noexcept
+        {
+            m_origin_x[lane] = ray.m_origin.x;
+            m_origin_y[lane] = ray.m_origin.y;
+            m_origin_z[lane] = ray.m_origin.z;
+            m_direction_x[lane] = ray.m_direction.x;
+            m_direction_y[lane] = ray.m_direction.y;
+            m_direction_z[lane] = ray.m_direction.z;
+
+            // the same reciprocals the scalar BVH traversal uses
+            m_inverse_direction_x[lane] = ray.m_inverse_direction.x;
+            m_inverse_direction_y[lane] = ray.m_inverse_direction.y;
+            m_inverse_direction_z[lane] = ray.m_inverse_direction.z;
+
+            m_t_min[lane] = ray.m_t_min;
+            m_t[lane] = ray.m_t_max;
+            m_hit[lane] = nullptr;
+            m_geometry[lane] = nullptr;
+            m_primitive[lane] = 0;
+            m_active |= 1u << lane;
+        }
+
+        // the lane's ray, its range ends at the closest hit found so far
+        [[nodiscard]] Ray get_ray(const int lane) const noexcept
+        {
+            return Ray(Point(m_origin_x[lane], m_origin_y[lane], m_origin_z[lane]), Vector(m_direction_x[lane], m_direction_y[lane], m_direction_z[lane]), m_t_min[lane], m_t[lane]);
+        }
+
+        // the rays in the object space of a shape with the given inverse transform
+        [[nodiscard]] PacketRays transform(const Matrix4 &m) const noexcept
+        {
+            const PacketFloat ox = PacketFloat::load(m_origin_x);
+            const PacketFloat oy = PacketFloat::load(m_origin_y);
+            const PacketFloat oz = PacketFloat::load(m_origin_z);
+            const PacketFloat dx = PacketFloat::load(m_direction_x);
+            const PacketFloat dy = PacketFloat::load(m_direction_y);
+            const PacketFloat dz = PacketFloat::load(m_direction_z);
+
+            auto row = [&](const int r, const PacketFloat &x, const PacketFloat &y, const PacketFloat &z)
+            {
+                return PacketFloat::broadcast(m(r, 0)) * x + PacketFloat::broadcast(m(r, 1)) * y + PacketFloat::broadcast(m(r, 2)) * z;
+            };
+
+            PacketRays rays;
+
+            rays.m_origin_x = row(0, ox, oy, oz) + PacketFloat::broadcast(m(0, 3));
+            rays.m_origin_y = row(1, ox, oy, oz) + PacketFloat::broadcast(m(1, 3));
+            rays.m_origin_z = row(2, ox, oy, oz) + PacketFloat::broadcast(m(2, 3));
+            rays.m_direction_x = row(0, dx, dy, dz);
+            rays.m_direction_y = row(1, dx, dy, dz);
+            rays.m_direction_z = row(2, dx, dy, dz);
+
+            return rays;
+        }
+
+        /**
+         * @brief Keep the hits of a shape that are closer than what the lanes found so far
+         *
+         * @param t The shape's distances, lanes without a hit may hold anything
+         * @param hit_mask Lanes where the shape was hit
+         * @param mask Lanes that tested the shape
+         */
+        void record_hits(const Shape &shape, const PacketFloat &t, const uint32_t hit_mask, const uint32_t mask) noexcept
+        {
+            // same rule as BVH::closest_hit, past the near end of the range and strictly closer
+            const uint32_t closer = (t > PacketFloat::load(m_t_min)).bits() & (t < PacketFloat::load(m_t)).bits() & hit_mask & mask;
+
+            if (!closer)
+                return;
+
+            alignas(32) float distances[kPacketSize];
+            t.store(distances);
+
+            for (int lane = 0; lane < kPacketSize; lane++)
+            {
+                if (closer & (1u << lane))
+                {
+                    m_t[lane] = distances[lane];
+                    m_hit[lane] = &shape;
+                    m_geometry[lane] = nullptr;
+                    m_primitive[lane] = 0;
+                }
+            }
+        }
+    };
+} // namespace COAL
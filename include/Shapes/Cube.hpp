@@ -20,44 +20,76 @@ namespace COAL
         {
             PROFILE_FUNCTION();
 
-            auto check_axis = [](const float origin, const float direction)
+            // the entry if it lies past the start of the range, the exit for rays starting inside (refracted rays leaving the cube)
+            return Cube::interval(ray).first_hit(ray, *this);
+        }
+
+        // the overlap of the three slabs
+        [[nodiscard]] Interval interval(const Ray &ray) const override
+        {
+            PROFILE_FUNCTION();
+
+            // the sign of the direction picks the face the ray enters through, no division and no swap per axis
+            auto slab = [](const float origin, const float inverse_direction, const bool negative, float &t_enter, float &t_exit)
             {
-                float tmin_numerator = -1 - origin;
-                float tmax_numerator = 1 - origin;
-
-                float tmin;
-                float tmax;
-
-                if (std::abs(direction) >= kEpsilon)
-                {
-                    tmin = tmin_numerator / direction;
-                    tmax = tmax_numerator / direction;
-                }
-                else
-                {
-                    tmin = tmin_numerator * std::numeric_limits<float>::infinity();
-                    tmax = tmax_numerator * std::numeric_limits<float>::infinity();
-                }
-
-                if (tmin > tmax)
-                    std::swap(tmin, tmax);
-
-                return std::make_pair(tmin, tmax);
+                t_enter = ((negative ? 1.0f : -1.0f) - origin) * inverse_direction;
+                t_exit = ((negative ? -1.0f : 1.0f) - origin) * inverse_direction;
             };
 
-            auto transformed_ray = ray.transform(get_inverse_transform());
+            const Ray transformed_ray = ray.transform(get_inverse_transform());
+
+            float xmin, xmax, ymin, ymax, zmin, zmax;
 
-            auto xt = check_axis(transformed_ray.m_origin.x, transformed_ray.m_direction.x);
-            auto yt = check_axis(transformed_ray.m_origin.y, transformed_ray.m_direction.y);
-            auto zt = check_axis(transformed_ray.m_origin.z, transformed_ray.m_direction.z);
+            slab(transformed_ray.m_origin.x, transformed_ray.m_inverse_direction.x, transformed_ray.is_negative(0), xmin, xmax);
+            slab(transformed_ray.m_origin.y, transformed_ray.m_inverse_direction.y, transformed_ray.is_negative(1), ymin, ymax);
+            slab(transformed_ray.m_origin.z, transformed_ray.m_inverse_direction.z, transformed_ray.is_negative(2), zmin, zmax);
 
-            float tmin = std::max(xt.first, std::max(yt.first, zt.first));
-            float tmax = std::min(xt.second, std::min(yt.second, zt.second));
+            float tmin = std::max(xmin, std::max(ymin, zmin));
+            float tmax = std::min(xmax, std::min(ymax, zmax));
 
             if (tmin > tmax)
                 return {};
 
-            return {tmin, *this};
+            return {tmin, tmax};
+        }
+
+        // the test above for a whole packet, the operations keep their order so every lane gets the same t
+        [[nodiscard]] bool intersects(RayPacket &packet, const uint32_t mask, uint32_t &hits) const override
+        {
+            PROFILE_FUNCTION();
+
+            const PacketFloat one = PacketFloat::broadcast(1.0f);
+            const PacketFloat minus_one = PacketFloat::broadcast(-1.0f);
+
+            auto slab = [&](const PacketFloat &origin, const PacketFloat &inverse_direction, PacketFloat &t_enter, PacketFloat &t_exit)
+            {
+                const PacketFloat negative = inverse_direction < PacketFloat::broadcast(0.0f);
+
+                t_enter = (PacketFloat::select(negative, one, minus_one) - origin) * inverse_direction;
+                t_exit = (PacketFloat::select(negative, minus_one, one) - origin) * inverse_direction;
+            };
+
+            PacketRays rays = packet.transform(get_inverse_transform());
+            rays.compute_inverse_direction();
+
+            PacketFloat xmin, xmax, ymin, ymax, zmin, zmax;
+
+            slab(rays.m_origin_x, rays.m_inverse_direction_x, xmin, xmax);
+            slab(rays.m_origin_y, rays.m_inverse_direction_y, ymin, ymax);
+            slab(rays.m_origin_z, rays.m_inverse_direction_z, zmin, zmax);
+
+            PacketFloat tmin = PacketFloat::max(xmin, PacketFloat::max(ymin, zmin));
+            PacketFloat tmax = PacketFloat::min(xmax, PacketFloat::min(ymax, zmax));
+
+            const PacketFloat t_min = PacketFloat::load(packet.m_t_min);
+
+            PacketFloat t = PacketFloat::select(tmin <= t_min, tmax, tmin);
+
+            hits = ~((tmin > tmax) | (t <= t_min)).bits() & mask;
+
+            packet.record_hits(*this, t, hits, mask);
+
+            return true;
         }
 
         [[nodiscard]] Vector normal_at(const Point &p) const override
@@ -77,6 +109,12 @@ namespace COAL
             return Vector(0, 0, local_p.z);
         }
 
+        // the unit cube spans [-1, 1] on every axis in object space
+        [[nodiscard]] AABB bounds() const override
+        {
+            return AABB::from_unit_box(get_transform());
+        }
+
         // implement abstract equality
         [[nodiscard]] bool operator==(const Shape &other) const override
         {
@@ -90,6 +128,12 @@ namespace COAL
             return "Cube ";
         }
 
+        // get type
+        [[nodiscard]] ShapeType get_type() const noexcept override
+        {
+            return ShapeType::Cube;
+        }
+
         // serialize all data to a nlohmann json string object
         [[nodiscard]] std::string to_json() const noexcept
         {
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <Accelerators/GeometryGroup.hpp>
+#include <Constants.hpp>
+#include <Intersection.hpp>
+#include <Material.hpp>
+#include <Matrix.hpp>
+#include <Ray.hpp>
+#include <Shapes/Shape.hpp>
+#include <Tuples/Point.hpp>
+#include <Tuples/Vector.hpp>
+
+namespace COAL
+{
+    /**
+     * @brief A geometry group placed in the world, the top level of a scene
+     *
+     * Only the transform and the material belong to the instance, the shapes and their BVH are shared through the group. A scene's
+     * memory grows with its unique geometry instead of its instance count, and moving an instance (World::mark_dirty) refits the
+     * world's BVH without touching the group's. Every shape of the group is shaded with the instance's material, and a refracting
+     * instance counts as one medium.
+     */
+    struct Instance : public Shape
+    {
+
+        [[nodiscard]] explicit Instance(std::shared_ptr<const GeometryGroup> group) : m_group(std::move(group)) {}
+
+        using Shape::intersects;
+
+        // the ray is moved into the group's space once for all of the group's shapes, the distances carry over unchanged
+        [[nodiscard]] Intersection intersects(const Ray &ray) const override
+        {
+            PROFILE_FUNCTION();
+
+            const Intersection hit = m_group->closest_hit(ray.transform(get_inverse_transform()));
+
+            if (!hit.m_object)
+                return {};
+
+            return Intersection(hit.m_t, *this, hit.m_object, hit.m_primitive);
+        }
+
+        // the lanes' rays are moved into the group's space like the scalar test does it, the group's BVH walks them as one packet
+        [[nodiscard]] bool intersects(RayPacket &packet, const uint32_t mask, uint32_t &hits) const override
+        {
+            PROFILE_FUNCTION();
+
+            RayPacket group_packet{};
+
+            for (int lane = 0; lane < kPacketSize; lane++)
+                if (mask & (1u << lane))
+                    group_packet.set_ray(lane, packet.get_ray(lane).transform(get_inverse_transform()));
+
+            m_group->closest_hit(group_packet);
+
+            hits = 0;
+
+            // the rays' ranges ended at the closest hit so far, any hit left is closer
+            for (int lane = 0; lane < kPacketSize; lane++)
+            {
+                if (!group_packet.m_hit[lane] || !(mask & (1u << lane)))
+                    continue;
+
+                hits |= 1u << lane;
+                packet.m_t[lane] = group_packet.m_t[lane];
+                packet.m_hit[lane] = this;
+                packet.m_geometry[lane] = group_packet.m_hit[lane];
+                packet.m_primitive[lane] = group_packet.m_primitive[lane];
+            }
+
+            return true;
+        }
+
+        [[nodiscard]] Interval interval(const Ray &ray) const override
+        {
+            PROFILE_FUNCTION();
+
+            return m_group->interval(ray.transform(get_inverse_transform()));
+        }
+
+        // the normal of the group's shape that was hit
+        [[nodiscard]] Vector normal_at_hit(const Point &p, const Intersection &hit) const override
+        {
+            PROFILE_FUNCTION();
+
+            if (!hit.m_geometry)
+                return normal_at(p);
+
+            // the hit as the group's shape returned it
+            const Intersection geometry_hit(hit.m_t, *hit.m_geometry, nullptr, hit.m_primitive);
+
+            const Vector normal = hit.m_geometry->normal_at_hit(get_inverse_transform() * p, geometry_hit);
+
+            return (get_normal_transform() * normal).normalize();
+        }
+
+        // without a hit the shape is not known, the one nearest to the point is taken
+        [[nodiscard]] Vector normal_at(const Point &p) const override
+        {
+            PROFILE_FUNCTION();
+
+            const Shape *shape = m_group->nearest_shape(get_inverse_transform() * p);
+
+            return shape ? group_normal(*shape, p) : Vector(0, 0, 0);
+        }
+
+        [[nodiscard]] AABB bounds() const override
+        {
+            return m_group->get_bounds().transformed(get_transform());
+        }
+
+        // implement abstract equality
+        [[nodiscard]] bool operator==(const Shape &other) const override
+        {
+            const auto other_instance = dynamic_cast<const Instance *>(&other);
+            return other_instance != nullptr && other_instance->m_group == m_group && other_instance->get_transform() == get_transform();
+        }
+
+        [[nodiscard]] const std::shared_ptr<const GeometryGroup> &get_group() const noexcept
+        {
+            return m_group;
+        }
+
+        // get name
+        [[nodiscard]] const char *get_name() const override
+        {
+            return "Instance ";
+        }
+
+        // get type
+        [[nodiscard]] ShapeType get_type() const noexcept override
+        {
+            return ShapeType::Instance;
+        }
+
+        // serialize all data to a nlohmann json string object, the group is referred to by its name
+        [[nodiscard]] std::string to_json() const noexcept
+        {
+            nlohmann::json j;
+
+            j["type"] = "Instance";
+            j["group"] = m_group->get_name();
+            j["translation"] = nlohmann::json::parse(get_translation().to_json());
+            j["scale"] = nlohmann::json::parse(get_scale().to_json());
+            j["rotation"] = nlohmann::json::parse(get_rotations().to_json());
+            j["material"] = nlohmann::json::parse(get_material().to_json());
+
+            return j.dump();
+        }
+
+        // static deserialize all data from a nlohmann json string object, the group named in it has to be looked up by the caller
+        static std::shared_ptr<Instance> from_json(const std::string &json, std::shared_ptr<const GeometryGroup> group) noexcept
+        {
+            nlohmann::json j = nlohmann::json::parse(json);
+
+            auto instance = std::make_shared<Instance>(std::move(group));
+
+            Point translation = Point::from_json(j["translation"].dump());
+            Point scale = Point::from_json(j["scale"].dump());
+            Point rotation = Point::from_json(j["rotation"].dump());
+
+            float translationf[3] = {translation.x, translation.y, translation.z};
+            float scalef[3] = {scale.x, scale.y, scale.z};
+            float rotationf[3] = {rotation.x, rotation.y, rotation.z};
+
+            instance->transform(translationf, rotationf, scalef);
+
+            instance->set_material(Material::from_json(j["material"].dump()));
+
+            return instance;
+        }
+
+    private:
+        // a normal of a shape of the group in world space
+        [[nodiscard]] Vector group_normal(const Shape &shape, const Point &p) const
+        {
+            const Vector normal = shape.normal_at(get_inverse_transform() * p);
+
+            return (get_normal_transform() * normal).normalize();
+        }
+
+        std::shared_ptr<const GeometryGroup> m_group;
+    };
+} // namespace COAL
@@ -0,0 +1,494 @@
+#pragma once
+
+#include "Accelerators/AABB.hpp"
+#include "Accelerators/BVH.hpp"
+#include "Constants.hpp"
+#include "Intersection.hpp"
+#include "Material.hpp"
+#include "Matrix.hpp"
+#include "Ray.hpp"
+#include "Shapes/Shape.hpp"
+#include "Threading/ThreadPool.hpp"
+#include "Tuples/Point.hpp"
+#include "Tuples/Vector.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief The triangles of a mesh and their BVH, shared by every mesh shape that shows them
+     *
+     * Three indices into the positions per triangle. The triangles are stored in the order of the BVH's leaves, so a leaf's range is a
+     * range of triangles and a triangle's index is stable for the lifetime of the data. Nothing is edited after the build.
+     */
+    struct MeshData
+    {
+        /**
+         * @brief Build the BVH over the triangles
+         *
+         * @param positions The vertices in object space
+         * @param indices Three per triangle, every one smaller than positions.size()
+         * @param file The file the mesh was loaded from, written to the scene instead of the triangles
+         * @param pool Workers to build the BVH with, may be nullptr
+         */
+        [[nodiscard]] MeshData(std::vector<Point> positions, std::vector<uint32_t> indices, std::string file = "", ThreadPool *pool = nullptr)
+            : m_positions(std::move(positions)), m_indices(std::move(indices)), m_file(std::move(file))
+        {
+            PROFILE_FUNCTION();
+
+            const size_t count = get_triangle_count();
+
+            if (count == 0)
+                return;
+
+            auto for_range = [&](const size_t range, const std::function<void(size_t, size_t, int)> &fn)
+            {
+                if (pool)
+                    pool->parallel_for(range, fn);
+                else
+                    fn(0, range, 0);
+            };
+
+            std::vector<AABB> bounds(count);
+
+            for_range(count, [&](const size_t begin, const size_t end, [[maybe_unused]] const int worker)
+                      {
+                for (size_t i = begin; i < end; i++)
+                {
+                    AABB &box = bounds[i];
+
+                    box.expand(m_positions[m_indices[i * 3]]);
+                    box.expand(m_positions[m_indices[i * 3 + 1]]);
+                    box.expand(m_positions[m_indices[i * 3 + 2]]);
+                } });
+
+            std::vector<uint32_t> order;
+            BVHBuilder::build(bounds, m_nodes, order, pool);
+
+            m_bounds = m_nodes[0].m_bounds;
+
+            // the triangles in leaf order
+            std::vector<uint32_t> sorted(m_indices.size());
+
+            for_range(count, [&](const size_t begin, const size_t end, [[maybe_unused]] const int worker)
+                      {
+                for (size_t i = begin; i < end; i++)
+                {
+                    sorted[i * 3] = m_indices[(size_t)order[i] * 3];
+                    sorted[i * 3 + 1] = m_indices[(size_t)order[i] * 3 + 1];
+                    sorted[i * 3 + 2] = m_indices[(size_t)order[i] * 3 + 2];
+                } });
+
+            m_indices = std::move(sorted);
+        }
+
+        /**
+         * @brief The closest triangle hit inside the ray's range
+         *
+         * @param ray A ray in object space
+         * @param t Set to the distance of the hit
+         * @param triangle Set to the triangle that was hit
+         * @return true if a triangle was hit
+         */
+        [[nodiscard]] bool closest_hit(const Ray &ray, float &t, uint32_t &triangle) const noexcept
+        {
+            Ray query = ray;
+            bool hit = false;
+
+            traverse(query, [&](const uint32_t i)
+                     {
+                float distance;
+
+                if (intersects(i, query, distance) && query.in_range(distance))
+                {
+                    t = query.m_t_max = distance;
+                    triangle = i;
+                    hit = true;
+                } });
+
+            return hit;
+        }
+
+        /**
+         * @brief The first and the last triangle hit along the whole line of a ray
+         *
+         * @param ray A ray in object space, its range is ignored
+         * @param t_enter Set to the smallest distance
+         * @param t_exit Set to the largest distance
+         * @return true if a triangle was hit
+         */
+        [[nodiscard]] bool extent(const Ray &ray, float &t_enter, float &t_exit) const noexcept
+        {
+            Ray query = ray;
+            query.m_t_min = -std::numeric_limits<float>::infinity();
+            query.m_t_max = std::numeric_limits<float>::infinity();
+
+            t_enter = std::numeric_limits<float>::infinity();
+            t_exit = -std::numeric_limits<float>::infinity();
+
+            traverse(query, [&](const uint32_t i)
+                     {
+                float distance;
+
+                if (intersects(i, query, distance))
+                {
+                    t_enter = std::min(t_enter, distance);
+                    t_exit = std::max(t_exit, distance);
+                } });
+
+            return t_enter <= t_exit;
+        }
+
+        /**
+         * @brief Möller–Trumbore, the distance along the ray without solving for the plane first
+         *
+         * @param triangle The triangle to test
+         * @param ray A ray in object space, its range is not checked
+         * @param t Set to the distance on a hit
+         * @return true if the line of the ray crosses the triangle, edges and corners count as inside
+         */
+        [[nodiscard]] bool intersects(const uint32_t triangle, const Ray &ray, float &t) const noexcept
+        {
+            const Point &v0 = m_positions[m_indices[(size_t)triangle * 3]];
+            const Point &v1 = m_positions[m_indices[(size_t)triangle * 3 + 1]];
+            const Point &v2 = m_positions[m_indices[(size_t)triangle * 3 + 2]];
+
+            const Vector edge1 = v1 - v0;
+            const Vector edge2 = v2 - v0;
+
+            const Vector p = ray.m_direction.cross(edge2);
+            const float determinant = edge1.dot(p);
+
+            // the ray runs parallel to the triangle
+            if (std::abs(determinant) < kParallelEpsilon)
+                return false;
+
+            const float inverse_determinant = 1.0f / determinant;
+
+            const Vector s = ray.m_origin - v0;
+            const float u = s.dot(p) * inverse_determinant;
+
+            if (u < 0.0f || u > 1.0f)
+                return false;
+
+            const Vector q = s.cross(edge1);
+            const float v = ray.m_direction.dot(q) * inverse_determinant;
+
+            if (v < 0.0f || u + v > 1.0f)
+                return false;
+
+            t = edge2.dot(q) * inverse_determinant;
+
+            return true;
+        }
+
+        // the unnormalized face normal in object space, the vertices wind counter-clockwise around it
+        [[nodiscard]] Vector face_normal(const uint32_t triangle) const noexcept
+        {
+            const Point &v0 = m_positions[m_indices[(size_t)triangle * 3]];
+            const Point &v1 = m_positions[m_indices[(size_t)triangle * 3 + 1]];
+            const Point &v2 = m_positions[m_indices[(size_t)triangle * 3 + 2]];
+
+            return (v1 - v0).cross(v2 - v0);
+        }
+
+        /**
+         * @brief The triangle closest to a point
+         *
+         * Nodes are visited near child first and skipped once their box is further away than the best triangle so far, a box is never
+         * further away than the triangles inside of it. Ties go to the triangle with the smaller index.
+         *
+         * @param p A point in object space
+         * @return uint32_t The triangle, 0 for an empty mesh
+         */
+        [[nodiscard]] uint32_t nearest_triangle(const Point &p) const noexcept
+        {
+            uint32_t nearest = 0;
+            float nearest_distance = std::numeric_limits<float>::infinity();
+
+            if (m_nodes.empty())
+                return nearest;
+
+            uint32_t stack[kStackSize];
+            int stack_pointer = 0;
+
+            stack[stack_pointer++] = 0;
+
+            while (stack_pointer > 0)
+            {
+                const BVHNode &node = m_nodes[stack[--stack_pointer]];
+
+                if (node.m_bounds.distance_squared(p) > nearest_distance)
+                    continue;
+
+                if (node.is_leaf())
+                {
+                    for (uint32_t i = node.m_left_first; i < node.m_left_first + node.m_count; i++)
+                    {
+                        const float distance = triangle_distance(i, p);
+
+                        if (distance < nearest_distance || (distance == nearest_distance && i < nearest))
+                        {
+                            nearest = i;
+                            nearest_distance = distance;
+                        }
+                    }
+
+                    continue;
+                }
+
+                uint32_t near_child = node.m_left_first;
+                uint32_t far_child = node.m_left_first + 1;
+
+                if (m_nodes[far_child].m_bounds.distance_squared(p) < m_nodes[near_child].m_bounds.distance_squared(p))
+                    std::swap(near_child, far_child);
+
+                stack[stack_pointer++] = far_child;
+                stack[stack_pointer++] = near_child;
+            }
+
+            return nearest;
+        }
+
+        // getters
+        [[nodiscard]] uint32_t get_triangle_count() const noexcept { return (uint32_t)(m_indices.size() / 3); }
+        [[nodiscard]] const std::vector<Point> &get_positions() const noexcept { return m_positions; }
+        [[nodiscard]] const std::vector<uint32_t> &get_indices() const noexcept { return m_indices; }
+        [[nodiscard]] const std::vector<BVHNode> &get_nodes() const noexcept { return m_nodes; }
+        [[nodiscard]] const std::string &get_file() const noexcept { return m_file; }
+
+        // bounds in object space
+        [[nodiscard]] const AABB &get_bounds() const noexcept { return m_bounds; }
+
+    private:
+        static constexpr int kStackSize = BVHBuilder::kMaxDepth + 4;
+        static constexpr float kParallelEpsilon = 1e-12f;
+
+        // the squared distance to the triangle's plane plus the one to its bounds, exact enough to tell triangles apart on the surface. Infinite for a degenerate triangle
+        [[nodiscard]] float triangle_distance(const uint32_t triangle, const Point &p) const noexcept
+        {
+            const Point &v0 = m_positions[m_indices[(size_t)triangle * 3]];
+            const Point &v1 = m_positions[m_indices[(size_t)triangle * 3 + 1]];
+            const Point &v2 = m_positions[m_indices[(size_t)triangle * 3 + 2]];
+
+            const Vector normal = face_normal(triangle);
+            const float length = normal.magnitude();
+
+            if (length == 0)
+                return std::numeric_limits<float>::infinity();
+
+            const float plane = normal.dot(p - v0) / length;
+
+            AABB box;
+            box.expand(v0).expand(v1).expand(v2);
+
+            return plane * plane + box.distance_squared(p);
+        }
+
+        // fn(triangle) for every triangle in a leaf the ray reaches, the nearer child first. fn may shorten the ray's range
+        template <typename Function>
+        void traverse(const Ray &ray, Function &&fn) const noexcept
+        {
+            if (m_nodes.empty() || m_nodes[0].m_bounds.intersects(ray) == std::numeric_limits<float>::infinity())
+                return;
+
+            struct StackEntry
+            {
+                uint32_t m_node;
+                float m_t;
+            };
+
+            StackEntry stack[kStackSize];
+            int stack_pointer = 0;
+
+            uint32_t node_index = 0;
+
+            while (true)
+            {
+                const BVHNode &node = m_nodes[node_index];
+
+                if (node.is_leaf())
+                {
+                    for (uint32_t i = node.m_left_first; i < node.m_left_first + node.m_count; i++)
+                        fn(i);
+                }
+                else
+                {
+                    uint32_t near_child = node.m_left_first;
+                    uint32_t far_child = node.m_left_first + 1;
+
+                    float near_t = m_nodes[near_child].m_bounds.intersects(ray);
+                    float far_t = m_nodes[far_child].m_bounds.intersects(ray);
+
+                    if (far_t < near_t)
+                    {
+                        std::swap(near_child, far_child);
+                        std::swap(near_t, far_t);
+                    }
+
+                    if (near_t != std::numeric_limits<float>::infinity())
+                    {
+                        if (far_t != std::numeric_limits<float>::infinity())
+                            stack[stack_pointer++] = {far_child, far_t};
+
+                        node_index = near_child;
+                        continue;
+                    }
+                }
+
+                // pop the next node that can still hold a closer hit
+                bool found = false;
+
+                while (stack_pointer > 0)
+                {
+                    const StackEntry &entry = stack[--stack_pointer];
+
+                    if (entry.m_t < ray.m_t_max)
+                    {
+                        node_index = entry.m_node;
+                        found = true;
+                        break;
+                    }
+                }
+
+                if (!found)
+                    break;
+            }
+        }
+
+        std::vector<Point> m_positions;
+        std::vector<uint32_t> m_indices;
+        std::vector<BVHNode> m_nodes;
+        AABB m_bounds;
+        std::string m_file;
+    };
+
+    /**
+     * @brief An indexed triangle mesh placed in the world
+     *
+     * The triangles are shared through MeshData, several meshes of one file hold one copy of it. Faces are shaded flat, and a closed
+     * mesh can refract as one medium: the ray enters at the first triangle along its line and leaves at the last one.
+     */
+    struct Mesh : public Shape
+    {
+
+        [[nodiscard]] explicit Mesh(std::shared_ptr<const MeshData> data) : m_data(std::move(data)) {}
+
+        using Shape::intersects;
+
+        // the distances carry over from object space, the direction is not normalized by the transform
+        [[nodiscard]] Intersection intersects(const Ray &ray) const override
+        {
+            PROFILE_FUNCTION();
+
+            float t;
+            uint32_t triangle;
+
+            if (!m_data->closest_hit(ray.transform(get_inverse_transform()), t, triangle))
+                return {};
+
+            return Intersection(t, *this, nullptr, triangle);
+        }
+
+        [[nodiscard]] Interval interval(const Ray &ray) const override
+        {
+            PROFILE_FUNCTION();
+
+            float t_enter, t_exit;
+
+            if (!m_data->extent(ray.transform(get_inverse_transform()), t_enter, t_exit))
+                return {};
+
+            return {t_enter, t_exit};
+        }
+
+        // the normal of the triangle that was hit
+        [[nodiscard]] Vector normal_at_hit([[maybe_unused]] const Point &p, const Intersection &hit) const override
+        {
+            PROFILE_FUNCTION();
+
+            return (get_normal_transform() * m_data->face_normal(hit.m_primitive)).normalize();
+        }
+
+        // without a hit the triangle is not known, the one nearest to the point is searched for. Shading reads it from the hit instead
+        [[nodiscard]] Vector normal_at(const Point &p) const override
+        {
+            PROFILE_FUNCTION();
+
+            if (m_data->get_triangle_count() == 0)
+                return Vector(0, 0, 0);
+
+            const uint32_t triangle = m_data->nearest_triangle(get_inverse_transform() * p);
+
+            return (get_normal_transform() * m_data->face_normal(triangle)).normalize();
+        }
+
+        [[nodiscard]] AABB bounds() const override
+        {
+            return m_data->get_bounds().transformed(get_transform());
+        }
+
+        // implement abstract equality
+        [[nodiscard]] bool operator==(const Shape &other) const override
+        {
+            const auto other_mesh = dynamic_cast<const Mesh *>(&other);
+            return other_mesh != nullptr && other_mesh->m_data == m_data && other_mesh->get_transform() == get_transform();
+        }
+
+        [[nodiscard]] const std::shared_ptr<const MeshData> &get_data() const noexcept
+        {
+            return m_data;
+        }
+
+        // get name
+        [[nodiscard]] const char *get_name() const override
+        {
+            return "Mesh ";
+        }
+
+        // get type
+        [[nodiscard]] ShapeType get_type() const noexcept override
+        {
+            return ShapeType::Mesh;
+        }
+
+        // serialize all data to a nlohmann json string object, the triangles are referred to by the file they were loaded from
+        [[nodiscard]] std::string to_json() const noexcept
+        {
+            nlohmann::json j;
+
+            j["type"] = "Mesh";
+            j["file"] = m_data->get_file();
+            j["translation"] = nlohmann::json::parse(get_translation().to_json());
+            j["scale"] = nlohmann::json::parse(get_scale().to_json());
+            j["rotation"] = nlohmann::json::parse(get_rotations().to_json());
+            j["material"] = nlohmann::json::parse(get_material().to_json());
+
+            return j.dump();
+        }
+
+        // static deserialize all data from a nlohmann json string object, the file named in it has to be loaded by the caller
+        static std::shared_ptr<Mesh> from_json(const std::string &json, std::shared_ptr<const MeshData> data) noexcept
+        {
+            nlohmann::json j = nlohmann::json::parse(json);
+
+            auto mesh = std::make_shared<Mesh>(std::move(data));
+
+            Point translation = Point::from_json(j["translation"].dump());
+            Point scale = Point::from_json(j["scale"].dump());
+            Point rotation = Point::from_json(j["rotation"].dump());
+
+            float translationf[3] = {translation.x, translation.y, translation.z};
+            float scalef[3] = {scale.x, scale.y, scale.z};
+            float rotationf[3] = {rotation.x, rotation.y, rotation.z};
+
+            mesh->transform(translationf, rotationf, scalef);
+
+            mesh->set_material(Material::from_json(j["material"].dump()));
+
+            return mesh;
+        }
+
+    private:
+        std::shared_ptr<const MeshData> m_data;
+    };
+} // namespace COAL
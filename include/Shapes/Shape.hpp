@@ -1,10 +1,12 @@
 #pragma once
 
+#include "Accelerators/AABB.hpp"
 #include "Constants.hpp"
 #include "Intersection.hpp"
 #include "Material.hpp"
 #include "Matrix.hpp"
 #include "Ray.hpp"
+#include "RayPacket.hpp"
 #include "Tuples/Point.hpp"
 #include "Tuples/Vector.hpp"
 
@@ -12,16 +14,71 @@ namespace COAL
 {
 
     struct Intersection;
+    struct Interval;
+    struct World;
+
+    // the id of a shape that is not part of a world
+    inline constexpr uint32_t kInvalidShapeId = std::numeric_limits<uint32_t>::max();
+
+    // the concrete kind of a shape, used to index per-type statistics
+    enum class ShapeType
+    {
+        Sphere,
+        Cube,
+        XYPlane,
+        XZPlane,
+        YZPlane,
+        Instance,
+        Mesh,
+        Count
+    };
+
+    [[nodiscard]] constexpr const char *shape_type_name(const ShapeType type) noexcept
+    {
+        constexpr const char *names[] = {"Sphere", "Cube", "XYPlane", "XZPlane", "YZPlane", "Instance", "Mesh"};
+
+        return type < ShapeType::Count ? names[(int)type] : "Unknown";
+    }
 
     struct Shape
     {
 
         [[nodiscard]] virtual Intersection intersects(const Ray &ray) const = 0;
 
+        // where the ray enters and leaves the shape, ignoring the ray's range
+        [[nodiscard]] virtual Interval interval(const Ray &ray) const = 0;
+
+        /**
+         * @brief Intersect the lanes of a packet at once, keeping closer hits in the packet
+         *
+         * Shapes without a packet kernel keep this default, the caller then runs the scalar intersects for every lane.
+         *
+         * @param packet The rays, their closest hits are updated in place
+         * @param mask The lanes to test
+         * @param hits Set to the lanes that hit the shape
+         * @return false if the shape has no packet kernel
+         */
+        [[nodiscard]] virtual bool intersects([[maybe_unused]] RayPacket &packet, [[maybe_unused]] const uint32_t mask, [[maybe_unused]] uint32_t &hits) const
+        {
+            return false;
+        }
+
         virtual ~Shape() = default;
 
         [[nodiscard]] virtual Vector normal_at(const Point &p) const = 0;
 
+        // the normal at a hit the shape returned, shapes whose normal depends on more than the point (instances) read the hit
+        [[nodiscard]] virtual Vector normal_at_hit(const Point &p, [[maybe_unused]] const Intersection &hit) const
+        {
+            return normal_at(p);
+        }
+
+        // world space bounds of the shape, unbounded shapes (the planes) keep the default infinite box
+        [[nodiscard]] virtual AABB bounds() const
+        {
+            return AABB::infinite();
+        }
+
         // setters and getters
         [[nodiscard]] const Material &get_material() const
         {
@@ -53,12 +110,13 @@ namespace COAL
             return m_inverse_normal_transform;
         }
 
-        // abstract equality
+        // abstract equality, the same kind of shape with the same transform. Identity is the address
         [[nodiscard]] virtual bool operator==(const Shape &other) const = 0;
 
         Shape &set_material(const Material &material)
         {
             m_material = material;
+            update_pattern_transform();
 
             return *this;
         }
@@ -72,9 +130,7 @@ namespace COAL
             m_scale = Vector(scale[0], scale[1], scale[2]);
 
             m_transform = COAL::IDENTITY.translate(translation[0], translation[1], translation[2]).scale(scale[0], scale[1], scale[2]);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -88,9 +144,7 @@ namespace COAL
             m_scale = Vector(scale[0], scale[1], scale[2]);
 
             m_transform = COAL::IDENTITY.translate(translation[0], translation[1], translation[2]).scale(scale[0], scale[1], scale[2]).rotate(m_rotation_x, m_rotation_y, m_rotation_z);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -104,9 +158,7 @@ namespace COAL
             m_scale = Vector(scale[0], scale[1], scale[2]);
 
             m_transform = COAL::IDENTITY.translate(translation[0], translation[1], translation[2]).scale(scale[0], scale[1], scale[2]).rotate(m_rotation_x, m_rotation_y, m_rotation_z);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -116,9 +168,7 @@ namespace COAL
         {
             m_translation = t;
             m_transform = COAL::IDENTITY.translate(t.x, t.y, t.z);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -128,9 +178,7 @@ namespace COAL
         {
             m_translation = Vector(x, y, z);
             m_transform = COAL::IDENTITY.translate(x, y, z);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -140,9 +188,7 @@ namespace COAL
         {
             m_scale = s;
             m_transform = m_transform.scale(s.x, s.y, s.z);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -152,9 +198,7 @@ namespace COAL
         {
             m_scale = Vector(x, y, z);
             m_transform = m_transform.scale(x, y, z);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -164,9 +208,7 @@ namespace COAL
         {
             m_rotation_x = radians;
             m_transform = m_transform.rotate_x(radians);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -175,9 +217,7 @@ namespace COAL
         {
             m_rotation_y = radians;
             m_transform = m_transform.rotate_y(radians);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -186,9 +226,7 @@ namespace COAL
         {
             m_rotation_z = radians;
             m_transform = m_transform.rotate_z(radians);
-            m_inverse_transform = m_transform.inverse();
-            m_normal_transform = m_inverse_transform.transpose();
-            m_inverse_normal_transform = m_normal_transform.inverse();
+            update_inverse_transforms();
 
             return *this;
         }
@@ -196,6 +234,9 @@ namespace COAL
         // get name
         [[nodiscard]] virtual const char *get_name() const = 0;
 
+        // get type
+        [[nodiscard]] virtual ShapeType get_type() const noexcept = 0;
+
         // getters
         [[nodiscard]] constexpr const Vector &get_translation() const
         {
@@ -232,12 +273,47 @@ namespace COAL
         [[nodiscard]] virtual std::string to_json() const noexcept = 0;
 
     private:
+        // the inverse of the normal transform (inverse transposed) is just the transform transposed, so only one inverse is needed
+        void update_inverse_transforms() noexcept
+        {
+            m_inverse_transform = m_transform.inverse();
+            m_normal_transform = m_inverse_transform.transpose();
+            m_inverse_normal_transform = m_transform.transpose();
+
+            update_pattern_transform();
+        }
+
+    public:
+        /**
+         * @brief Fold the world to pattern space matrix of the material's pattern
+         *
+         * Called whenever the transform or the material changes, and by World::rebuild_acceleration to pick up patterns edited in place.
+         */
+        void update_pattern_transform() noexcept;
+
+        // the folded world to pattern space matrix, or nullptr if it was computed for another pattern (or an older revision of it)
+        [[nodiscard]] const Matrix4 *get_pattern_transform(const Pattern &pattern) const noexcept
+        {
+            if (&pattern != m_cached_pattern || pattern.get_revision() != m_pattern_revision)
+                return nullptr;
+
+            return &m_pattern_transform;
+        }
+
+    private:
+
         // private:
         COAL::Material m_material = COAL::Material();
         COAL::Matrix4 m_transform = COAL::IDENTITY;
         COAL::Matrix4 m_inverse_transform = COAL::IDENTITY;
         COAL::Matrix4 m_normal_transform = COAL::IDENTITY;
         COAL::Matrix4 m_inverse_normal_transform = COAL::IDENTITY;
+        COAL::Matrix4 m_pattern_transform = COAL::IDENTITY;
+        const Pattern *m_cached_pattern = nullptr;
+        uint64_t m_pattern_revision = 0;
+        // the id the last world it was added to gave the shape, World::get_id checks it before trusting it
+        friend struct World;
+        uint32_t m_id = kInvalidShapeId;
         Vector m_translation = Vector(0, 0, 0);
         Vector m_scale = Vector(1, 1, 1);
         float m_rotation_x = 0;
@@ -249,10 +325,24 @@ namespace COAL
     {
         PROFILE_FUNCTION();
 
-        Point object_point = s.get_transform().inverse() * p;
-        Point pattern_point = m_transform.inverse() * object_point;
+        if (const Matrix4 *world_to_pattern = s.get_pattern_transform(*this))
+            return color_at(*world_to_pattern * p);
+
+        Point object_point = s.get_inverse_transform() * p;
+        Point pattern_point = m_inverse_transform * object_point;
 
         return color_at(pattern_point);
     }
 
+    inline void Shape::update_pattern_transform() noexcept
+    {
+        m_cached_pattern = m_material.get_pattern().get();
+
+        if (m_cached_pattern)
+        {
+            m_pattern_revision = m_cached_pattern->get_revision();
+            m_pattern_transform = m_cached_pattern->get_inverse_transform() * m_inverse_transform;
+        }
+    }
+
 } // namespace COAL
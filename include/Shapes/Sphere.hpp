@@ -20,6 +20,15 @@ namespace COAL
         {
             PROFILE_FUNCTION();
 
+            // the nearer root if it lies past the start of the range, the far one otherwise
+            return Sphere::interval(ray).first_hit(ray, *this);
+        }
+
+        // the two roots, the ray is inside the sphere between them
+        [[nodiscard]] Interval interval(const Ray &ray) const override
+        {
+            PROFILE_FUNCTION();
+
             Ray transformed_ray = ray.transform(get_inverse_transform());
 
             Vector sphere_to_ray = transformed_ray.m_origin - Point();
@@ -43,17 +52,43 @@ namespace COAL
             //     std::swap(t1, t2);
             // }
 
-            if (t1 < 0)
-            {
-                t1 = t2;
-            }
+            return {t1, t2};
+        }
 
-            if (t1 < 0)
-            {
-                return {};
-            }
+        // the test above for a whole packet, the operations keep their order so every lane gets the same t
+        [[nodiscard]] bool intersects(RayPacket &packet, const uint32_t mask, uint32_t &hits) const override
+        {
+            PROFILE_FUNCTION();
+
+            const PacketRays rays = packet.transform(get_inverse_transform());
+
+            const PacketFloat &ox = rays.m_origin_x, &oy = rays.m_origin_y, &oz = rays.m_origin_z;
+            const PacketFloat &dx = rays.m_direction_x, &dy = rays.m_direction_y, &dz = rays.m_direction_z;
 
-            return Intersection(t1, *this);
+            const PacketFloat zero = PacketFloat::broadcast(0.0f);
+            const PacketFloat two = PacketFloat::broadcast(2.0f);
+
+            PacketFloat a = dx * dx + dy * dy + dz * dz;
+            PacketFloat b = two * (ox * dx + oy * dy + oz * dz);
+            PacketFloat c = (ox * ox + oy * oy + oz * oz) - PacketFloat::broadcast(1.0f);
+
+            PacketFloat discriminant = b * b - PacketFloat::broadcast(4.0f) * a * c;
+
+            // lanes with a negative discriminant get a NaN root, they are masked out below
+            PacketFloat root = discriminant.sqrt();
+
+            PacketFloat t1 = (-b - root) / (two * a);
+            PacketFloat t2 = (-b + root) / (two * a);
+
+            const PacketFloat t_min = PacketFloat::load(packet.m_t_min);
+
+            t1 = PacketFloat::select(t1 <= t_min, t2, t1);
+
+            hits = ~((discriminant < zero) | (t1 <= t_min)).bits() & mask;
+
+            packet.record_hits(*this, t1, hits, mask);
+
+            return true;
         }
 
         [[nodiscard]] Vector normal_at(const Point &p) const override
@@ -65,6 +100,12 @@ namespace COAL
             return (get_normal_transform() * object_normal).normalize();
         }
 
+        // the unit sphere spans [-1, 1] on every axis in object space
+        [[nodiscard]] AABB bounds() const override
+        {
+            return AABB::from_unit_box(get_transform());
+        }
+
         // implement abstract equality
         [[nodiscard]] bool operator==(const Shape &other) const override
         {
@@ -78,6 +119,12 @@ namespace COAL
             return "Sphere ";
         }
 
+        // get type
+        [[nodiscard]] ShapeType get_type() const noexcept override
+        {
+            return ShapeType::Sphere;
+        }
+
         // serialize all data to a nlohmann json string object
         [[nodiscard]] std::string to_json() const noexcept
         {
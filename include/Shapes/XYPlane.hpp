@@ -14,6 +14,14 @@ namespace COAL
         [[nodiscard]] XYPlane() = default;
 
         [[nodiscard]] Intersection intersects(const Ray &ray) const
+        {
+            PROFILE_FUNCTION();
+
+            return XYPlane::interval(ray).first_hit(ray, *this);
+        }
+
+        // the plane is flat, the ray enters and leaves it at the same distance
+        [[nodiscard]] Interval interval(const Ray &ray) const override
         {
 
             PROFILE_FUNCTION();
@@ -27,12 +35,26 @@ namespace COAL
 
             float t = -(transformed_ray.m_origin.z) / (transformed_ray.m_direction.z);
 
-            if (t < 0)
-            {
-                return {};
-            }
+            return {t, t};
+        }
+
+        // the test above for a whole packet, the operations keep their order so every lane gets the same t
+        [[nodiscard]] bool intersects(RayPacket &packet, const uint32_t mask, uint32_t &hits) const override
+        {
+            PROFILE_FUNCTION();
+
+            const PacketRays rays = packet.transform(get_inverse_transform());
+
+            PacketFloat t = (-rays.m_origin_z) / rays.m_direction_z;
+
+            PacketFloat parallel = rays.m_direction_z.abs() < PacketFloat::broadcast(packet_epsilon());
 
-            return Intersection(t, *this);
+            // past the near end of the range like Ray::in_range, offset secondary rays skip the plane they start on
+            hits = ~(parallel | (t <= PacketFloat::load(packet.m_t_min))).bits() & mask;
+
+            packet.record_hits(*this, t, hits, mask);
+
+            return true;
         }
 
         [[nodiscard]] Vector normal_at([[maybe_unused]] const Point &p) const override
@@ -55,6 +77,12 @@ namespace COAL
             return "XYPlane ";
         }
 
+        // get type
+        [[nodiscard]] ShapeType get_type() const noexcept override
+        {
+            return ShapeType::XYPlane;
+        }
+
         // serialize all data to a nlohmann json string object
         [[nodiscard]] std::string to_json() const noexcept
         {
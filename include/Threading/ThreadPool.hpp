@@ -0,0 +1,207 @@
+#pragma once
+
+#include "Constants.hpp"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace COAL
+{
+    /**
+     * @brief A set of long-lived worker threads that park between jobs
+     *
+     * A job is a function that is called once on every worker with the worker's index. run() blocks until every worker returned,
+     * so the same threads are reused for every frame instead of being created and joined per render.
+     *
+     * run() is not re-entrant: a job can not run() (or parallel_for()) on its own pool, the worker would wait for itself. Such a call
+     * throws std::logic_error instead of deadlocking. Jobs may use a different pool.
+     */
+    struct ThreadPool
+    {
+        /**
+         * @brief Construct a new Thread Pool object
+         *
+         * @param thread_count The number of workers, values below 1 use one worker
+         * @param pin_threads Pin worker i to core (i % kCORE_COUNT)
+         */
+        [[nodiscard]] explicit ThreadPool(const int thread_count = kCORE_COUNT, const bool pin_threads = false)
+            : m_pinned(pin_threads)
+        {
+            PROFILE_FUNCTION();
+
+            const int count = std::max(1, thread_count);
+
+            m_threads.reserve((size_t)count);
+
+            for (int i = 0; i < count; i++)
+            {
+                m_threads.emplace_back([this, i]()
+                                       { worker_loop(i); });
+
+                if (pin_threads)
+                    pin_to_core(m_threads.back(), i % std::max(1, kCORE_COUNT));
+            }
+
+            debug_print("[THREAD POOL]: ", "Started " + std::to_string(count) + " workers");
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool()
+        {
+            shutdown();
+        }
+
+        /**
+         * @brief Run a job on every worker and wait for all of them to finish
+         *
+         * @param job Called as job(worker_index) on each worker
+         * @throw std::logic_error if called from a job of this pool
+         */
+        void run(const std::function<void(int)> &job)
+        {
+            PROFILE_FUNCTION();
+
+            if (is_worker_thread())
+                throw std::logic_error("ThreadPool::run called from a job of the same pool");
+
+            std::lock_guard<std::mutex> run_lock(m_run_lock);
+
+            std::unique_lock<std::mutex> lock(m_lock);
+
+            if (m_stopping)
+                return;
+
+            m_job = &job;
+            m_pending = (int)m_threads.size();
+            m_generation++;
+
+            m_wake.notify_all();
+
+            m_done.wait(lock, [this]()
+                        { return m_pending == 0; });
+
+            m_job = nullptr;
+        }
+
+        /**
+         * @brief Split [0, count) into one contiguous chunk per worker and wait for all of them
+         *
+         * @param fn Called as fn(begin, end, worker_index) for every non-empty chunk, the chunks only depend on count and the worker count
+         * @throw std::logic_error if called from a job of this pool
+         */
+        void parallel_for(const size_t count, const std::function<void(size_t, size_t, int)> &fn)
+        {
+            const size_t workers = m_threads.size();
+
+            run([&](const int worker)
+                {
+                    const size_t begin = count * (size_t)worker / workers;
+                    const size_t end = count * (size_t)(worker + 1) / workers;
+
+                    if (begin < end)
+                        fn(begin, end, worker); });
+        }
+
+        // stop and join every worker, called by the destructor
+        void shutdown()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+
+                if (m_stopping)
+                    return;
+
+                m_stopping = true;
+            }
+
+            m_wake.notify_all();
+
+            for (auto &thread : m_threads)
+                if (thread.joinable())
+                    thread.join();
+
+            debug_print("[THREAD POOL]: ", "Stopped");
+        }
+
+        // true on the threads of this pool, where run() must not be called
+        [[nodiscard]] bool is_worker_thread() const noexcept
+        {
+            return current_pool() == this;
+        }
+
+        // getters
+        [[nodiscard]] int get_thread_count() const noexcept { return (int)m_threads.size(); }
+        [[nodiscard]] bool is_pinned() const noexcept { return m_pinned; }
+
+    private:
+        // the pool the calling thread works for, nullptr on threads outside of every pool
+        [[nodiscard]] static const ThreadPool *&current_pool() noexcept
+        {
+            thread_local const ThreadPool *pool = nullptr;
+            return pool;
+        }
+
+        void worker_loop(const int index)
+        {
+            current_pool() = this;
+
+            uint64_t seen_generation = 0;
+
+            while (true)
+            {
+                const std::function<void(int)> *job = nullptr;
+
+                {
+                    std::unique_lock<std::mutex> lock(m_lock);
+
+                    m_wake.wait(lock, [&]()
+                                { return m_stopping || m_generation != seen_generation; });
+
+                    if (m_stopping)
+                        return;
+
+                    seen_generation = m_generation;
+                    job = m_job;
+                }
+
+                (*job)(index);
+
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+
+                    if (--m_pending == 0)
+                        m_done.notify_one();
+                }
+            }
+        }
+
+        static void pin_to_core([[maybe_unused]] std::thread &thread, [[maybe_unused]] const int core)
+        {
+#if defined(_WIN32)
+            SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(static_cast<size_t>(core), &set);
+            pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set);
+#endif
+        }
+
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_run_lock;
+        std::mutex m_lock;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+
+        const std::function<void(int)> *m_job = nullptr;
+        uint64_t m_generation = 0;
+        int m_pending = 0;
+        bool m_stopping = false;
+        bool m_pinned = false;
+    };
+} // namespace COAL
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Constants.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief A rectangular block of pixels, [x0, x1) x [y0, y1)
+     *
+     */
+    struct Tile
+    {
+        int m_x0;
+        int m_y0;
+        int m_x1;
+        int m_y1;
+    };
+
+    /**
+     * @brief Time a render worker spent tracing tiles versus waiting for work
+     *
+     */
+    struct WorkerStats
+    {
+        float m_busy_ms = 0;
+        float m_idle_ms = 0;
+        int m_tiles = 0;
+        int m_stolen_tiles = 0;
+    };
+
+    /**
+     * @brief Hands out image tiles to render workers with work stealing
+     *
+     * Every worker owns a deque that starts with a contiguous run of tiles. Workers take tiles from the front of their own deque and,
+     * once it is empty, steal from the back of the other workers' deques, so threads that landed on cheap tiles keep helping the others.
+     */
+    struct TileScheduler
+    {
+        [[nodiscard]] TileScheduler(const int width, const int height, const int tile_size, const int worker_count)
+            : m_queues(static_cast<size_t>(std::max(1, worker_count)))
+        {
+            PROFILE_FUNCTION();
+
+            const int size = std::max(1, tile_size);
+            const int tiles_x = (width + size - 1) / size;
+            const int tiles_y = (height + size - 1) / size;
+            const int tile_count = tiles_x * tiles_y;
+            const int queue_count = (int)m_queues.size();
+
+            for (int i = 0; i < tile_count; i++)
+            {
+                int tx = i % tiles_x;
+                int ty = i / tiles_x;
+
+                Tile tile{tx * size, ty * size, std::min(width, (tx + 1) * size), std::min(height, (ty + 1) * size)};
+
+                // contiguous runs keep neighbouring tiles (and their cache lines) on the same worker
+                m_queues[(size_t)((long long)i * queue_count / tile_count)].m_tiles.emplace_back(tile);
+            }
+        }
+
+        /**
+         * @brief Get the next tile for a worker
+         *
+         * @param worker The index of the calling worker
+         * @param tile Output, the tile to render
+         * @param stolen Output, true if the tile was taken from another worker
+         * @return false once every tile was handed out
+         */
+        [[nodiscard]] bool next_tile(const int worker, Tile &tile, bool &stolen)
+        {
+            const int queue_count = (int)m_queues.size();
+
+            {
+                WorkerQueue &own = m_queues[(size_t)worker];
+                std::lock_guard<std::mutex> lock(own.m_lock);
+
+                if (!own.m_tiles.empty())
+                {
+                    tile = own.m_tiles.front();
+                    own.m_tiles.pop_front();
+                    stolen = false;
+                    return true;
+                }
+            }
+
+            for (int i = 1; i < queue_count; i++)
+            {
+                WorkerQueue &victim = m_queues[(size_t)((worker + i) % queue_count)];
+                std::lock_guard<std::mutex> lock(victim.m_lock);
+
+                if (!victim.m_tiles.empty())
+                {
+                    tile = victim.m_tiles.back();
+                    victim.m_tiles.pop_back();
+                    stolen = true;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        [[nodiscard]] int get_worker_count() const noexcept
+        {
+            return (int)m_queues.size();
+        }
+
+    private:
+        struct WorkerQueue
+        {
+            std::mutex m_lock;
+            std::deque<Tile> m_tiles;
+        };
+
+        std::vector<WorkerQueue> m_queues;
+    };
+} // namespace COAL
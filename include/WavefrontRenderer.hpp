@@ -0,0 +1,656 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Intersection.hpp"
+#include "Profiling/RenderCounters.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "World.hpp"
+
+namespace COAL
+{
+    /**
+     * @brief Where the wavefront renderer spent its time, summed over the tiles (and workers) of a render
+     *
+     */
+    struct WavefrontStats
+    {
+        double m_generate_ms = 0;
+        double m_sort_ms = 0;
+        double m_intersect_ms = 0;
+        // preparing the hits and queueing their shadow rays
+        double m_queue_shadow_ms = 0;
+        double m_shadow_ms = 0;
+        double m_shade_ms = 0;
+        double m_resolve_ms = 0;
+
+        // closest hit rays (primary, reflected and refracted) and shadow rays that went through the stages
+        uint64_t m_rays = 0;
+        uint64_t m_shadow_rays = 0;
+
+        // the most bounce levels a tile needed
+        int m_levels = 0;
+
+        void reset() noexcept
+        {
+            *this = WavefrontStats();
+        }
+
+        WavefrontStats &operator+=(const WavefrontStats &other) noexcept
+        {
+            m_generate_ms += other.m_generate_ms;
+            m_sort_ms += other.m_sort_ms;
+            m_intersect_ms += other.m_intersect_ms;
+            m_queue_shadow_ms += other.m_queue_shadow_ms;
+            m_shadow_ms += other.m_shadow_ms;
+            m_shade_ms += other.m_shade_ms;
+            m_resolve_ms += other.m_resolve_ms;
+            m_rays += other.m_rays;
+            m_shadow_rays += other.m_shadow_rays;
+            m_levels = std::max(m_levels, other.m_levels);
+
+            return *this;
+        }
+
+        [[nodiscard]] nlohmann::json to_json() const
+        {
+            nlohmann::json json;
+
+            json["generate_ms"] = m_generate_ms;
+            json["sort_ms"] = m_sort_ms;
+            json["intersect_ms"] = m_intersect_ms;
+            json["queue_shadow_ms"] = m_queue_shadow_ms;
+            json["shadow_ms"] = m_shadow_ms;
+            json["shade_ms"] = m_shade_ms;
+            json["resolve_ms"] = m_resolve_ms;
+            json["rays"] = m_rays;
+            json["shadow_rays"] = m_shadow_rays;
+            json["levels"] = m_levels;
+
+            return json;
+        }
+    };
+
+    /**
+     * @brief Rays waiting for the next stage, stored component by component
+     *
+     * m_index tells the stage where the ray's result goes. Every queued ray starts at t = 0, m_t_max is its far end (the light of a
+     * shadow ray).
+     */
+    struct RayQueue
+    {
+        std::vector<float> m_origin_x, m_origin_y, m_origin_z;
+        std::vector<float> m_direction_x, m_direction_y, m_direction_z;
+        std::vector<float> m_t_max;
+        std::vector<uint32_t> m_index;
+
+        void clear() noexcept
+        {
+            m_origin_x.clear();
+            m_origin_y.clear();
+            m_origin_z.clear();
+            m_direction_x.clear();
+            m_direction_y.clear();
+            m_direction_z.clear();
+            m_t_max.clear();
+            m_index.clear();
+        }
+
+        void push(const Ray &ray, const uint32_t index)
+        {
+            m_origin_x.emplace_back(ray.m_origin.x);
+            m_origin_y.emplace_back(ray.m_origin.y);
+            m_origin_z.emplace_back(ray.m_origin.z);
+            m_direction_x.emplace_back(ray.m_direction.x);
+            m_direction_y.emplace_back(ray.m_direction.y);
+            m_direction_z.emplace_back(ray.m_direction.z);
+            m_t_max.emplace_back(ray.m_t_max);
+            m_index.emplace_back(index);
+        }
+
+        [[nodiscard]] Ray get_ray(const size_t i) const noexcept
+        {
+            return Ray(Point(m_origin_x[i], m_origin_y[i], m_origin_z[i]), Vector(m_direction_x[i], m_direction_y[i], m_direction_z[i]), 0, m_t_max[i]);
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return m_index.size();
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return m_index.empty();
+        }
+
+        /**
+         * @brief Group the rays by the signs of their direction, keeping their order inside an octant
+         *
+         * Rays of one octant visit the BVH children in the same order and hit the same sides of the shapes.
+         *
+         * @param scratch Receives the old contents, its buffers are reused
+         */
+        void sort_by_octant(RayQueue &scratch)
+        {
+            const size_t count = size();
+
+            size_t offsets[8] = {};
+
+            auto octant = [&](const size_t i)
+            {
+                return (m_direction_x[i] < 0 ? 1 : 0) | (m_direction_y[i] < 0 ? 2 : 0) | (m_direction_z[i] < 0 ? 4 : 0);
+            };
+
+            for (size_t i = 0; i < count; i++)
+                offsets[octant(i)]++;
+
+            // already sorted if every ray shares one octant, common for primary rays
+            if (std::find(std::begin(offsets), std::end(offsets), count) != std::end(offsets))
+                return;
+
+            for (size_t i = 0, start = 0; i < 8; i++)
+                start += std::exchange(offsets[i], start);
+
+            scratch.resize(count);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                const size_t to = offsets[octant(i)]++;
+
+                scratch.m_origin_x[to] = m_origin_x[i];
+                scratch.m_origin_y[to] = m_origin_y[i];
+                scratch.m_origin_z[to] = m_origin_z[i];
+                scratch.m_direction_x[to] = m_direction_x[i];
+                scratch.m_direction_y[to] = m_direction_y[i];
+                scratch.m_direction_z[to] = m_direction_z[i];
+                scratch.m_t_max[to] = m_t_max[i];
+                scratch.m_index[to] = m_index[i];
+            }
+
+            swap(scratch);
+        }
+
+        void resize(const size_t count)
+        {
+            m_origin_x.resize(count);
+            m_origin_y.resize(count);
+            m_origin_z.resize(count);
+            m_direction_x.resize(count);
+            m_direction_y.resize(count);
+            m_direction_z.resize(count);
+            m_t_max.resize(count);
+            m_index.resize(count);
+        }
+
+        void swap(RayQueue &other) noexcept
+        {
+            m_origin_x.swap(other.m_origin_x);
+            m_origin_y.swap(other.m_origin_y);
+            m_origin_z.swap(other.m_origin_z);
+            m_direction_x.swap(other.m_direction_x);
+            m_direction_y.swap(other.m_direction_y);
+            m_direction_z.swap(other.m_direction_z);
+            m_t_max.swap(other.m_t_max);
+            m_index.swap(other.m_index);
+        }
+    };
+
+    /**
+     * @brief Traces a batch of primary rays breadth first, one bounce level at a time
+     *
+     * Every level runs the same stages over all of its rays: sort the rays by direction octant, find their closest hits, sort the
+     * hits by material, queue a shadow ray per hit and light, test the shadow rays, light the hits and queue their reflected and
+     * refracted rays as the next level. Each ray leaves a path node with its direct light and the indices of its child rays, once
+     * the last level is done the nodes are resolved from the deepest level up. The resolve repeats World::shade_hit's arithmetic in
+     * the same order, so the colors are the ones the recursive World::color_at returns.
+     *
+     * The buffers are kept between batches, use one renderer per thread (local()).
+     */
+    struct WavefrontRenderer
+    {
+        // the renderer of the calling thread
+        [[nodiscard]] static WavefrontRenderer &local()
+        {
+            thread_local WavefrontRenderer renderer;
+            return renderer;
+        }
+
+        /**
+         * @brief Start a batch with count primary rays
+         *
+         * @param ray_for_index Called as ray_for_index(i) for i in [0, count), the color of ray i is get_color(i) after trace()
+         */
+        template <typename Function>
+        void generate(const size_t count, Function &&ray_for_index)
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            m_level_count = 0;
+            m_queue.clear();
+            m_material_ids.clear();
+            m_materials.clear();
+
+            // the primary rays start outside of every shape, every node starts with medium 0
+            m_media.clear();
+            m_media.emplace_back(MediumStack::vacuum());
+
+            std::vector<PathNode> &nodes = next_level();
+            nodes.resize(count);
+
+            for (size_t i = 0; i < count; i++)
+                m_queue.push(ray_for_index(i), (uint32_t)i);
+
+            m_stats.m_generate_ms += elapsed_ms(start);
+        }
+
+        /**
+         * @brief Run the stages level by level and resolve the colors of the primary rays
+         *
+         * @param w The world, its max depth limits the levels like it limits the recursion
+         * @param packets Find the closest hits of neighbouring queue entries as SIMD packets
+         */
+        void trace(const World &w, const bool packets)
+        {
+            PROFILE_FUNCTION();
+
+            for (int level = 0; !m_queue.empty(); level++)
+            {
+                m_stats.m_rays += m_queue.size();
+
+                sort_rays(m_queue);
+                intersect(w, packets);
+                sort_hits();
+                queue_shadow_rays(w, level);
+                sort_rays(m_shadow_queue);
+                test_shadow_rays(w, packets);
+                shade(w, level);
+            }
+
+            m_stats.m_levels = std::max(m_stats.m_levels, (int)m_level_count);
+
+            resolve();
+        }
+
+        // the color of primary ray i of the last trace
+        [[nodiscard]] const Color &get_color(const size_t i) const noexcept
+        {
+            return m_levels[0][i].m_color;
+        }
+
+        [[nodiscard]] WavefrontStats &get_stats() noexcept
+        {
+            return m_stats;
+        }
+
+    private:
+        /**
+         * @brief What a ray of one level contributes to its parent
+         *
+         * Rays that missed keep a null material and resolve to black. The children index the next level, -1 where shade_hit would
+         * have used a black reflected or refracted color.
+         */
+        struct PathNode
+        {
+            const Material *m_material = nullptr;
+            Color m_direct;
+            Color m_color;
+            float m_reflectance = 0;
+            int32_t m_reflection = -1;
+            int32_t m_refraction = -1;
+            // the shapes the ray travels inside of, an index into m_media
+            uint32_t m_medium = 0;
+        };
+
+        // the closest hit of a queued ray
+        struct Hit
+        {
+            const Shape *m_shape;
+            // the shape of an instance's group that was hit
+            const Shape *m_geometry;
+            float m_t;
+            // the triangle of a mesh that was hit
+            uint32_t m_primitive;
+            uint32_t m_queue_index;
+            // equal materials share an id, set by sort_hits
+            uint32_t m_material;
+        };
+
+        [[nodiscard]] static double elapsed_ms(const std::chrono::steady_clock::time_point start) noexcept
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // a cleared node list for the next level, the lists of earlier batches keep their capacity
+        [[nodiscard]] std::vector<PathNode> &next_level()
+        {
+            if (m_level_count == m_levels.size())
+                m_levels.emplace_back();
+
+            std::vector<PathNode> &nodes = m_levels[m_level_count++];
+            nodes.clear();
+
+            return nodes;
+        }
+
+        void sort_rays(RayQueue &queue)
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            queue.sort_by_octant(m_scratch_queue);
+
+            m_stats.m_sort_ms += elapsed_ms(start);
+        }
+
+        // closest hit of every queued ray, the hits are collected in m_hits
+        void intersect(const World &w, const bool packets)
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            m_hits.clear();
+
+            const BVH &bvh = w.get_bvh();
+            const size_t count = m_queue.size();
+            size_t i = 0;
+
+            if (packets)
+            {
+                for (; i + kPacketSize <= count; i += kPacketSize)
+                {
+                    RayPacket packet{};
+
+                    for (int lane = 0; lane < kPacketSize; lane++)
+                        packet.set_ray(lane, m_queue.get_ray(i + (size_t)lane));
+
+                    bvh.closest_hit(packet);
+
+                    for (int lane = 0; lane < kPacketSize; lane++)
+                    {
+                        COUNT_RAY_RESULT(packet.m_hit[lane] != nullptr);
+
+                        if (packet.m_hit[lane])
+                            m_hits.push_back({packet.m_hit[lane], packet.m_geometry[lane], packet.m_t[lane], packet.m_primitive[lane], (uint32_t)(i + (size_t)lane), 0});
+                    }
+                }
+            }
+
+            // the rest, or every ray without packets
+            for (; i < count; i++)
+            {
+                const Intersection hit = bvh.closest_hit(m_queue.get_ray(i));
+
+                COUNT_RAY_RESULT(hit.m_t >= 0);
+
+                if (hit.m_t >= 0)
+                    m_hits.push_back({hit.m_object, hit.m_geometry, hit.m_t, hit.m_primitive, (uint32_t)i, 0});
+            }
+
+            m_stats.m_intersect_ms += elapsed_ms(start);
+        }
+
+        /**
+         * @brief The id of a shape's material, shapes with equal materials (and the same pattern) get the same id
+         *
+         * Ids are handed out in the order the materials are first hit in the batch, so they do not depend on where the shapes were allocated.
+         */
+        [[nodiscard]] uint32_t material_id(const Shape &shape)
+        {
+            const auto [entry, inserted] = m_material_ids.try_emplace(&shape, 0);
+
+            if (!inserted)
+                return entry->second;
+
+            const Material &material = shape.get_material();
+            uint32_t id = 0;
+
+            while (id < m_materials.size() && !(*m_materials[id] == material && m_materials[id]->get_pattern() == material.get_pattern()))
+                id++;
+
+            if (id == m_materials.size())
+                m_materials.push_back(&material);
+
+            entry->second = id;
+
+            return id;
+        }
+
+        // hits on the same material are shaded one after the other
+        void sort_hits()
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            // neighbouring rays mostly hit the same shape, only look the id up when the shape changes
+            const Shape *last_shape = nullptr;
+            uint32_t last_id = 0;
+
+            for (Hit &hit : m_hits)
+            {
+                if (hit.m_shape != last_shape)
+                {
+                    last_shape = hit.m_shape;
+                    last_id = material_id(*hit.m_shape);
+                }
+
+                hit.m_material = last_id;
+            }
+
+            std::sort(m_hits.begin(), m_hits.end(), [](const Hit &a, const Hit &b)
+                      { return a.m_material != b.m_material ? a.m_material < b.m_material : a.m_queue_index < b.m_queue_index; });
+
+            m_stats.m_sort_ms += elapsed_ms(start);
+        }
+
+        // prepare every hit and queue its shadow rays, ray (hit, light) writes its result to m_shadowed[hit * lights + light]
+        void queue_shadow_rays(const World &w, const int level)
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            const auto &lights = w.get_lights();
+
+            m_computations.clear();
+            m_shadow_queue.clear();
+
+            const std::vector<PathNode> &nodes = m_levels[(size_t)level];
+
+            for (const Hit &hit : m_hits)
+            {
+                const Ray ray = m_queue.get_ray(hit.m_queue_index);
+                const Intersection intersection(hit.m_t, *hit.m_shape, hit.m_geometry, hit.m_primitive);
+                const MediumStack &media = m_media[nodes[m_queue.m_index[hit.m_queue_index]].m_medium];
+
+                const Computation &comp = m_computations.emplace_back(intersection.prepare_computation(ray, media));
+
+                for (const auto &light : lights)
+                    m_shadow_queue.push(World::shadow_ray(comp.m_over_point, *light), (uint32_t)m_shadow_queue.size());
+            }
+
+            m_stats.m_queue_shadow_ms += elapsed_ms(start);
+        }
+
+        void test_shadow_rays(const World &w, const bool packets)
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            m_shadowed.assign(m_shadow_queue.size(), 0);
+
+            const size_t count = m_shadow_queue.size();
+            size_t i = 0;
+
+            // the rays end at their light, a closest hit query finds a hit exactly when the any-hit query would
+            if (packets)
+            {
+                const BVH &bvh = w.get_bvh();
+
+                for (; i + kPacketSize <= count; i += kPacketSize)
+                {
+                    RayPacket packet{};
+
+                    for (int lane = 0; lane < kPacketSize; lane++)
+                        packet.set_ray(lane, m_shadow_queue.get_ray(i + (size_t)lane));
+
+                    bvh.closest_hit(packet);
+
+                    for (int lane = 0; lane < kPacketSize; lane++)
+                        m_shadowed[m_shadow_queue.m_index[i + (size_t)lane]] = packet.m_hit[lane] ? 1 : 0;
+                }
+            }
+
+            for (; i < count; i++)
+                m_shadowed[m_shadow_queue.m_index[i]] = w.is_occluded(m_shadow_queue.get_ray(i)) ? 1 : 0;
+
+            m_stats.m_shadow_rays += m_shadow_queue.size();
+            m_stats.m_shadow_ms += elapsed_ms(start);
+        }
+
+        // light the hits of a level and queue their secondary rays as the next level
+        void shade(const World &w, const int level)
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            // color_at -> shade_hit -> reflected_color raises the recursion level by two per bounce
+            const int depth = 2 * level;
+            const int max_depth = w.get_max_depth();
+
+            const auto &lights = w.get_lights();
+            const size_t light_count = lights.size();
+
+            m_next_queue.clear();
+
+            std::vector<PathNode> *next_nodes = nullptr;
+
+            auto spawn = [&](const Ray &ray, const uint32_t medium)
+            {
+                if (!next_nodes)
+                    next_nodes = &next_level();
+
+                const auto index = (uint32_t)next_nodes->size();
+
+                next_nodes->emplace_back().m_medium = medium;
+                m_next_queue.push(ray, index);
+
+                return (int32_t)index;
+            };
+
+            // the level's nodes are looked up after spawning, next_level() may move the node lists
+            const size_t node_level = (size_t)level;
+
+            for (size_t h = 0; h < m_hits.size(); h++)
+            {
+                const Computation &comp = m_computations[h];
+                const Material &mat = comp.m_s->get_material();
+
+                Color res;
+
+                for (size_t l = 0; l < light_count; l++)
+                {
+                    COUNT_RAY(RayKind::Shadow, depth);
+
+                    const bool in_shadow = m_shadowed[h * light_count + l] != 0;
+
+                    COUNT_SHADOW_RESULT(in_shadow);
+
+                    res = res + mat.lighting(*lights[l], *comp.m_s, comp.m_over_point, comp.m_eye_vector, comp.m_normal_vector, in_shadow);
+                }
+
+                const uint32_t medium = m_levels[node_level][m_queue.m_index[m_hits[h].m_queue_index]].m_medium;
+
+                int32_t reflection = -1;
+                int32_t refraction = -1;
+
+                if (mat.get_reflectiveness() > 0 && depth + 1 < max_depth)
+                {
+                    COUNT_RAY(RayKind::Reflection, depth + 1);
+
+                    reflection = spawn(Ray(comp.m_over_point, comp.m_reflection_vector), medium);
+                }
+                else if (mat.get_reflectiveness() > 0)
+                    COUNT_MAX_DEPTH();
+
+                if (World::refracts(mat) && depth + 1 < max_depth)
+                {
+                    Ray refracted_ray(comp.m_under_point, Vector());
+
+                    if (World::refraction_ray(comp, refracted_ray))
+                    {
+                        COUNT_RAY(RayKind::Refraction, depth + 1);
+
+                        m_media.emplace_back(comp.m_media->crossed(*comp.m_s));
+
+                        refraction = spawn(refracted_ray, (uint32_t)(m_media.size() - 1));
+                    }
+                }
+                else if (World::refracts(mat))
+                    COUNT_MAX_DEPTH();
+
+                PathNode &node = m_levels[node_level][m_queue.m_index[m_hits[h].m_queue_index]];
+
+                node.m_material = &mat;
+                node.m_direct = res;
+                node.m_reflectance = World::reflectance(comp);
+                node.m_reflection = reflection;
+                node.m_refraction = refraction;
+            }
+
+            m_queue.swap(m_next_queue);
+
+            m_stats.m_shade_ms += elapsed_ms(start);
+        }
+
+        // fold the levels back into the primary rays, deepest level first
+        void resolve()
+        {
+            PROFILE_FUNCTION();
+
+            const auto start = std::chrono::steady_clock::now();
+
+            for (size_t level = m_level_count; level-- > 0;)
+            {
+                for (PathNode &node : m_levels[level])
+                {
+                    if (!node.m_material)
+                    {
+                        node.m_color = Color(0, 0, 0);
+                        continue;
+                    }
+
+                    const Material &mat = *node.m_material;
+
+                    Color reflection_map = node.m_reflection >= 0 ? m_levels[level + 1][(size_t)node.m_reflection].m_color * mat.get_reflectiveness() : Color();
+                    Color refraction_map = node.m_refraction >= 0 ? m_levels[level + 1][(size_t)node.m_refraction].m_color * mat.get_transparency() : Color();
+
+                    node.m_color = World::mix_secondary(mat, node.m_direct, reflection_map, refraction_map, node.m_reflectance);
+                }
+            }
+
+            m_stats.m_resolve_ms += elapsed_ms(start);
+        }
+
+        std::vector<std::vector<PathNode>> m_levels;
+        size_t m_level_count = 0;
+
+        RayQueue m_queue;
+        RayQueue m_next_queue;
+        RayQueue m_shadow_queue;
+        RayQueue m_scratch_queue;
+
+        std::vector<Hit> m_hits;
+        // the material ids of the shapes hit in this batch, and the first material of every id
+        std::unordered_map<const Shape *, uint32_t> m_material_ids;
+        std::vector<const Material *> m_materials;
+        std::vector<Computation> m_computations;
+        // the media of the batch's rays, a deque so the computations can point into it while refracted rays add to it
+        std::deque<MediumStack> m_media;
+        std::vector<uint8_t> m_shadowed;
+
+        WavefrontStats m_stats;
+    };
+} // namespace COAL
@@ -1,13 +1,21 @@
 #pragma once
 
+#include "Accelerators/BVH.hpp"
 #include "Computation.hpp"
 #include "Constants.hpp"
 #include "Intersection.hpp"
 #include "Lights/Light.hpp"
 #include "Lights/PointLight.hpp"
 #include "Matrix.hpp"
+#include "MediumStack.hpp"
+#include "Memory/ScratchArena.hpp"
+#include "MeshLoader.hpp"
+#include "Profiling/RenderCounters.hpp"
+#include "Shapes/Instance.hpp"
+#include "Shapes/Mesh.hpp"
 #include "Shapes/Shape.hpp"
 #include "Shapes/Sphere.hpp"
+#include "Threading/ThreadPool.hpp"
 #include "Tuples/Color.hpp"
 #include "Tuples/Point.hpp"
 #include "Tuples/Vector.hpp"
@@ -25,99 +33,171 @@ namespace COAL
 
             std::shared_ptr<Sphere> sphere = std::make_shared<Sphere>(Sphere());
             sphere->set_material(Material(Color(0.8f, 1, 0.6f), -1.0f, 0.7f, 0.2f, -1.0f, nullptr, 0.0f, -1.0f, -1.0f));
-            m_shapes.emplace_back(sphere);
+            insert_shape(sphere);
 
             std::shared_ptr<Sphere> sphere2 = std::make_shared<Sphere>(Sphere());
             sphere2->scale(0.5, 0.5, 0.5);
-            m_shapes.emplace_back(sphere2);
+            insert_shape(sphere2);
 
             auto light = std::make_shared<PointLight>(PointLight());
             light->set_intensity(Color(1, 1, 1)).set_position(Point(-10, 10, -10));
             m_lights.emplace_back(light);
+
+            rebuild_acceleration();
         }
 
         [[nodiscard]] std::vector<Intersection> intersects(const Ray &ray) const
         {
             PROFILE_FUNCTION();
 
-            std::vector<Intersection> res;
+            ArenaScope scope;
+            ArenaVector<Intersection> xs;
 
-            for (const auto &shape : m_shapes)
-            {
-                Intersection shape_xs = shape->intersects(ray);
-                if (shape_xs.m_t > 0)
-                    res.emplace_back(shape_xs);
-            }
+            intersects(ray, xs);
 
-            // lamda std::vector sort
-            std::sort(res.begin(), res.end(), [](const Intersection &a, const Intersection &b)
-                      { return a.m_t < b.m_t; });
+            return std::vector<Intersection>(xs.begin(), xs.end());
+        }
+
+        // collect every intersection, sorted by distance, into a list backed by the thread's scratch arena
+        void intersects(const Ray &ray, ArenaVector<Intersection> &xs) const
+        {
+            PROFILE_FUNCTION();
 
-            return res;
+            m_bvh.all_hits(ray, [&](const Intersection &shape_xs)
+                           { xs.push_back(shape_xs); });
+
+            // lamda sort
+            std::sort(xs.begin(), xs.end(), [](const Intersection &a, const Intersection &b)
+                      { return a.m_t < b.m_t; });
         }
 
         [[nodiscard]] bool is_shadowed(const Point &point, const Light &light) const
         {
             PROFILE_FUNCTION();
 
+            return is_occluded(shadow_ray(point, light));
+        }
+
+        // the ray from a point toward a light, it ends at the light so only shapes in between cast a shadow
+        [[nodiscard]] static Ray shadow_ray(const Point &point, const Light &light)
+        {
             Vector v = light.m_position - point;
             float distance = v.magnitude();
             Vector direction = v.normalize();
 
-            Ray ray(point, direction);
-            auto xs = intersects(ray);
-
-            Intersection hit = Intersection::hit(xs);
+            return Ray(point, direction, 0, distance);
+        }
 
-            if (hit.m_t >= 0 && hit.m_t < distance)
-                return true;
+        // any-hit query, true if a shape blocks the ray inside its range
+        [[nodiscard]] bool is_occluded(const Ray &ray) const
+        {
+            PROFILE_FUNCTION();
 
-            return false;
+            return m_bvh.any_hit(ray);
         }
 
+        // the color seen along a ray that starts outside of every shape
         [[nodiscard]] Color color_at(const Ray &ray, const int recursion_level = 0) const
+        {
+            return color_at(ray, MediumStack::vacuum(), recursion_level);
+        }
+
+        // the color seen along a ray that travels inside the shapes of media
+        [[nodiscard]] Color color_at(const Ray &ray, const MediumStack &media, const int recursion_level) const
         {
             PROFILE_FUNCTION();
 
-            auto xs = intersects(ray);
-            Intersection hit = Intersection::hit(xs);
+            Intersection hit = m_bvh.closest_hit(ray);
+
+            COUNT_RAY_RESULT(hit.m_t >= 0);
 
             if (hit.m_t < 0)
                 return Color(0, 0, 0);
 
-            Computation comps = hit.prepare_computation(ray, xs);
+            Computation comps = hit.prepare_computation(ray, media);
 
             return shade_hit(comps, recursion_level);
         }
 
+        /**
+         * @brief color_at for the primary rays of a packet
+         *
+         * The closest hits are found for the whole packet, the hit lanes are then shaded one by one like color_at does it.
+         *
+         * @param packet The rays, their closest hits are written into it
+         * @param colors Receives the color of every active lane
+         */
+        void color_at(RayPacket &packet, Color (&colors)[kPacketSize]) const
+        {
+            PROFILE_FUNCTION();
+
+            m_bvh.closest_hit(packet);
+
+            for (int lane = 0; lane < kPacketSize; lane++)
+            {
+                if (!(packet.m_active & (1u << lane)))
+                    continue;
+
+                COUNT_RAY_RESULT(packet.m_hit[lane] != nullptr);
+
+                if (!packet.m_hit[lane])
+                {
+                    colors[lane] = Color(0, 0, 0);
+                    continue;
+                }
+
+                const Ray ray = packet.get_ray(lane);
+                const Intersection hit(packet.m_t[lane], *packet.m_hit[lane], packet.m_geometry[lane], packet.m_primitive[lane]);
+
+                Computation comps = hit.prepare_computation(ray, MediumStack::vacuum());
+
+                colors[lane] = shade_hit(comps, 0);
+            }
+        }
+
         [[nodiscard]] Color shade_hit(const Computation &comp, const int depth = 0) const
         {
+            PROFILE_FUNCTION();
 
             Color res;
 
+            const Material &mat = comp.m_s->get_material();
+
+            // direct lighting is summed over the lights
             for (const auto &light : m_lights)
             {
+                COUNT_RAY(RayKind::Shadow, depth);
+
                 bool in_shadow = is_shadowed(comp.m_over_point, *light);
 
-                res = res + comp.m_s->get_material().lighting(
-                                *light, *comp.m_s, comp.m_over_point, comp.m_eye_vector, comp.m_normal_vector, in_shadow);
+                COUNT_SHADOW_RESULT(in_shadow);
 
-                Color reflection_map = reflected_color(comp, depth + 1);
+                res = res + mat.lighting(*light, *comp.m_s, comp.m_over_point, comp.m_eye_vector, comp.m_normal_vector, in_shadow);
+            }
 
-                Color refraction_map = refraction_color(comp, depth + 1);
+            // while the secondary rays are traced once per hit, independent of the light count
+            Color reflection_map = reflected_color(comp, depth + 1);
 
-                Material mat = comp.m_s->get_material();
+            Color refraction_map = refraction_color(comp, depth + 1);
 
-                if (mat.get_reflectiveness() > 0 && mat.get_transparency() > 0)
-                {
-                    float reflectiveness = comp.schilck();
+            return mix_secondary(mat, res, reflection_map, refraction_map, reflectance(comp));
+        }
 
-                    res = res + reflection_map * (1 - reflectiveness) + refraction_map * (1 - reflectiveness);
-                }
-                else
-                    res = res + reflection_map + refraction_map;
-            }
-            return res;
+        // the reflection's share when a material both reflects and refracts (Schlick's approximation), mix_secondary ignores it otherwise
+        [[nodiscard]] static float reflectance(const Computation &comp)
+        {
+            const Material &mat = comp.m_s->get_material();
+
+            return mat.get_reflectiveness() > 0 && mat.get_transparency() > 0 ? comp.schilck() : 0;
+        }
+
+        // add the reflected and refracted colors to the direct light
+        [[nodiscard]] static Color mix_secondary(const Material &mat, const Color &direct, const Color &reflection_map, const Color &refraction_map, const float reflectance)
+        {
+            if (mat.get_reflectiveness() > 0 && mat.get_transparency() > 0)
+                return direct + reflection_map * reflectance + refraction_map * (1 - reflectance);
+
+            return direct + reflection_map + refraction_map;
         }
 
         [[nodiscard]] Color reflected_color(const Computation &comp, const int recursion_level = 0) const
@@ -126,11 +206,16 @@ namespace COAL
 
             if (comp.m_s->get_material().get_reflectiveness() > 0 && recursion_level < MAX_DEPTH)
             {
+                COUNT_RAY(RayKind::Reflection, recursion_level);
+
                 Ray reflected_ray = Ray(comp.m_over_point, comp.m_reflection_vector);
-                Color reflected_color = color_at(reflected_ray, recursion_level + 1);
+                Color reflected_color = color_at(reflected_ray, *comp.m_media, recursion_level + 1);
                 return reflected_color * comp.m_s->get_material().get_reflectiveness();
             }
 
+            if (comp.m_s->get_material().get_reflectiveness() > 0)
+                COUNT_MAX_DEPTH();
+
             return Color();
         }
 
@@ -138,39 +223,142 @@ namespace COAL
         {
             PROFILE_FUNCTION();
 
-            if (comp.m_s->get_material().get_refractive_index() > 0 && recursion_level < MAX_DEPTH)
+            if (refracts(comp.m_s->get_material()) && recursion_level < MAX_DEPTH)
             {
-                float n_ratio = comp.m_inside ? comp.m_n1 / comp.m_n2 : comp.m_n2 / comp.m_n1;
+                Ray refracted_ray(comp.m_under_point, Vector());
 
-                float cos_i = comp.m_eye_vector.dot(comp.m_normal_vector);
-
-                float sin2_t = (n_ratio * n_ratio * (1.0f - cos_i * cos_i));
-
-                if (sin2_t > 1.0)
+                if (!refraction_ray(comp, refracted_ray))
                     return Color();
 
-                float cos_t = (float)sqrt(1.0 - sin2_t);
+                COUNT_RAY(RayKind::Refraction, recursion_level);
 
-                Vector direction = comp.m_normal_vector * (n_ratio * cos_i - cos_t) - comp.m_eye_vector * n_ratio;
+                // the refracted ray is on the other side of the hit surface
+                const MediumStack media = comp.m_media->crossed(*comp.m_s);
 
-                Ray refracted_ray = Ray(comp.m_under_point, direction);
-
-                return color_at(refracted_ray, recursion_level + 1) * comp.m_s->get_material().get_transparency();
+                return color_at(refracted_ray, media, recursion_level + 1) * comp.m_s->get_material().get_transparency();
             }
 
+            if (refracts(comp.m_s->get_material()))
+                COUNT_MAX_DEPTH();
+
             return Color();
         }
 
-        // add shapes
-        void add_shape(const std::shared_ptr<Shape> &shape)
+        // true if a material lets light through, an opaque one would only scale its refracted color by 0
+        [[nodiscard]] static bool refracts(const Material &mat)
         {
-            m_shapes.emplace_back(shape);
+            return mat.get_transparency() > 0 && mat.get_refractive_index() > 0;
+        }
+
+        // the ray Snell's law bends into the hit shape (or out of it), false on total internal reflection
+        [[nodiscard]] static bool refraction_ray(const Computation &comp, Ray &ray)
+        {
+            float n_ratio = comp.m_n1 / comp.m_n2;
+
+            float cos_i = comp.m_eye_vector.dot(comp.m_normal_vector);
+
+            float sin2_t = (n_ratio * n_ratio * (1.0f - cos_i * cos_i));
+
+            if (sin2_t > 1.0f)
+                return false;
+
+            float cos_t = static_cast<float>(std::sqrt(1.0 - static_cast<double>(sin2_t)));
+
+            Vector direction = comp.m_normal_vector * (n_ratio * cos_i - cos_t) - comp.m_eye_vector * n_ratio;
+
+            ray = Ray(comp.m_under_point, direction);
+
+            return true;
+        }
+
+        /**
+         * @brief Add a shape and give it an id
+         *
+         * @return The shape's id, it stays the same until the shape is removed and may be given to another shape after that
+         */
+        uint32_t add_shape(const std::shared_ptr<Shape> &shape)
+        {
+            insert_shape(shape);
+
+            update_acceleration();
+
+            return get_id(*shape);
         }
 
         // add shapes
         void add_shapes(const std::vector<std::shared_ptr<Shape>> &shapes)
         {
-            m_shapes.insert(m_shapes.end(), shapes.begin(), shapes.end());
+            for (const auto &shape : shapes)
+                insert_shape(shape);
+
+            update_acceleration();
+        }
+
+        // rebuild the BVH, the cached pattern matrices and the id table, has to be called after shapes were edited through get_shapes()
+        void rebuild_acceleration()
+        {
+            PROFILE_FUNCTION();
+
+            reindex_shapes();
+
+            update_acceleration();
+        }
+
+        // the transform of the shape changed, refit_acceleration() brings the BVH up to date
+        void mark_dirty(const uint32_t id)
+        {
+            if (contains_shape(id))
+                m_dirty_ids.emplace_back(id);
+        }
+
+        /**
+         * @brief Refit the BVH to the shapes marked dirty since the last update
+         *
+         * Far cheaper than rebuild_acceleration() when a few shapes moved, the BVH only rebuilds the parts whose quality dropped too far
+         * (get_bvh().get_update_stats() tells what it did). Shapes added or removed through get_shapes() still need rebuild_acceleration().
+         */
+        void refit_acceleration()
+        {
+            PROFILE_FUNCTION();
+
+            if (m_dirty_ids.empty())
+                return;
+
+            std::vector<uint32_t> slots;
+            slots.reserve(m_dirty_ids.size());
+
+            for (const uint32_t id : m_dirty_ids)
+                if (contains_shape(id))
+                    slots.emplace_back(m_shape_slots[id]);
+
+            std::sort(slots.begin(), slots.end());
+            slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+
+            m_bvh.refit(m_shapes, slots);
+
+            m_dirty_ids.clear();
+        }
+
+        // build the BVH and load meshes on the workers of the pool, the render pool can be shared since builds never overlap a render
+        void set_thread_pool(const std::shared_ptr<ThreadPool> &pool)
+        {
+            m_thread_pool = pool;
+            m_bvh.set_thread_pool(pool.get());
+        }
+
+        [[nodiscard]] ThreadPool *get_thread_pool() const noexcept
+        {
+            return m_thread_pool.get();
+        }
+
+        [[nodiscard]] const BVH &get_bvh() const
+        {
+            return m_bvh;
+        }
+
+        [[nodiscard]] BVH &get_bvh()
+        {
+            return m_bvh;
         }
 
         // add light
@@ -210,17 +398,64 @@ namespace COAL
                 m_lights.erase(m_lights.begin() + index);
         }
 
+        // the shapes are removed without building the BVH again, the shapes behind the removed one move up a slot so get_shapes() keeps its order
         void remove_shape(const std::shared_ptr<Shape> &shape)
         {
-            auto it = std::find(m_shapes.begin(), m_shapes.end(), shape);
-            if (it != m_shapes.end())
-                m_shapes.erase(it);
+            if (shape)
+                remove_shape_by_id(get_id(*shape));
         }
 
         void remove_shape(const int index)
         {
-            if (index < m_shapes.size())
-                m_shapes.erase(m_shapes.begin() + index);
+            if (index >= 0 && (size_t)index < m_shapes.size())
+                erase_shape((uint32_t)index);
+        }
+
+        void remove_shape_by_id(const uint32_t id)
+        {
+            if (contains_shape(id))
+                erase_shape(m_shape_slots[id]);
+        }
+
+        /**
+         * @brief The id this world gave a shape
+         *
+         * The shape carries the id it was last given, which is checked against the id table. The ids belong to the world: a shape shared
+         * by worlds that gave it different ids is searched for in the table of the world that did not write the shape's id last.
+         *
+         * @return kInvalidShapeId if the shape is not part of the world
+         */
+        [[nodiscard]] uint32_t get_id(const Shape &shape) const noexcept
+        {
+            const uint32_t id = shape.m_id;
+
+            // a shape no world gave an id to
+            if (id == kInvalidShapeId)
+                return kInvalidShapeId;
+
+            if (id < m_id_shapes.size() && m_id_shapes[id] == &shape)
+                return id;
+
+            const auto it = std::find(m_id_shapes.begin(), m_id_shapes.end(), &shape);
+
+            return it != m_id_shapes.end() ? (uint32_t)(it - m_id_shapes.begin()) : kInvalidShapeId;
+        }
+
+        [[nodiscard]] bool contains_shape(const uint32_t id) const noexcept
+        {
+            return id < m_shape_slots.size() && m_shape_slots[id] != kInvalidShapeId;
+        }
+
+        // the shape with the id, nullptr if there is none
+        [[nodiscard]] Shape *find_shape(const uint32_t id) const noexcept
+        {
+            return contains_shape(id) ? m_shapes[m_shape_slots[id]].get() : nullptr;
+        }
+
+        // every id is below this bound, tables indexed by shape id need this many entries
+        [[nodiscard]] size_t get_shape_id_bound() const noexcept
+        {
+            return m_shape_slots.size();
         }
 
         // get shapes
@@ -264,6 +499,27 @@ namespace COAL
                 shapes_json.emplace_back(nlohmann::json::parse(shape->to_json()));
             json["shapes"] = shapes_json;
 
+            // every group is written once, before the instances that refer to it
+            std::vector<const GeometryGroup *> groups;
+            nlohmann::json groups_json = nlohmann::json::array();
+
+            for (const auto &shape : m_shapes)
+            {
+                if (shape->get_type() != ShapeType::Instance)
+                    continue;
+
+                const GeometryGroup *group = static_cast<const Instance &>(*shape).get_group().get();
+
+                if (std::find(groups.begin(), groups.end(), group) != groups.end())
+                    continue;
+
+                groups.emplace_back(group);
+                groups_json.emplace_back(nlohmann::json::parse(group->to_json()));
+            }
+
+            if (!groups.empty())
+                json["groups"] = groups_json;
+
             return json.dump();
         }
 
@@ -271,7 +527,7 @@ namespace COAL
         void from_json(const std::string &json_string)
         {
 
-            m_shapes.clear();
+            clear_shapes();
             m_lights.clear();
 
             nlohmann::json json = nlohmann::json::parse(json_string);
@@ -286,24 +542,213 @@ namespace COAL
                 }
             }
 
+            // every mesh file is loaded once, the meshes showing it share the triangles
+            std::unordered_map<std::string, std::shared_ptr<const MeshData>> meshes;
+
+            // the groups are built before the instances placing them
+            std::unordered_map<std::string, std::shared_ptr<const GeometryGroup>> groups;
+
+            if (json.contains("groups"))
+            {
+                for (const auto &group_json : json["groups"])
+                {
+                    std::vector<std::shared_ptr<Shape>> group_shapes;
+
+                    for (const auto &shape_json : group_json["shapes"])
+                        if (auto shape = shape_from_json(shape_json, meshes))
+                            group_shapes.emplace_back(shape);
+
+                    const std::string name = group_json["name"];
+                    groups[name] = std::make_shared<GeometryGroup>(name, std::move(group_shapes));
+                }
+            }
+
+            // the shapes get their ids in file order, patches of a scene can refer to them by id
             for (const auto &shape_json : json["shapes"])
             {
-                if (shape_json["type"] == "Sphere")
-                    m_shapes.emplace_back(Sphere::from_json(shape_json.dump()));
-                else if (shape_json["type"] == "XZPlane")
-                    m_shapes.emplace_back(XZPlane::from_json(shape_json.dump()));
-                else if (shape_json["type"] == "YZPlane")
-                    m_shapes.emplace_back(YZPlane::from_json(shape_json.dump()));
-                else if (shape_json["type"] == "XYPlane")
-                    m_shapes.emplace_back(XYPlane::from_json(shape_json.dump()));
-                if (shape_json["type"] == "Cube")
-                    m_shapes.emplace_back(Cube::from_json(shape_json.dump()));
+                if (shape_json["type"] == "Instance")
+                {
+                    auto group = groups.find(shape_json["group"]);
+
+                    if (group != groups.end())
+                        insert_shape(Instance::from_json(shape_json.dump(), group->second));
+                }
+                else if (auto shape = shape_from_json(shape_json, meshes))
+                {
+                    insert_shape(shape);
+                }
             }
+
+            update_acceleration();
         }
 
     private:
+        // a shape that is not an instance, nullptr for an unknown type or a mesh file that can not be read
+        [[nodiscard]] std::shared_ptr<Shape> shape_from_json(const nlohmann::json &shape_json, std::unordered_map<std::string, std::shared_ptr<const MeshData>> &meshes) const
+        {
+            if (shape_json["type"] == "Sphere")
+                return Sphere::from_json(shape_json.dump());
+            if (shape_json["type"] == "XZPlane")
+                return XZPlane::from_json(shape_json.dump());
+            if (shape_json["type"] == "YZPlane")
+                return YZPlane::from_json(shape_json.dump());
+            if (shape_json["type"] == "XYPlane")
+                return XYPlane::from_json(shape_json.dump());
+            if (shape_json["type"] == "Cube")
+                return Cube::from_json(shape_json.dump());
+
+            if (shape_json["type"] == "Mesh")
+            {
+                const std::string file = shape_json["file"];
+                auto &data = meshes[file];
+
+                if (!data)
+                    data = MeshLoader::load(file, m_thread_pool.get());
+
+                if (!data)
+                    return nullptr;
+
+                return Mesh::from_json(shape_json.dump(), data);
+            }
+
+            return nullptr;
+        }
+
+        // the cached pattern matrices and the BVH
+        void update_acceleration()
+        {
+            PROFILE_FUNCTION();
+
+            // patterns may have been swapped or edited in place
+            for (const auto &shape : m_shapes)
+                shape->update_pattern_transform();
+
+            m_bvh.build(m_shapes);
+
+            m_dirty_ids.clear();
+        }
+
+        // append a shape with a fresh id, a shape that is already part of the world is skipped
+        void insert_shape(const std::shared_ptr<Shape> &shape)
+        {
+            if (get_id(*shape) != kInvalidShapeId)
+                return;
+
+            const uint32_t id = allocate_id();
+
+            m_shape_slots[id] = (uint32_t)m_shapes.size();
+            m_id_shapes[id] = shape.get();
+            shape->m_id = id;
+
+            m_shapes.emplace_back(shape);
+        }
+
+        // the most recently freed id, or a new one if none is free
+        [[nodiscard]] uint32_t allocate_id()
+        {
+            if (m_free_ids.empty())
+            {
+                m_shape_slots.emplace_back(kInvalidShapeId);
+                m_id_shapes.emplace_back(nullptr);
+                return (uint32_t)(m_shape_slots.size() - 1);
+            }
+
+            const uint32_t id = m_free_ids.back();
+            m_free_ids.pop_back();
+
+            return id;
+        }
+
+        // take the shape out of the slot and the BVH, the shapes behind it move up a slot and the removed shape's id is freed
+        void erase_shape(const uint32_t slot)
+        {
+            Shape &shape = *m_shapes[slot];
+            const uint32_t id = get_id(shape);
+
+            m_shape_slots[id] = kInvalidShapeId;
+            m_id_shapes[id] = nullptr;
+            m_free_ids.emplace_back(id);
+
+            if (shape.m_id == id)
+                shape.m_id = kInvalidShapeId;
+
+            m_bvh.erase(slot, shape);
+
+            m_shapes.erase(m_shapes.begin() + slot);
+
+            for (size_t i = slot; i < m_shapes.size(); i++)
+                m_shape_slots[get_id(*m_shapes[i])] = static_cast<uint32_t>(i);
+        }
+
+        void clear_shapes()
+        {
+            for (const auto &shape : m_shapes)
+                if (get_id(*shape) == shape->m_id)
+                    shape->m_id = kInvalidShapeId;
+
+            m_shapes.clear();
+            m_shape_slots.clear();
+            m_id_shapes.clear();
+            m_free_ids.clear();
+        }
+
+        // rebuild the id table after get_shapes() was edited, the shapes keep their places and the ones that were in the world their ids
+        void reindex_shapes()
+        {
+            // the ids from before the edit, the table still describes the old shapes
+            std::vector<uint32_t> ids(m_shapes.size(), kInvalidShapeId);
+
+            for (size_t slot = 0; slot < m_shapes.size(); slot++)
+                ids[slot] = get_id(*m_shapes[slot]);
+
+            std::fill(m_shape_slots.begin(), m_shape_slots.end(), kInvalidShapeId);
+            std::fill(m_id_shapes.begin(), m_id_shapes.end(), nullptr);
+
+            for (size_t slot = 0; slot < m_shapes.size(); slot++)
+            {
+                // a shape listed twice keeps its id in the first slot only
+                if (ids[slot] != kInvalidShapeId && !m_id_shapes[ids[slot]])
+                {
+                    m_shape_slots[ids[slot]] = (uint32_t)slot;
+                    m_id_shapes[ids[slot]] = m_shapes[slot].get();
+                }
+                else
+                    ids[slot] = kInvalidShapeId;
+            }
+
+            // the lowest free id is handed out first
+            m_free_ids.clear();
+
+            for (size_t id = m_shape_slots.size(); id-- > 0;)
+                if (m_shape_slots[id] == kInvalidShapeId)
+                    m_free_ids.emplace_back((uint32_t)id);
+
+            for (size_t slot = 0; slot < m_shapes.size(); slot++)
+            {
+                Shape &shape = *m_shapes[slot];
+
+                if (ids[slot] == kInvalidShapeId)
+                {
+                    ids[slot] = allocate_id();
+                    m_shape_slots[ids[slot]] = (uint32_t)slot;
+                    m_id_shapes[ids[slot]] = &shape;
+                }
+
+                if (get_id(shape) == ids[slot])
+                    shape.m_id = ids[slot];
+            }
+        }
+
         std::vector<std::shared_ptr<Shape>> m_shapes;
+        // the slot of every id in m_shapes and its shape (kInvalidShapeId and nullptr for freed ids), and the freed ids
+        std::vector<uint32_t> m_shape_slots;
+        std::vector<const Shape *> m_id_shapes;
+        std::vector<uint32_t> m_free_ids;
+        // shapes moved since the last BVH update
+        std::vector<uint32_t> m_dirty_ids;
         std::vector<std::shared_ptr<Light>> m_lights;
+        BVH m_bvh;
+        std::shared_ptr<ThreadPool> m_thread_pool;
         int MAX_DEPTH = 7;
     };
 
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <COAL.hpp>
+
+#include <iomanip>
+
+#include <Profiling/AllocationCounter.hpp>
+
+namespace COAL::Bench
+{
+    /**
+     * @brief How a benchmark is repeated
+     *
+     */
+    struct BenchmarkConfig
+    {
+        int m_warmup = 3;
+        int m_repetitions = 15;
+        std::string m_filter;
+    };
+
+    /**
+     * @brief Summary of the repetitions of one benchmark, times are per operation
+     *
+     */
+    struct BenchmarkResult
+    {
+        std::string m_name;
+        size_t m_ops = 0;
+        bool m_is_ray_kernel = false;
+
+        double m_mean_ns = 0;
+        double m_median_ns = 0;
+        double m_stddev_ns = 0;
+        double m_min_ns = 0;
+        double m_max_ns = 0;
+        double m_allocations_per_op = 0;
+
+        // operations (rays for ray kernels) per second at the median time
+        [[nodiscard]] double ops_per_second() const noexcept
+        {
+            return m_median_ns > 0 ? 1e9 / m_median_ns : 0;
+        }
+
+        [[nodiscard]] nlohmann::json to_json() const
+        {
+            nlohmann::json json;
+
+            json["name"] = m_name;
+            json["ops"] = m_ops;
+            json["mean_ns"] = m_mean_ns;
+            json["median_ns"] = m_median_ns;
+            json["stddev_ns"] = m_stddev_ns;
+            json["min_ns"] = m_min_ns;
+            json["max_ns"] = m_max_ns;
+            json["allocations_per_op"] = m_allocations_per_op;
+            json[m_is_ray_kernel ? "rays_per_second" : "ops_per_second"] = ops_per_second();
+
+            return json;
+        }
+    };
+
+    // keeps the optimizer from dropping the benchmarked work
+    inline volatile float g_sink = 0;
+
+    /**
+     * @brief Time a kernel
+     *
+     * @param name The name reported in the results and matched against baselines
+     * @param ops How many operations one call of the kernel performs
+     * @param is_ray_kernel Report rays per second instead of operations per second
+     * @param kernel Runs the operations and returns a checksum of their results
+     */
+    template <typename Kernel>
+    [[nodiscard]] BenchmarkResult run_benchmark(const BenchmarkConfig &config, const std::string &name, const size_t ops, const bool is_ray_kernel, Kernel &&kernel)
+    {
+        BenchmarkResult result;
+        result.m_name = name;
+        result.m_ops = ops;
+        result.m_is_ray_kernel = is_ray_kernel;
+
+        for (int i = 0; i < config.m_warmup; i++)
+            g_sink = g_sink + kernel();
+
+        std::vector<double> samples;
+        samples.reserve((size_t)config.m_repetitions);
+
+        AllocationScope allocations;
+
+        for (int i = 0; i < std::max(1, config.m_repetitions); i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            g_sink = g_sink + kernel();
+
+            auto end = std::chrono::steady_clock::now();
+
+            samples.emplace_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)ops);
+        }
+
+        result.m_allocations_per_op = (double)allocations.allocations() / (double)(samples.size() * ops);
+
+        std::sort(samples.begin(), samples.end());
+
+        const size_t count = samples.size();
+
+        double sum = 0;
+
+        for (double sample : samples)
+            sum += sample;
+
+        result.m_mean_ns = sum / (double)count;
+        result.m_median_ns = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+        result.m_min_ns = samples.front();
+        result.m_max_ns = samples.back();
+
+        double variance = 0;
+
+        for (double sample : samples)
+            variance += (sample - result.m_mean_ns) * (sample - result.m_mean_ns);
+
+        result.m_stddev_ns = count > 1 ? std::sqrt(variance / (double)(count - 1)) : 0;
+
+        return result;
+    }
+
+    /**
+     * @brief Collects benchmark results and compares them against a baseline
+     *
+     */
+    struct BenchmarkSuite
+    {
+        [[nodiscard]] explicit BenchmarkSuite(const BenchmarkConfig &config) : m_config(config) {}
+
+        // run a benchmark unless the filter excludes it
+        template <typename Kernel>
+        void add(const std::string &name, const size_t ops, const bool is_ray_kernel, Kernel &&kernel)
+        {
+            if (!m_config.m_filter.empty() && name.find(m_config.m_filter) == std::string::npos)
+                return;
+
+            m_results.emplace_back(run_benchmark(m_config, name, ops, is_ray_kernel, std::forward<Kernel>(kernel)));
+
+            print_result(m_results.back());
+        }
+
+        /**
+         * @brief Compare the median times against a previous run
+         *
+         * @param baseline The JSON written by an earlier run
+         * @param threshold The allowed slowdown, 0.1 allows 10%
+         * @return int The number of benchmarks that regressed
+         */
+        int compare(const nlohmann::json &baseline, const double threshold)
+        {
+            std::unordered_map<std::string, double> baseline_medians;
+
+            for (const auto &entry : baseline.at("benchmarks"))
+                baseline_medians[entry.at("name").get<std::string>()] = entry.at("median_ns").get<double>();
+
+            int regressions = 0;
+
+            std::cerr << "\nBaseline comparison (median, threshold " << threshold * 100 << "%)\n";
+
+            for (const auto &result : m_results)
+            {
+                auto it = baseline_medians.find(result.m_name);
+
+                if (it == baseline_medians.end() || it->second <= 0)
+                {
+                    std::cerr << "  " << std::left << std::setw(36) << result.m_name << " no baseline\n";
+                    continue;
+                }
+
+                const double ratio = result.m_median_ns / it->second;
+                const bool regressed = ratio > 1 + threshold;
+
+                regressions += regressed ? 1 : 0;
+
+                m_comparison[result.m_name] = {{"baseline_median_ns", it->second}, {"ratio", ratio}, {"regressed", regressed}};
+
+                std::cerr << "  " << std::left << std::setw(36) << result.m_name << std::right << std::fixed << std::setprecision(3)
+                          << std::setw(8) << ratio << "x" << (regressed ? "  REGRESSION" : "") << "\n";
+            }
+
+            return regressions;
+        }
+
+        [[nodiscard]] nlohmann::json to_json() const
+        {
+            nlohmann::json json;
+
+            json["warmup"] = m_config.m_warmup;
+            json["repetitions"] = m_config.m_repetitions;
+            json["allocation_counter"] = AllocationCounter::is_enabled();
+            json["benchmarks"] = nlohmann::json::array();
+
+            for (const auto &result : m_results)
+            {
+                nlohmann::json entry = result.to_json();
+
+                if (m_comparison.contains(result.m_name))
+                    entry["baseline"] = m_comparison.at(result.m_name);
+
+                json["benchmarks"].push_back(entry);
+            }
+
+            return json;
+        }
+
+        [[nodiscard]] const std::vector<BenchmarkResult> &get_results() const noexcept
+        {
+            return m_results;
+        }
+
+    private:
+        static void print_result(const BenchmarkResult &result)
+        {
+            std::cerr << std::left << std::setw(36) << result.m_name << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(12) << result.m_median_ns << " ns/op"
+                      << " +-" << std::setw(8) << result.m_stddev_ns
+                      << std::setw(14) << std::setprecision(0) << result.ops_per_second() << (result.m_is_ray_kernel ? " rays/s" : " ops/s ")
+                      << std::setw(8) << std::setprecision(2) << result.m_allocations_per_op << " allocs/op\n";
+        }
+
+        BenchmarkConfig m_config;
+        std::vector<BenchmarkResult> m_results;
+        std::unordered_map<std::string, nlohmann::json> m_comparison;
+    };
+} // namespace COAL::Bench
@@ -0,0 +1,530 @@
+#define COAL_ALLOCATION_COUNTER_IMPLEMENTATION
+#include "Benchmark.hpp"
+#include "SceneBenchmark.hpp"
+
+#ifndef COAL_SOURCE_DIR
+#define COAL_SOURCE_DIR "."
+#endif
+
+namespace
+{
+    using namespace COAL;
+    using namespace COAL::Bench;
+
+    struct Options
+    {
+        BenchmarkConfig m_config;
+        size_t m_ray_count = 4096;
+        uint32_t m_seed = 1337;
+        double m_threshold = 0.1;
+        std::string m_baseline_file;
+        std::string m_output_file;
+
+        bool m_run_scenes = false;
+        SceneBenchmarkConfig m_scene_config;
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: coal_bench [options]\n"
+                  << "\n"
+                  << "Options:\n"
+                  << "  --warmup <n>         untimed runs before measuring (default: 3)\n"
+                  << "  --repetitions <n>    timed runs per benchmark (default: 15)\n"
+                  << "  --rays <n>           size of the random ray set (default: 4096)\n"
+                  << "  --seed <n>           seed of the random ray set (default: 1337)\n"
+                  << "  --filter <text>      only run benchmarks whose name contains text\n"
+                  << "  --baseline <file>    compare against the JSON of an earlier run\n"
+                  << "  --threshold <f>      allowed slowdown against the baseline (default: 0.1)\n"
+                  << "  --output <file>      write the JSON there instead of stdout\n"
+                  << "\n"
+                  << "Scene benchmarks (end-to-end renders at 1, 2, 4 ... threads, checked against golden images):\n"
+                  << "  --scenes             run the scene benchmarks instead of the kernels\n"
+                  << "  --width <n>          render width (default: 200)\n"
+                  << "  --height <n>         render height (default: 150)\n"
+                  << "  --max-threads <n>    highest thread count (default: every core)\n"
+                  << "  --psnr <dB>          lowest PSNR accepted against a golden image (default: 50)\n"
+                  << "  --scene-dir <dir>    directory of the scene files (default: bin/x64)\n"
+                  << "  --golden-dir <dir>   directory of the golden images (default: bin/x64/Goldens)\n"
+                  << "  --update-goldens     write the single threaded renders as the new golden images\n"
+                  << "  --wavefront          render the scenes in wavefront mode\n"
+                  << "\n"
+                  << "Exits with 3 if a kernel is slower than the baseline allows and with 4 if a scene does not match its golden image.\n";
+    }
+
+    [[nodiscard]] bool parse_arguments(const int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+
+            auto next = [&]() -> std::string
+            {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("missing value for " + arg);
+
+                return argv[++i];
+            };
+
+            if (arg == "--help" || arg == "-h")
+            {
+                print_usage();
+                return false;
+            }
+            else if (arg == "--warmup")
+                options.m_config.m_warmup = std::stoi(next());
+            else if (arg == "--repetitions")
+                options.m_config.m_repetitions = std::stoi(next());
+            else if (arg == "--rays")
+                options.m_ray_count = std::stoul(next());
+            else if (arg == "--seed")
+                options.m_seed = (uint32_t)std::stoul(next());
+            else if (arg == "--filter")
+                options.m_config.m_filter = next();
+            else if (arg == "--baseline")
+                options.m_baseline_file = next();
+            else if (arg == "--threshold")
+                options.m_threshold = std::stod(next());
+            else if (arg == "--output")
+                options.m_output_file = next();
+            else if (arg == "--scenes")
+                options.m_run_scenes = true;
+            else if (arg == "--width")
+                options.m_scene_config.m_width = std::stoi(next());
+            else if (arg == "--height")
+                options.m_scene_config.m_height = std::stoi(next());
+            else if (arg == "--max-threads")
+                options.m_scene_config.m_max_threads = std::stoi(next());
+            else if (arg == "--psnr")
+                options.m_scene_config.m_psnr_threshold = std::stod(next());
+            else if (arg == "--scene-dir")
+                options.m_scene_config.m_scene_directory = next();
+            else if (arg == "--golden-dir")
+                options.m_scene_config.m_golden_directory = next();
+            else if (arg == "--update-goldens")
+                options.m_scene_config.m_update_goldens = true;
+            else if (arg == "--wavefront")
+                options.m_scene_config.m_wavefront = true;
+            else
+                throw std::runtime_error("unknown option " + arg);
+        }
+
+        // the scene benchmarks share the repetitions and filter of the kernels
+        options.m_scene_config.m_repetitions = std::min(options.m_config.m_repetitions, 3);
+        options.m_scene_config.m_filter = options.m_config.m_filter;
+
+        return true;
+    }
+
+    /**
+     * @brief The fixed random inputs every kernel runs on
+     *
+     * Rays start on a sphere of radius 6 around the origin and aim at points near it, so most of them hit the benchmark shapes.
+     */
+    struct BenchmarkData
+    {
+        BenchmarkData(const size_t count, const uint32_t seed)
+        {
+            std::mt19937 generator(seed);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+            // drawn in a braced list so the order (and the data) does not depend on the compiler
+            auto random_vector = [&]()
+            {
+                const float values[3] = {unit(generator), unit(generator), unit(generator)};
+                return Vector(values[0], values[1], values[2]);
+            };
+
+            for (size_t i = 0; i < count; i++)
+            {
+                Vector on_sphere = random_vector().normalize() * 6.0f;
+                Point origin = Point(on_sphere.x, on_sphere.y, on_sphere.z);
+                Point target = Point(0, 0, 0) + random_vector() * 1.5f;
+
+                m_rays.emplace_back(origin, (target - origin).normalize());
+
+                Vector translation = random_vector();
+                Vector rotation = random_vector();
+                Vector scale = random_vector();
+
+                Matrix4 transform = IDENTITY.translate(translation.x, translation.y, translation.z)
+                                        .rotate(rotation.x, rotation.y, rotation.z)
+                                        .scale(1.5f + scale.x, 1.5f + scale.y, 1.5f + scale.z);
+
+                m_matrices.emplace_back(transform);
+            }
+        }
+
+        std::vector<Ray> m_rays;
+        std::vector<Matrix4> m_matrices;
+    };
+
+    // the scene of the editor's default world
+    [[nodiscard]] World default_world()
+    {
+        World world;
+
+        auto floor = std::make_shared<XZPlane>(XZPlane());
+        floor->get_material().set_color(Color(1.0f, 0.9f, 0.9f)).set_specular(0).set_reflectiveness(0.3f);
+
+        auto middle_sphere = std::make_shared<Sphere>(Sphere());
+        middle_sphere->get_material().set_color(Color(0.0f, 0.0f, 0.0f)).set_specular(1).set_diffuse(0.1f).set_reflectiveness(0.3f).set_shininess(200).set_transparency(1);
+        middle_sphere->translate(-0.5f, 1.0f, 0.5f);
+
+        auto right_sphere = std::make_shared<Sphere>(Sphere());
+        right_sphere->get_material().set_color(Color(0.5f, 1.0f, 0.1f)).set_specular(0.3f).set_diffuse(0.7f).set_reflectiveness(0.3f);
+        right_sphere->translate(1.5f, 0.5f, -0.5f).scale(0.5f, 0.5f, 0.5f);
+
+        auto left_sphere = std::make_shared<Sphere>(Sphere());
+        left_sphere->get_material().set_color(Color(1, 0.8f, 0.1f)).set_specular(0.3f).set_diffuse(0.7f).set_reflectiveness(0.3f);
+        left_sphere->translate(-1.5f, 0.33f, -0.75f).scale(0.33f, 0.33f, 0.33f);
+
+        auto light = std::make_shared<PointLight>(PointLight());
+        light->set_intensity(Color(255, 255, 255)).set_position(Point(-10, 10, -10));
+
+        world.add_shapes({floor, middle_sphere, right_sphere, left_sphere});
+        world.add_lights({light});
+
+        return world;
+    }
+
+    template <typename ShapeType>
+    void add_intersection_benchmark(BenchmarkSuite &suite, const std::string &name, const ShapeType &shape, const BenchmarkData &data)
+    {
+        suite.add(name, data.m_rays.size(), true, [&]()
+                  {
+                      float checksum = 0;
+
+                      for (const auto &ray : data.m_rays)
+                          checksum += shape.intersects(ray).m_t;
+
+                      return checksum; });
+    }
+
+    // a unit sphere of segments * rings * 2 triangles, the mesh kernel renders the same shape as the sphere kernel
+    [[nodiscard]] std::shared_ptr<const MeshData> sphere_mesh(const uint32_t segments, const uint32_t rings)
+    {
+        std::vector<Point> positions;
+        std::vector<uint32_t> indices;
+
+        for (uint32_t r = 0; r <= rings; r++)
+        {
+            for (uint32_t s = 0; s < segments; s++)
+            {
+                const float theta = std::numbers::pi_v<float> * (float)r / (float)rings;
+                const float phi = 2.0f * std::numbers::pi_v<float> * (float)s / (float)segments;
+
+                positions.emplace_back(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            }
+        }
+
+        for (uint32_t r = 0; r < rings; r++)
+        {
+            for (uint32_t s = 0; s < segments; s++)
+            {
+                const uint32_t a = r * segments + s;
+                const uint32_t b = r * segments + (s + 1) % segments;
+                const uint32_t c = a + segments;
+                const uint32_t d = b + segments;
+
+                indices.insert(indices.end(), {a, b, c, b, d, c});
+            }
+        }
+
+        return std::make_shared<const MeshData>(std::move(positions), std::move(indices));
+    }
+
+    void run_kernels(BenchmarkSuite &suite, const BenchmarkData &data)
+    {
+        const size_t count = data.m_rays.size();
+
+        // shapes with a non-trivial transform, like the ones of a real scene
+        Sphere sphere;
+        sphere.translate(0.2f, 0.1f, -0.3f).scale(1.2f, 0.8f, 1.0f);
+
+        Cube cube;
+        cube.translate(-0.1f, 0.2f, 0.1f).scale(0.9f, 1.1f, 0.8f);
+
+        XZPlane xz_plane;
+        XYPlane xy_plane;
+        YZPlane yz_plane;
+
+        Mesh mesh(sphere_mesh(128, 64));
+        mesh.translate(0.2f, 0.1f, -0.3f).scale(1.2f, 0.8f, 1.0f);
+
+        add_intersection_benchmark(suite, "Sphere::intersects", sphere, data);
+        add_intersection_benchmark(suite, "Cube::intersects", cube, data);
+        add_intersection_benchmark(suite, "XZPlane::intersects", xz_plane, data);
+        add_intersection_benchmark(suite, "XYPlane::intersects", xy_plane, data);
+        add_intersection_benchmark(suite, "YZPlane::intersects", yz_plane, data);
+        add_intersection_benchmark(suite, "Mesh::intersects", mesh, data);
+
+        // a 3x3x3 grid of spheres placed twice, the packet kernel has to find the same hits as the scalar one
+        std::vector<std::shared_ptr<COAL::Shape>> grid_shapes;
+
+        for (int x = -1; x <= 1; x++)
+            for (int y = -1; y <= 1; y++)
+                for (int z = -1; z <= 1; z++)
+                {
+                    auto grid_sphere = std::make_shared<Sphere>(Sphere());
+                    grid_sphere->translate(0.6f * (float)x, 0.6f * (float)y, 0.6f * (float)z).scale(0.25f, 0.25f, 0.25f);
+                    grid_shapes.emplace_back(grid_sphere);
+                }
+
+        Instance instance(std::make_shared<const GeometryGroup>("grid", grid_shapes));
+        instance.translate(0.1f, -0.2f, 0.1f).scale(1.3f, 1.0f, 1.2f);
+
+        add_intersection_benchmark(suite, "Instance::intersects", instance, data);
+
+        // packets want coherent rays, these come from a pinhole at z = -6 in blocks of kPacketWidth x kPacketHeight pixels like the camera's
+        const int side = std::max(1, (int)std::sqrt((double)count) / kPacketWidth * kPacketWidth);
+        std::vector<Ray> camera_rays;
+        std::vector<RayPacket> packets;
+
+        for (int y0 = 0; y0 < side; y0 += kPacketHeight)
+        {
+            for (int x0 = 0; x0 < side; x0 += kPacketWidth)
+            {
+                RayPacket &packet = packets.emplace_back();
+
+                for (int lane = 0; lane < kPacketSize; lane++)
+                {
+                    const float u = 3.0f * ((float)(x0 + lane % kPacketWidth) + 0.5f) / (float)side - 1.5f;
+                    const float v = 3.0f * ((float)(y0 + lane / kPacketWidth) + 0.5f) / (float)side - 1.5f;
+
+                    const Point origin(0, 0, -6);
+                    camera_rays.emplace_back(origin, (Point(u, v, 0) - origin).normalize());
+                    packet.set_ray(lane, camera_rays.back());
+                }
+            }
+        }
+
+        // the packet kernel has to find the hits of the scalar one
+        for (size_t i = 0; i < camera_rays.size(); i++)
+        {
+            RayPacket packet = packets[i / kPacketSize];
+            uint32_t hits = 0;
+
+            if (!instance.intersects(packet, packet.m_active, hits))
+                throw std::runtime_error("Instance has no packet kernel");
+
+            const int lane = (int)(i % kPacketSize);
+            const Ray &ray = camera_rays[i];
+            const Intersection xs = instance.intersects(ray);
+
+            const bool scalar_hit = ray.in_range(xs.m_t);
+            const bool packet_hit = (hits >> lane) & 1u;
+
+            if (scalar_hit != packet_hit || (scalar_hit && (packet.m_geometry[lane] != xs.m_geometry || std::abs(packet.m_t[lane] - xs.m_t) > 1e-4f * std::max(1.0f, xs.m_t))))
+                throw std::runtime_error("Instance packet hit of ray " + std::to_string(i) + " differs from its scalar hit");
+        }
+
+        suite.add("Instance::intersects (camera)", camera_rays.size(), true, [&]()
+                  {
+                      float checksum = 0;
+
+                      for (const auto &ray : camera_rays)
+                          checksum += instance.intersects(ray).m_t;
+
+                      return checksum; });
+
+        suite.add("Instance::intersects (packet)", camera_rays.size(), true, [&]()
+                  {
+                      float checksum = 0;
+
+                      for (const auto &source : packets)
+                      {
+                          RayPacket packet = source;
+                          uint32_t hits = 0;
+
+                          (void)instance.intersects(packet, packet.m_active, hits);
+
+                          for (int lane = 0; lane < kPacketSize; lane++)
+                              if ((hits >> lane) & 1u)
+                                  checksum += packet.m_t[lane];
+                      }
+
+                      return checksum; });
+
+        suite.add("Ray::transform", count, true, [&]()
+                  {
+                      float checksum = 0;
+
+                      for (size_t i = 0; i < count; i++)
+                          checksum += data.m_rays[i].transform(data.m_matrices[i]).m_direction.x;
+
+                      return checksum; });
+
+        suite.add("Matrix4::inverse", count, false, [&]()
+                  {
+                      float checksum = 0;
+
+                      for (const auto &matrix : data.m_matrices)
+                          checksum += matrix.inverse()(0, 3);
+
+                      return checksum; });
+
+        // the hits on the sphere are the inputs of the shading kernels
+        std::vector<std::pair<Ray, Intersection>> hits;
+
+        for (const auto &ray : data.m_rays)
+        {
+            Intersection hit = sphere.intersects(ray);
+
+            if (hit.m_object)
+                hits.emplace_back(ray, hit);
+        }
+
+        if (hits.empty())
+            return;
+
+        std::vector<Computation> computations;
+
+        for (const auto &[ray, hit] : hits)
+            computations.emplace_back(hit.prepare_computation(ray, MediumStack::vacuum()));
+
+        suite.add("Intersection::prepare_computation", hits.size(), false, [&]()
+                  {
+                      float checksum = 0;
+
+                      for (const auto &[ray, hit] : hits)
+                          checksum += hit.prepare_computation(ray, MediumStack::vacuum()).m_n2;
+
+                      return checksum; });
+
+        PointLight light;
+        light.set_intensity(Color(255, 255, 255)).set_position(Point(-10, 10, -10));
+
+        suite.add("Material::lighting", computations.size(), false, [&]()
+                  {
+                      float checksum = 0;
+
+                      for (const auto &comp : computations)
+                          checksum += sphere.get_material().lighting(light, sphere, comp.m_over_point, comp.m_eye_vector, comp.m_normal_vector, false).r;
+
+                      return checksum; });
+
+        World world = default_world();
+
+        suite.add("World::color_at", count, true, [&]()
+                  {
+                      float checksum = 0;
+
+                      for (const auto &ray : data.m_rays)
+                          checksum += world.color_at(ray).g;
+
+                      return checksum; });
+
+        // one sphere per matrix, a few of them move back and forth every iteration like shapes dragged in the editor
+        World grid;
+        std::vector<Point> positions;
+
+        for (const auto &matrix : data.m_matrices)
+        {
+            positions.emplace_back(matrix(0, 3) * 20.0f, matrix(1, 3) * 20.0f, matrix(2, 3) * 20.0f);
+
+            auto shape = std::make_shared<Sphere>(Sphere());
+            shape->translate(positions.back().x, positions.back().y, positions.back().z).scale(0.2f, 0.2f, 0.2f);
+            grid.add_shape(shape);
+        }
+
+        suite.add("BVH::build", count, false, [&]()
+                  {
+                      grid.rebuild_acceleration();
+
+                      return (float)grid.get_bvh().get_update_stats().m_sah; });
+
+        const size_t moved = std::min<size_t>(count, 16);
+        float offset = 0.5f;
+
+        suite.add("BVH::refit", moved, false, [&]()
+                  {
+                      for (size_t i = 0; i < moved; i++)
+                      {
+                          const size_t index = i * (count / moved);
+                          const auto &shape = grid.get_shapes()[index];
+
+                          shape->translate(positions[index].x + offset, positions[index].y, positions[index].z).scale(0.2f, 0.2f, 0.2f);
+                          grid.mark_dirty(grid.get_id(*shape));
+                      }
+
+                      offset = -offset;
+                      grid.refit_acceleration();
+
+                      return (float)grid.get_bvh().get_update_stats().m_sah; });
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    options.m_scene_config.m_scene_directory = (std::filesystem::path(COAL_SOURCE_DIR) / "bin" / "x64").string();
+    options.m_scene_config.m_golden_directory = (std::filesystem::path(COAL_SOURCE_DIR) / "bin" / "x64" / "Goldens").string();
+
+    try
+    {
+        if (!parse_arguments(argc, argv, options))
+            return 1;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "coal_bench: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (options.m_run_scenes)
+    {
+        int failures = 0;
+
+        nlohmann::json report = run_scene_benchmarks(options.m_scene_config, failures);
+
+        if (options.m_output_file.empty())
+            std::cout << report.dump(4) << std::endl;
+        else
+            write_file(options.m_output_file, report.dump(4));
+
+        return failures == 0 ? 0 : 4;
+    }
+
+    BenchmarkData data(std::max<size_t>(1, options.m_ray_count), options.m_seed);
+    BenchmarkSuite suite(options.m_config);
+
+    try
+    {
+        run_kernels(suite, data);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "coal_bench: " << e.what() << "\n";
+        return 1;
+    }
+
+    int regressions = 0;
+
+    if (!options.m_baseline_file.empty())
+    {
+        std::ifstream file(options.m_baseline_file);
+
+        if (!file)
+        {
+            std::cerr << "coal_bench: cannot open baseline " << options.m_baseline_file << "\n";
+            return 1;
+        }
+
+        nlohmann::json baseline;
+        file >> baseline;
+
+        regressions = suite.compare(baseline, options.m_threshold);
+    }
+
+    nlohmann::json report = suite.to_json();
+    report["rays"] = data.m_rays.size();
+    report["seed"] = options.m_seed;
+
+    if (options.m_output_file.empty())
+        std::cout << report.dump(4) << std::endl;
+    else
+        write_file(options.m_output_file, report.dump(4));
+
+    return regressions == 0 ? 0 : 3;
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+#include "Benchmark.hpp"
+
+#include <Patterns/Checker.hpp>
+#include <Profiling/MemoryUsage.hpp>
+
+namespace COAL::Bench
+{
+    /**
+     * @brief Settings of the end-to-end scene benchmarks
+     *
+     */
+    struct SceneBenchmarkConfig
+    {
+        int m_width = 200;
+        int m_height = 150;
+        int m_repetitions = 3;
+        int m_max_threads = kCORE_COUNT;
+        double m_psnr_threshold = 50;
+        bool m_update_goldens = false;
+        // render through the wavefront queues, the goldens then check it against the recursive renders
+        bool m_wavefront = false;
+        std::string m_scene_directory;
+        std::string m_golden_directory;
+        std::string m_filter;
+    };
+
+    /**
+     * @brief A scene to benchmark, either loaded from a scene file or generated
+     *
+     */
+    struct BenchmarkScene
+    {
+        std::string m_name;
+        std::function<Scene()> m_create;
+    };
+
+    // PSNR of the 8 bit images (as written by save_image/write_ppm), infinity if they are identical
+    [[nodiscard]] inline double psnr(const Color *lhs, const Color *rhs, const size_t count)
+    {
+        double squared_error = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const double dr = static_cast<double>(static_cast<uint8_t>(lhs[i].r)) - static_cast<double>(static_cast<uint8_t>(rhs[i].r));
+            const double dg = static_cast<double>(static_cast<uint8_t>(lhs[i].g)) - static_cast<double>(static_cast<uint8_t>(rhs[i].g));
+            const double db = static_cast<double>(static_cast<uint8_t>(lhs[i].b)) - static_cast<double>(static_cast<uint8_t>(rhs[i].b));
+
+            squared_error += dr * dr + dg * dg + db * db;
+        }
+
+        if (squared_error == 0)
+            return std::numeric_limits<double>::infinity();
+
+        const double mse = squared_error / static_cast<double>(count * 3);
+
+        return 10 * std::log10(255.0 * 255.0 / mse);
+    }
+
+    // 1, 2, 4 ... up to and including max_threads
+    [[nodiscard]] inline std::vector<int> thread_counts(const int max_threads)
+    {
+        std::vector<int> counts;
+
+        for (int count = 1; count < max_threads; count *= 2)
+            counts.emplace_back(count);
+
+        counts.emplace_back(std::max(1, max_threads));
+
+        return counts;
+    }
+
+    [[nodiscard]] inline Scene make_scene(const Point &from, const Point &to)
+    {
+        Scene scene(Camera(200, 150, (float)std::numbers::pi / 3), World());
+        scene.m_camera.transform(from, to, Vector(0, 1, 0));
+        scene.m_world.set_max_depth(5);
+
+        return scene;
+    }
+
+    [[nodiscard]] inline std::shared_ptr<PointLight> make_light(const Point &position, const float intensity)
+    {
+        auto light = std::make_shared<PointLight>(PointLight());
+        light->set_intensity(Color(intensity, intensity, intensity)).set_position(position);
+
+        return light;
+    }
+
+    // a 16x16 grid of spheres, half of them reflective, lit by two lights
+    [[nodiscard]] inline Scene sphere_grid_scene()
+    {
+        Scene scene = make_scene(Point(0, 7, -16), Point(0, 0, 0));
+
+        std::vector<std::shared_ptr<Shape>> shapes;
+
+        auto floor = std::make_shared<XZPlane>(XZPlane());
+        floor->get_material().set_color(Color(0.9f, 0.9f, 0.9f)).set_specular(0);
+        shapes.emplace_back(floor);
+
+        for (int z = 0; z < 16; z++)
+        {
+            for (int x = 0; x < 16; x++)
+            {
+                auto sphere = std::make_shared<Sphere>(Sphere());
+                sphere->get_material().set_color(Color(static_cast<float>(x) / 16.0f, 0.5f, static_cast<float>(z) / 16.0f)).set_reflectiveness((x + z) % 2 ? 0.4f : 0.0f);
+                sphere->translate(static_cast<float>(x) - 7.5f, 0.4f, static_cast<float>(z) - 7.5f).scale(0.4f, 0.4f, 0.4f);
+                shapes.emplace_back(sphere);
+            }
+        }
+
+        scene.m_world.add_shapes(shapes);
+        scene.m_world.add_lights({make_light(Point(-10, 10, -10), 180), make_light(Point(10, 12, -6), 120)});
+
+        return scene;
+    }
+
+    // reflective and refractive spheres over a checkered floor, every hit recurses to the maximum depth
+    [[nodiscard]] inline Scene glass_scene()
+    {
+        Scene scene = make_scene(Point(0, 3, -9), Point(0, 0.5f, 0));
+
+        std::vector<std::shared_ptr<Shape>> shapes;
+
+        Color first(1, 1, 1);
+        Color second(0.1f, 0.1f, 0.1f);
+        Matrix4 transform = IDENTITY;
+
+        auto floor = std::make_shared<XZPlane>(XZPlane());
+        floor->get_material().set_pattern(std::make_shared<Checker>(first, second, transform)).set_reflectiveness(0.2f);
+        shapes.emplace_back(floor);
+
+        for (int z = 0; z < 5; z++)
+        {
+            for (int x = 0; x < 5; x++)
+            {
+                auto sphere = std::make_shared<Sphere>(Sphere());
+                sphere->get_material().set_color(Color(0.05f, 0.05f, 0.1f)).set_diffuse(0.1f).set_specular(1).set_shininess(200).set_reflectiveness(0.9f).set_transparency(0.9f).set_refractive_index(1.5f);
+                sphere->translate(static_cast<float>(x - 2) * 1.1f, 0.5f, static_cast<float>(z - 2) * 1.1f).scale(0.5f, 0.5f, 0.5f);
+                shapes.emplace_back(sphere);
+            }
+        }
+
+        scene.m_world.add_shapes(shapes);
+        scene.m_world.add_lights({make_light(Point(-10, 10, -10), 255)});
+
+        return scene;
+    }
+
+    // a few shapes lit by eight lights, shading and shadow rays dominate
+    [[nodiscard]] inline Scene many_lights_scene()
+    {
+        Scene scene = make_scene(Point(0, 4, -10), Point(0, 0.5f, 0));
+
+        std::vector<std::shared_ptr<Shape>> shapes;
+
+        auto floor = std::make_shared<XZPlane>(XZPlane());
+        floor->get_material().set_color(Color(0.8f, 0.8f, 0.8f)).set_reflectiveness(0.2f);
+        shapes.emplace_back(floor);
+
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        for (int i = 0; i < 40; i++)
+        {
+            std::shared_ptr<Shape> shape;
+
+            if (i % 2)
+                shape = std::make_shared<Sphere>(Sphere());
+            else
+                shape = std::make_shared<Cube>(Cube());
+
+            // braced lists are evaluated in order, function arguments are not, so the scene is the same with every compiler
+            const float size = 0.2f + 0.3f * unit(generator);
+            const float color[3] = {unit(generator), unit(generator), unit(generator)};
+            const float reflectiveness = 0.3f * unit(generator);
+            const float position[2] = {8 * unit(generator) - 4, 8 * unit(generator) - 4};
+
+            shape->get_material().set_color(Color(color)).set_reflectiveness(reflectiveness);
+            shape->translate(position[0], size, position[1]).scale(size, size, size);
+            shapes.emplace_back(shape);
+        }
+
+        std::vector<std::shared_ptr<Light>> lights;
+
+        for (int i = 0; i < 8; i++)
+        {
+            const float angle = (float)i * (float)std::numbers::pi / 4;
+            lights.emplace_back(make_light(Point(8 * std::cos(angle), 6 + (float)(i % 3), 8 * std::sin(angle)), 40));
+        }
+
+        scene.m_world.add_shapes(shapes);
+        scene.m_world.add_lights(lights);
+
+        return scene;
+    }
+
+    // a thousand small cubes scattered through a volume, stresses the acceleration structure
+    [[nodiscard]] inline Scene random_cubes_scene()
+    {
+        Scene scene = make_scene(Point(0, 2, -18), Point(0, 0, 0));
+
+        std::vector<std::shared_ptr<Shape>> shapes;
+
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        for (int i = 0; i < 1000; i++)
+        {
+            auto cube = std::make_shared<Cube>(Cube());
+
+            const float color[3] = {0.5f + 0.5f * unit(generator), 0.5f + 0.5f * unit(generator), 0.5f + 0.5f * unit(generator)};
+            const float rotation[3] = {unit(generator), unit(generator), unit(generator)};
+            const float translation[3] = {8 * unit(generator), 6 * unit(generator), 8 * unit(generator)};
+            const float scale[3] = {0.2f, 0.2f, 0.2f};
+
+            cube->get_material().set_color(Color(color));
+            cube->transform(translation, rotation, scale);
+            shapes.emplace_back(cube);
+        }
+
+        scene.m_world.add_shapes(shapes);
+        scene.m_world.add_lights({make_light(Point(-10, 10, -20), 255)});
+
+        return scene;
+    }
+
+    // the shapes of a small table in its own space, standing on y = 0
+    [[nodiscard]] inline std::shared_ptr<const GeometryGroup> table_group()
+    {
+        std::vector<std::shared_ptr<Shape>> shapes;
+
+        auto top = std::make_shared<Cube>(Cube());
+        top->translate(0, 1, 0).scale(1, 0.08f, 1);
+        shapes.emplace_back(top);
+
+        for (int i = 0; i < 4; i++)
+        {
+            auto leg = std::make_shared<Cube>(Cube());
+            leg->translate((i & 1) ? 0.85f : -0.85f, 0.5f, (i & 2) ? 0.85f : -0.85f).scale(0.08f, 0.5f, 0.08f);
+            shapes.emplace_back(leg);
+        }
+
+        auto ball = std::make_shared<Sphere>(Sphere());
+        ball->translate(0, 1.38f, 0).scale(0.3f, 0.3f, 0.3f);
+        shapes.emplace_back(ball);
+
+        return std::make_shared<GeometryGroup>("Table", std::move(shapes));
+    }
+
+    // a 12x12 grid of instances of one table, turned and colored one by one
+    [[nodiscard]] inline Scene instances_scene()
+    {
+        Scene scene = make_scene(Point(0, 9, -16), Point(0, 0, 0));
+
+        std::vector<std::shared_ptr<Shape>> shapes;
+
+        auto floor = std::make_shared<XZPlane>(XZPlane());
+        floor->get_material().set_color(Color(0.9f, 0.9f, 0.9f)).set_specular(0).set_reflectiveness(0.2f);
+        shapes.emplace_back(floor);
+
+        const std::shared_ptr<const GeometryGroup> table = table_group();
+
+        for (int z = 0; z < 12; z++)
+        {
+            for (int x = 0; x < 12; x++)
+            {
+                auto instance = std::make_shared<Instance>(table);
+
+                const float translation[3] = {(static_cast<float>(x) - 5.5f) * 1.2f, 0, (static_cast<float>(z) - 5.5f) * 1.2f};
+                const float rotation[3] = {0, static_cast<float>(x * 12 + z) * 0.3f, 0};
+                const float scale[3] = {0.45f, 0.45f, 0.45f};
+
+                instance->get_material().set_color(Color(static_cast<float>(x) / 12.0f, 0.4f, static_cast<float>(z) / 12.0f)).set_reflectiveness((x + z) % 3 ? 0.0f : 0.3f);
+                instance->transform(translation, rotation, scale);
+                shapes.emplace_back(instance);
+            }
+        }
+
+        scene.m_world.add_shapes(shapes);
+        scene.m_world.add_lights({make_light(Point(-10, 12, -10), 200)});
+
+        return scene;
+    }
+
+    // the checked-in scene files followed by the generated stress scenes
+    [[nodiscard]] inline std::vector<BenchmarkScene> benchmark_scenes(const SceneBenchmarkConfig &config)
+    {
+        std::vector<BenchmarkScene> scenes;
+
+        for (const std::string name : {"Default_Scene", "Main_Test_Scene"})
+        {
+            const std::string file = (std::filesystem::path(config.m_scene_directory) / (name + ".json")).string();
+
+            scenes.push_back({name, [file]()
+                              {
+                                  if (!std::filesystem::exists(file))
+                                      throw std::runtime_error("cannot open scene " + file);
+
+                                  Scene scene(Camera(200, 150, (float)std::numbers::pi / 3), World());
+                                  scene.load_scene(file);
+                                  return scene;
+                              }});
+        }
+
+        scenes.push_back({"Stress_Sphere_Grid", sphere_grid_scene});
+        scenes.push_back({"Stress_Glass", glass_scene});
+        scenes.push_back({"Stress_Many_Lights", many_lights_scene});
+        scenes.push_back({"Stress_Random_Cubes", random_cubes_scene});
+        scenes.push_back({"Stress_Instances", instances_scene});
+
+        return scenes;
+    }
+
+    /**
+     * @brief Render a scene at every thread count and compare the images against its golden render
+     *
+     * @param failures Incremented if the scene could not be rendered or an image is below the PSNR threshold
+     */
+    [[nodiscard]] inline nlohmann::json run_scene_benchmark(const SceneBenchmarkConfig &config, const BenchmarkScene &benchmark_scene, int &failures)
+    {
+        nlohmann::json json;
+        json["name"] = benchmark_scene.m_name;
+
+        Scene scene = benchmark_scene.m_create();
+
+        Camera &camera = scene.m_camera;
+        camera.set_width(config.m_width);
+        camera.set_height(config.m_height);
+        camera.set_wavefront(config.m_wavefront);
+
+        const size_t pixel_count = static_cast<size_t>(config.m_width) * static_cast<size_t>(config.m_height);
+        const size_t primary_rays = pixel_count * static_cast<size_t>(camera.get_samples());
+
+        json["width"] = config.m_width;
+        json["height"] = config.m_height;
+        json["shapes"] = scene.m_world.get_shapes().size();
+        json["lights"] = scene.m_world.get_lights().size();
+        json["bvh"] = scene.m_world.get_bvh().get_build_stats().to_json();
+
+        const std::string golden_file = (std::filesystem::path(config.m_golden_directory) / (benchmark_scene.m_name + ".ppm")).string();
+
+        int golden_width = 0;
+        int golden_height = 0;
+        std::shared_ptr<Color[]> golden;
+
+        if (!config.m_update_goldens)
+        {
+            golden = read_ppm(golden_file, golden_width, golden_height);
+
+            if (golden && (golden_width != config.m_width || golden_height != config.m_height))
+                golden = nullptr;
+        }
+
+        double min_psnr = std::numeric_limits<double>::infinity();
+        double single_thread_ms = 0;
+
+        json["runs"] = nlohmann::json::array();
+
+        for (const int threads : thread_counts(config.m_max_threads))
+        {
+            std::vector<double> times;
+            std::shared_ptr<Color[]> image;
+
+            for (int i = 0; i < std::max(1, config.m_repetitions); i++)
+            {
+                Timer timer;
+
+                image = camera.classic_render_multi_threaded(scene.m_world, threads);
+
+                times.emplace_back(timer.elapsed_millis());
+            }
+
+            std::sort(times.begin(), times.end());
+
+            const double wall_ms = times[times.size() / 2];
+
+            if (threads == 1)
+                single_thread_ms = wall_ms;
+
+            nlohmann::json run;
+            run["threads"] = threads;
+            run["wall_ms"] = wall_ms;
+            run["primary_rays_per_second"] = wall_ms > 0 ? (double)primary_rays / (wall_ms / 1000) : 0;
+            run["parallel_efficiency"] = wall_ms > 0 ? single_thread_ms / (wall_ms * threads) : 0;
+            run["load_imbalance"] = camera.get_load_imbalance();
+            run["peak_rss_mb"] = (double)get_peak_rss() / (1024.0 * 1024.0);
+
+            // counters of the last repetition, every ray (shadow and secondary ones too) per second
+            if (RenderCounters::is_enabled())
+            {
+                const RenderCounters &counters = camera.get_render_counters();
+
+                run["counters"] = counters.to_json();
+                run["rays_per_second"] = wall_ms > 0 ? (double)counters.total_rays() / (wall_ms / 1000) : 0;
+            }
+
+            if (camera.get_wavefront())
+                run["wavefront"] = camera.get_wavefront_stats().to_json();
+
+            // every thread count has to produce the golden image
+            if (golden)
+            {
+                const double image_psnr = psnr(image.get(), golden.get(), pixel_count);
+                min_psnr = std::min(min_psnr, image_psnr);
+
+                run["psnr"] = std::isinf(image_psnr) ? nlohmann::json("inf") : nlohmann::json(image_psnr);
+            }
+
+            json["runs"].push_back(run);
+
+            std::cerr << std::left << std::setw(24) << benchmark_scene.m_name << std::right << std::setw(3) << threads << " threads"
+                      << std::fixed << std::setprecision(2) << std::setw(12) << wall_ms << " ms"
+                      << std::setw(10) << run["parallel_efficiency"].get<double>() * 100 << "% efficiency"
+                      << std::setw(10) << run["peak_rss_mb"].get<double>() << " MB peak\n";
+
+            if (config.m_update_goldens && threads == 1)
+            {
+                std::filesystem::create_directories(config.m_golden_directory);
+
+                if (write_ppm(image, config.m_width, config.m_height, golden_file) < 0)
+                    failures++;
+            }
+        }
+
+        if (config.m_update_goldens)
+            json["golden"] = "updated";
+        else if (!golden)
+        {
+            json["golden"] = "missing";
+            failures++;
+
+            std::cerr << "  no golden image for " << benchmark_scene.m_name << " at " << golden_file << "\n";
+        }
+        else
+        {
+            const bool passed = min_psnr >= config.m_psnr_threshold;
+
+            json["golden"] = passed ? "passed" : "failed";
+            json["min_psnr"] = std::isinf(min_psnr) ? nlohmann::json("inf") : nlohmann::json(min_psnr);
+
+            failures += passed ? 0 : 1;
+
+            if (!passed)
+                std::cerr << "  " << benchmark_scene.m_name << " differs from its golden image, PSNR " << min_psnr << " dB\n";
+        }
+
+        return json;
+    }
+
+    // run every scene benchmark the filter allows, failures counts scenes that errored or did not match their golden image
+    [[nodiscard]] inline nlohmann::json run_scene_benchmarks(const SceneBenchmarkConfig &config, int &failures)
+    {
+        nlohmann::json json;
+        json["width"] = config.m_width;
+        json["height"] = config.m_height;
+        json["repetitions"] = config.m_repetitions;
+        json["psnr_threshold"] = config.m_psnr_threshold;
+        json["scenes"] = nlohmann::json::array();
+
+        for (const auto &scene : benchmark_scenes(config))
+        {
+            if (!config.m_filter.empty() && scene.m_name.find(config.m_filter) == std::string::npos)
+                continue;
+
+            try
+            {
+                json["scenes"].push_back(run_scene_benchmark(config, scene, failures));
+            }
+            catch (const std::exception &e)
+            {
+                failures++;
+
+                json["scenes"].push_back({{"name", scene.m_name}, {"error", e.what()}});
+
+                std::cerr << "  " << scene.m_name << ": " << e.what() << "\n";
+            }
+        }
+
+        return json;
+    }
+} // namespace COAL::Bench
@@ -0,0 +1,433 @@
+#include <COAL.hpp>
+
+namespace
+{
+    /**
+     * @brief One render of a batch, zero/empty values keep what the scene file specifies
+     *
+     */
+    struct RenderJob
+    {
+        std::string m_scene;
+        std::string m_output;
+        int m_width = 0;
+        int m_height = 0;
+        int m_samples = 0;
+        float m_field_of_view = 0;
+
+        // camera override, applied when m_has_view is set
+        bool m_has_view = false;
+        COAL::Point m_from = COAL::Point(0, 0, 0);
+        COAL::Point m_to = COAL::Point(0, 0, 1);
+        COAL::Vector m_up = COAL::Vector(0, 1, 0);
+    };
+
+    struct Options
+    {
+        int m_threads = kCORE_COUNT;
+        int m_tile_size = 16;
+        int m_samples = 1;
+        bool m_pin_threads = false;
+        bool m_packets = true;
+        bool m_wavefront = false;
+        std::string m_output_directory;
+        std::string m_timings_file;
+        std::string m_profile_directory;
+        COAL::HeatmapMode m_heatmap_mode = COAL::HeatmapMode::None;
+        ProfileMode m_profile_mode = ProfileMode::Trace;
+        std::vector<RenderJob> m_jobs;
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: coal_cli [options] <scene.json>...\n"
+                  << "\n"
+                  << "Options:\n"
+                  << "  --threads <n>        render threads (default: every core)\n"
+                  << "  --tile <n>           tile edge length in pixels (default: 16)\n"
+                  << "  --samples <n>        rays per pixel (default: 1)\n"
+                  << "  --width <n>          override the camera width\n"
+                  << "  --height <n>         override the camera height\n"
+                  << "  --output <file>      output image (.jpg or .ppm), only valid with a single scene\n"
+                  << "  --output-dir <dir>   directory for the rendered images\n"
+                  << "  --batch <jobs.json>  render every job of a batch file\n"
+                  << "  --timings <file>     write the timings there instead of stdout\n"
+                  << "  --pin                pin the render threads to cores\n"
+                  << "  --no-packets         trace primary rays one by one instead of as SIMD packets\n"
+                  << "  --wavefront          trace each tile level by level through sorted ray queues instead of recursively\n"
+                  << "  --heatmap <mode>     also save a false color cost image per render, time, rays or tests\n"
+                  << "                       (rays and tests need a RENDER_COUNTERS build)\n"
+                  << "  --profile <dir>      write a Perfetto trace of the profiled scopes (needs a PROFILING build)\n"
+                  << "  --profile-stats <dir> only aggregate the profiled scopes and print the hot spots\n"
+                  << "\n"
+                  << "A batch file is a list of jobs (or an object with a \"jobs\" list), for example:\n"
+                  << "  [{\"scene\": \"a.json\", \"output\": \"a.jpg\", \"width\": 800, \"height\": 600, \"samples\": 4,\n"
+                  << "    \"camera\": {\"from\": [0, 1.5, -5], \"to\": [0, 1, 0], \"up\": [0, 1, 0], \"field_of_view\": 1.047}}]\n";
+    }
+
+    [[nodiscard]] COAL::Point point_from_json(const nlohmann::json &json)
+    {
+        return COAL::Point(json.at(0).get<float>(), json.at(1).get<float>(), json.at(2).get<float>());
+    }
+
+    [[nodiscard]] COAL::Vector vector_from_json(const nlohmann::json &json)
+    {
+        return COAL::Vector(json.at(0).get<float>(), json.at(1).get<float>(), json.at(2).get<float>());
+    }
+
+    [[nodiscard]] RenderJob job_from_json(const nlohmann::json &json)
+    {
+        RenderJob job;
+
+        job.m_scene = json.at("scene").get<std::string>();
+        job.m_output = json.value("output", "");
+        job.m_width = json.value("width", 0);
+        job.m_height = json.value("height", 0);
+        job.m_samples = json.value("samples", 0);
+
+        if (json.contains("camera"))
+        {
+            const auto &camera = json["camera"];
+
+            job.m_field_of_view = camera.value("field_of_view", 0.0f);
+
+            if (camera.contains("from") || camera.contains("to") || camera.contains("up"))
+            {
+                job.m_has_view = true;
+                job.m_from = point_from_json(camera.at("from"));
+                job.m_to = point_from_json(camera.at("to"));
+                job.m_up = camera.contains("up") ? vector_from_json(camera["up"]) : COAL::Vector(0, 1, 0);
+            }
+        }
+
+        return job;
+    }
+
+    [[nodiscard]] std::vector<RenderJob> read_batch(const std::string &file_name)
+    {
+        std::ifstream file(file_name);
+
+        if (!file)
+            throw std::runtime_error("cannot open batch file " + file_name);
+
+        nlohmann::json json;
+        file >> json;
+
+        const nlohmann::json &jobs = json.is_object() ? json.at("jobs") : json;
+
+        std::vector<RenderJob> result;
+
+        for (const auto &job : jobs)
+            result.emplace_back(job_from_json(job));
+
+        return result;
+    }
+
+    // parse the command line, returns false if the program should exit
+    // the image writers by extension, the extension is compared case insensitive
+    [[nodiscard]] std::string output_extension(const std::string &path)
+    {
+        std::string extension = std::filesystem::path(path).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](const unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+
+        return extension;
+    }
+
+    [[nodiscard]] bool is_supported_output(const std::string &path)
+    {
+        const std::string extension = output_extension(path);
+
+        return extension == ".jpg" || extension == ".jpeg" || extension == ".ppm";
+    }
+
+    [[nodiscard]] int save_output(const std::shared_ptr<COAL::Color[]> &canvas, const int width, const int height, const std::string &path)
+    {
+        if (output_extension(path) == ".ppm")
+            return COAL::write_ppm(canvas, width, height, path);
+
+        return COAL::save_image(canvas, width, height, path);
+    }
+
+    [[nodiscard]] bool parse_arguments(const int argc, char **argv, Options &options)
+    {
+        std::string output;
+        int width = 0;
+        int height = 0;
+
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+
+            auto next = [&]() -> std::string
+            {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("missing value for " + arg);
+
+                return argv[++i];
+            };
+
+            if (arg == "--help" || arg == "-h")
+            {
+                print_usage();
+                return false;
+            }
+            else if (arg == "--threads")
+                options.m_threads = std::stoi(next());
+            else if (arg == "--tile")
+                options.m_tile_size = std::stoi(next());
+            else if (arg == "--samples")
+                options.m_samples = std::stoi(next());
+            else if (arg == "--width")
+                width = std::stoi(next());
+            else if (arg == "--height")
+                height = std::stoi(next());
+            else if (arg == "--output")
+                output = next();
+            else if (arg == "--output-dir")
+                options.m_output_directory = next();
+            else if (arg == "--batch")
+            {
+                auto jobs = read_batch(next());
+                options.m_jobs.insert(options.m_jobs.end(), jobs.begin(), jobs.end());
+            }
+            else if (arg == "--timings")
+                options.m_timings_file = next();
+            else if (arg == "--pin")
+                options.m_pin_threads = true;
+            else if (arg == "--no-packets")
+                options.m_packets = false;
+            else if (arg == "--wavefront")
+                options.m_wavefront = true;
+            else if (arg == "--heatmap")
+            {
+                const std::string name = next();
+                const auto mode = COAL::heatmap_mode_from_name(name);
+
+                if (!mode)
+                    throw std::runtime_error("unknown heatmap mode " + name + ", expected time, rays or tests");
+
+                if (!COAL::is_heatmap_mode_available(*mode))
+                    throw std::runtime_error("the " + name + " heatmap needs a build with RENDER_COUNTERS");
+
+                options.m_heatmap_mode = *mode;
+            }
+            else if (arg == "--profile" || arg == "--profile-stats")
+            {
+                options.m_profile_directory = next();
+                options.m_profile_mode = arg == "--profile" ? ProfileMode::Trace : ProfileMode::Aggregate;
+            }
+            else if (arg.starts_with("--"))
+                throw std::runtime_error("unknown option " + arg);
+            else
+            {
+                RenderJob job;
+                job.m_scene = arg;
+                options.m_jobs.emplace_back(job);
+            }
+        }
+
+        if (options.m_jobs.empty())
+        {
+            print_usage();
+            return false;
+        }
+
+        if (!output.empty())
+        {
+            if (options.m_jobs.size() != 1)
+                throw std::runtime_error("--output needs exactly one scene, use --output-dir for several");
+
+            options.m_jobs[0].m_output = output;
+        }
+
+        // command line sizes apply to every job that does not set its own
+        for (auto &job : options.m_jobs)
+        {
+            // checked before anything is rendered, a batch should not fail at its last image
+            if (!job.m_output.empty() && !is_supported_output(job.m_output))
+                throw std::runtime_error("unsupported output format " + job.m_output + ", use .jpg or .ppm");
+
+            job.m_width = job.m_width > 0 ? job.m_width : width;
+            job.m_height = job.m_height > 0 ? job.m_height : height;
+        }
+
+        return true;
+    }
+
+    [[nodiscard]] std::string output_path(const Options &options, const RenderJob &job, const size_t index)
+    {
+        std::filesystem::path path = job.m_output;
+
+        if (path.empty())
+            path = std::filesystem::path(job.m_scene).stem().string() + "_" + std::to_string(index) + ".jpg";
+
+        if (!options.m_output_directory.empty() && path.is_relative())
+            path = std::filesystem::path(options.m_output_directory) / path;
+
+        return path.string();
+    }
+
+    [[nodiscard]] nlohmann::json render_job(const Options &options, const RenderJob &job, const size_t index, const std::shared_ptr<COAL::ThreadPool> &pool)
+    {
+        nlohmann::json timings;
+        timings["scene"] = job.m_scene;
+
+        if (!std::filesystem::exists(job.m_scene))
+            throw std::runtime_error("cannot open scene " + job.m_scene);
+
+        COAL::Timer timer;
+
+        COAL::Scene scene(COAL::Camera(800, 600, (float)std::numbers::pi / 3), COAL::World());
+        scene.m_world.set_thread_pool(pool);
+        scene.load_scene(job.m_scene);
+
+        timings["load_ms"] = timer.elapsed_millis();
+        timings["bvh"] = scene.m_world.get_bvh().get_build_stats().to_json();
+
+        COAL::Camera &camera = scene.m_camera;
+
+        if (job.m_width > 0)
+            camera.set_width(job.m_width);
+
+        if (job.m_height > 0)
+            camera.set_height(job.m_height);
+
+        if (job.m_field_of_view > 0)
+            camera.set_field_of_view(job.m_field_of_view);
+
+        if (job.m_has_view)
+            camera.transform(job.m_from, job.m_to, job.m_up);
+
+        camera.set_tile_size(options.m_tile_size);
+        camera.set_samples(job.m_samples > 0 ? job.m_samples : options.m_samples);
+        camera.set_thread_pool(pool);
+        camera.set_heatmap_mode(options.m_heatmap_mode);
+
+        if (!options.m_packets)
+            camera.set_packet_tracing(false);
+
+        camera.set_wavefront(options.m_wavefront);
+
+        timer.reset();
+
+        auto canvas = camera.classic_render_multi_threaded(scene.m_world, pool->get_thread_count());
+
+        timings["render_ms"] = timer.elapsed_millis();
+        timings["load_imbalance"] = camera.get_load_imbalance();
+
+        if (COAL::RenderCounters::is_enabled())
+            timings["counters"] = camera.get_render_counters().to_json();
+
+        if (camera.get_wavefront())
+            timings["wavefront"] = camera.get_wavefront_stats().to_json();
+
+        const std::string output = output_path(options, job, index);
+
+        timer.reset();
+
+        const int saved = save_output(canvas, camera.get_width(), camera.get_height(), output);
+
+        timings["save_ms"] = timer.elapsed_millis();
+        timings["output"] = output;
+        timings["width"] = camera.get_width();
+        timings["height"] = camera.get_height();
+        timings["samples"] = camera.get_samples();
+        timings["packets"] = camera.get_packet_tracing();
+        timings["shapes"] = scene.m_world.get_shapes().size();
+
+        if (saved < 0)
+            timings["error"] = "failed to save " + output;
+
+        const COAL::Heatmap &heatmap = camera.get_heatmap();
+
+        if (heatmap.is_enabled())
+        {
+            std::filesystem::path heatmap_path = output;
+            heatmap_path.replace_filename(heatmap_path.stem().string() + "_heatmap_" + COAL::heatmap_mode_name(heatmap.m_mode) + heatmap_path.extension().string());
+
+            if (save_output(heatmap.to_image(), camera.get_width(), camera.get_height(), heatmap_path.string()) < 0)
+                timings["error"] = "failed to save " + heatmap_path.string();
+
+            timings["heatmap"] = {{"output", heatmap_path.string()}, {"mode", COAL::heatmap_mode_name(heatmap.m_mode)}, {"total", heatmap.total()}, {"p99", heatmap.percentile(0.99f)}};
+        }
+
+        return timings;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+
+    try
+    {
+        if (!parse_arguments(argc, argv, options))
+            return 1;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "coal_cli: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (!options.m_output_directory.empty())
+        std::filesystem::create_directories(options.m_output_directory);
+
+    if (!options.m_profile_directory.empty())
+    {
+        if (!PROFILING)
+            std::cerr << "coal_cli: built without PROFILING, the profile will be empty\n";
+
+        Instrumentor::Get().beginSession("coal_cli", options.m_profile_directory, options.m_profile_mode);
+    }
+
+    COAL::Timer total_timer;
+
+    // one pool for the whole batch, the workers stay warm between renders
+    auto pool = std::make_shared<COAL::ThreadPool>(options.m_threads, options.m_pin_threads);
+
+    nlohmann::json report;
+    report["threads"] = pool->get_thread_count();
+    report["tile_size"] = options.m_tile_size;
+    report["pinned"] = options.m_pin_threads;
+    report["renders"] = nlohmann::json::array();
+
+    int failures = 0;
+
+    for (size_t i = 0; i < options.m_jobs.size(); i++)
+    {
+        const RenderJob &job = options.m_jobs[i];
+
+        try
+        {
+            nlohmann::json timings = render_job(options, job, i, pool);
+
+            failures += timings.contains("error") ? 1 : 0;
+
+            report["renders"].push_back(timings);
+        }
+        catch (const std::exception &e)
+        {
+            failures++;
+
+            report["renders"].push_back({{"scene", job.m_scene}, {"error", e.what()}});
+        }
+    }
+
+    report["total_ms"] = total_timer.elapsed_millis();
+
+    if (!options.m_profile_directory.empty())
+    {
+        Instrumentor::Get().endSession();
+
+        report["profile"] = options.m_profile_directory;
+    }
+
+    if (options.m_timings_file.empty())
+        std::cout << report.dump(4) << std::endl;
+    else
+        COAL::write_file(options.m_timings_file, report.dump(4));
+
+    return failures == 0 ? 0 : 2;
+}
@@ -70,6 +70,18 @@ public:
                     scene.load_scene(path);
             }
 
+            ImGui::SameLine();
+
+            // an .obj or .ply file
+            if (ImGui::Button("Add Mesh"))
+            {
+                if (strlen(path) > 0)
+                {
+                    if (auto data = COAL::MeshLoader::load(path, scene.m_world.get_thread_pool()))
+                        scene.m_world.add_shape(std::make_shared<COAL::Mesh>(data));
+                }
+            }
+
             { // save scene
 
                 static char name[32] = "Default_Scene";
@@ -156,7 +168,7 @@ public:
 
                 for (int i = 0; i < shapes.size(); i++)
                 {
-                    if (ImGui::Selectable((shapes[i]->get_name() + std::to_string(i)).c_str()))
+                    if (ImGui::Selectable((shapes[i]->get_name() + std::to_string(scene.m_world.get_id(*shapes[i]))).c_str()))
                         selected = i;
                 }
 
@@ -213,20 +225,27 @@ public:
                             float rotation[3] = {rotations.x, rotations.y, rotations.z};
                             float scale[3] = {scales.x, scales.y, scales.z};
 
+                            bool edited = false;
+
                             // imgui text output
                             ImGui::Text("Translation: (x, y, z):");
-                            ImGui::SliderFloat3("##Translation", transformation, -50, 50);
+                            edited |= ImGui::SliderFloat3("##Translation", transformation, -50, 50);
 
                             ImGui::Spacing();
 
                             ImGui::Text("Rotation: (x, y, z):");
-                            ImGui::SliderFloat3("##Rotation", rotation, -180, 180);
+                            edited |= ImGui::SliderFloat3("##Rotation", rotation, -180, 180);
 
                             ImGui::Spacing();
                             ImGui::Text("Scale: (x, y, z):");
-                            ImGui::SliderFloat3("##Scale", scale, 0.1f, 10);
+                            edited |= ImGui::SliderFloat3("##Scale", scale, 0.1f, 10);
 
-                            shape->transform_deg(transformation, rotation, scale);
+                            // only the moved shape is refit into the BVH before the next render
+                            if (edited)
+                            {
+                                shape->transform_deg(transformation, rotation, scale);
+                                scene.m_world.mark_dirty(scene.m_world.get_id(*shape));
+                            }
                         }
                         else
                         {
@@ -336,6 +355,12 @@ public:
             }
 
             ImGui::Text("Last render: %.3fms", m_LastRenderTime);
+
+            const COAL::BVHUpdateStats &bvh_stats = scene.m_world.get_bvh().get_update_stats();
+            ImGui::Text("BVH update: refit %.3fms, rebuild %.3fms, SAH %.2f", bvh_stats.m_refit_ms, bvh_stats.m_rebuild_ms, bvh_stats.m_sah);
+
+            const COAL::BVHBuildStats &build_stats = scene.m_world.get_bvh().get_build_stats();
+            ImGui::Text("BVH build: %u nodes in %.3fms on %d threads, SAH %.2f", build_stats.m_nodes, build_stats.m_build_ms, build_stats.m_threads, build_stats.m_sah);
         }
 
         if (!is_first_render)
@@ -385,6 +410,9 @@ public:
 
         // canvas = a2.get();
 
+        // the editor moves shapes in place and marks them dirty, the BVH refits them before every render
+        scene.m_world.refit_acceleration();
+
         canvas = scene.m_camera.classic_render_multi_threaded(scene.m_world);
 
         if (!m_Image || m_ViewportWidth != m_Image->GetWidth() || m_ViewportHeight != m_Image->GetHeight())
@@ -428,6 +456,11 @@ Walnut::Application *Walnut::CreateApplication([[maybe_unused]] int argc, [[mayb
 {
     Instrumentor::Get().beginSession("Main func"); // Start profiling session
 
+    // the renders and the BVH builds share the workers
+    auto pool = std::make_shared<COAL::ThreadPool>();
+    scene.m_camera.set_thread_pool(pool);
+    scene.m_world.set_thread_pool(pool);
+
     auto floor = std::make_shared<COAL::XZPlane>(COAL::XZPlane());
     floor->get_material().set_color(COAL::Color(1.0f, 0.9f, 0.9f)).set_specular(0).set_reflectiveness(0.3f);
 
@@ -483,30 +516,13 @@ int main()
 
     scene.m_camera.transform(COAL::Point(0, 1.5, -5), COAL::Point(0, 1, 0), COAL::Vector(0, 1, 0));
 
-    canvas = scene.m_camera.classic_render_multi_threaded(world, 4);
+    canvas = scene.m_camera.classic_render_multi_threaded(scene.m_world, 4);
 
     Instrumentor::Get().endSession();
 
-    // Get a console handle
-    HWND myconsole = GetConsoleWindow();
-    // Get a handle to device context
-    HDC mydc = GetDC(myconsole);
-
-    // Draw pixels
-    for (int16_t i = 0; i < scene.m_camera.get_width(); i++)
-    {
-
-        for (int16_t j = 0; j < scene.m_camera.get_height(); j++)
-        {
-            COLORREF COLOR = RGB(canvas.get()[j * scene.m_camera.get_width() + i].r, canvas.get()[j * scene.m_camera.get_width() + i].g, canvas.get()[j * scene.m_camera.get_width() + i].b);
-
-            SetPixel(mydc, i, j, COLOR);
-        }
-    }
-
-    ReleaseDC(myconsole, mydc);
+    // there is no console drawing outside of Windows, write the render to disk instead (see coal_cli for the full headless renderer)
+    COAL::save_image(canvas, scene.m_camera.get_width(), scene.m_camera.get_height(), "render.jpg");
 
-    std::cin.ignore();
     return 0;
 }
 